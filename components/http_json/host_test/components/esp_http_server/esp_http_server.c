@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_http_server.h"
+
+#define FAKE_HTTPD_MAX_HANDLERS 16
+
+// Everything is static, the fake must not show up in the test's allocation counts
+static httpd_uri_t handlers[FAKE_HTTPD_MAX_HANDLERS];
+static int handler_count = 0;
+
+static const char* req_header = NULL;
+static const char* req_body = NULL;
+static size_t req_body_at = 0;
+static fake_httpd_resp_t* resp = NULL;
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    if (handler_count == FAKE_HTTPD_MAX_HANDLERS) return ESP_ERR_NO_MEM;
+
+    handlers[handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+void fake_httpd_reset(void) {
+    handler_count = 0;
+}
+
+static bool fake_httpd_match(const char* pattern, const char* uri) {
+    size_t uri_len = strcspn(uri, "?");
+    size_t pattern_len = strlen(pattern);
+
+    if (pattern_len > 0 && pattern[pattern_len - 1] == '*') {
+        return uri_len >= pattern_len - 1 && strncmp(pattern, uri, pattern_len - 1) == 0;
+    }
+    return uri_len == pattern_len && strncmp(pattern, uri, uri_len) == 0;
+}
+
+esp_err_t fake_httpd_request(httpd_method_t method, const char* uri, const char* header, const char* body,
+                             fake_httpd_resp_t* response) {
+    const httpd_uri_t* handler = NULL;
+    for (int i=0; i<handler_count && handler == NULL; i++) {
+        if (handlers[i].method == method && fake_httpd_match(handlers[i].uri, uri)) handler = &handlers[i];
+    }
+    if (handler == NULL) return ESP_ERR_NOT_FOUND;
+
+    static httpd_req_t req;
+    memset(&req, 0, sizeof(req));
+    req.method = method;
+    req.user_ctx = handler->user_ctx;
+    req.content_len = body ? strlen(body) : 0;
+    snprintf((char*)req.uri, sizeof(req.uri), "%s", uri);
+
+    memset(response, 0, sizeof(*response));
+    snprintf(response->status, sizeof(response->status), "200 OK");
+
+    req_header = header;
+    req_body = body;
+    req_body_at = 0;
+    resp = response;
+
+    response->err = handler->handler(&req);
+
+    resp = NULL;
+    return ESP_OK;
+}
+
+const char* fake_httpd_resp_header(const fake_httpd_resp_t* response, const char* name) {
+    for (int i=0; i<response->header_count; i++) {
+        if (strcasecmp(response->header_names[i], name) == 0) return response->header_values[i];
+    }
+    return NULL;
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    size_t left = r->content_len - req_body_at;
+    if (buf_len > left) buf_len = left;
+
+    memcpy(buf, req_body + req_body_at, buf_len);
+    req_body_at += buf_len;
+    return buf_len;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    size_t field_len = strlen(field);
+    const char* line = req_header;
+    while (line != NULL) {
+        if (strncasecmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            const char* value = line + field_len + 1;
+            while (*value == ' ') value++;
+            size_t len = strcspn(value, "\n");
+            if (len >= val_size) return ESP_ERR_HTTPD_RESULT_TRUNC;
+
+            memcpy(val, value, len);
+            val[len] = '\0';
+            return ESP_OK;
+        }
+
+        line = strchr(line, '\n');
+        if (line != NULL) line++;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    const char* query = strchr(r->uri, '?');
+    if (query == NULL) return ESP_ERR_NOT_FOUND;
+
+    int len = snprintf(buf, buf_len, "%s", query + 1);
+    return (len >= (int)buf_len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size) {
+    size_t key_len = strlen(key);
+    const char* at = qry;
+    while (at != NULL) {
+        if (strncmp(at, key, key_len) == 0 && at[key_len] == '=') {
+            const char* value = at + key_len + 1;
+            size_t len = strcspn(value, "&");
+            if (len >= val_size) return ESP_ERR_HTTPD_RESULT_TRUNC;
+
+            memcpy(val, value, len);
+            val[len] = '\0';
+            return ESP_OK;
+        }
+
+        at = strchr(at, '&');
+        if (at != NULL) at++;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    snprintf(resp->status, sizeof(resp->status), "%s", status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    return httpd_resp_set_hdr(r, "Content-Type", type);
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    if (resp->header_count == FAKE_HTTPD_MAX_HEADERS) return ESP_ERR_HTTPD_RESP_HDR;
+
+    int i = resp->header_count++;
+    snprintf(resp->header_names[i], sizeof(resp->header_names[i]), "%s", field);
+    snprintf(resp->header_values[i], sizeof(resp->header_values[i]), "%s", value);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    if (buf == NULL) return ESP_OK;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) buf_len = strlen(buf);
+
+    size_t room = FAKE_HTTPD_MAX_BODY - resp->length;
+    if ((size_t)buf_len > room) {
+        buf_len = room;
+        resp->is_truncated = true;
+    }
+
+    memcpy(resp->body + resp->length, buf, buf_len);
+    resp->length += buf_len;
+    resp->body[resp->length] = '\0';
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    return httpd_resp_send_chunk(r, buf, buf_len);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    const char* status;
+    switch (error) {
+        case HTTPD_400_BAD_REQUEST:
+            status = "400 Bad Request";
+            break;
+        case HTTPD_404_NOT_FOUND:
+            status = "404 Not Found";
+            break;
+        default:
+            status = "500 Internal Server Error";
+            break;
+    }
+
+    httpd_resp_set_status(req, status);
+    return httpd_resp_send(req, msg ? msg : status, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_404(httpd_req_t* r) {
+    return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t* r) {
+    return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+}
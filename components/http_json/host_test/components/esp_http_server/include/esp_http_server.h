@@ -0,0 +1,112 @@
+#ifndef ESP_HTTP_SERVER_H
+#define ESP_HTTP_SERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <esp_err.h>
+
+// Just the parts of esp_http_server the API handlers and http_json use. There is no
+// socket or server task, `fake_httpd_request` runs a request straight through the
+// registered handlers and keeps the response in memory.
+
+#define ESP_ERR_HTTPD_BASE (0xb000)
+#define ESP_ERR_HTTPD_RESP_HDR (ESP_ERR_HTTPD_BASE + 2)
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 4)
+
+#define HTTPD_RESP_USE_STRLEN -1
+#define HTTPD_SOCK_ERR_FAIL -1
+#define HTTPD_SOCK_ERR_INVALID -2
+#define HTTPD_SOCK_ERR_TIMEOUT -3
+
+#define FAKE_HTTPD_MAX_URI 512
+#define FAKE_HTTPD_MAX_BODY 8192
+#define FAKE_HTTPD_MAX_HEADERS 4
+
+typedef void* httpd_handle_t;
+
+// Same values as http_parser's methods
+typedef enum {
+    HTTP_DELETE = 0,
+    HTTP_GET = 1,
+    HTTP_POST = 3,
+    HTTP_PUT = 4,
+} httpd_method_t;
+
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+    HTTPD_400_BAD_REQUEST = 3,
+    HTTPD_404_NOT_FOUND = 6,
+} httpd_err_code_t;
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;
+    const char uri[FAKE_HTTPD_MAX_URI + 1];
+    size_t content_len;
+    void* aux;
+    void* user_ctx;
+    void* sess_ctx;
+} httpd_req_t;
+
+typedef struct {
+    const char* uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t* r);
+    void* user_ctx;
+} httpd_uri_t;
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler);
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size);
+
+// There's no connection to keep open, so handing a request off always fails
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out);
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r);
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status);
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value);
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg);
+esp_err_t httpd_resp_send_404(httpd_req_t* r);
+esp_err_t httpd_resp_send_500(httpd_req_t* r);
+
+typedef struct {
+    // Status line without the "HTTP/1.1", e.g. "200 OK"
+    char status[32];
+    char body[FAKE_HTTPD_MAX_BODY + 1];
+    size_t length;
+    // Set if the body didn't fit
+    bool is_truncated;
+    char header_names[FAKE_HTTPD_MAX_HEADERS][24];
+    char header_values[FAKE_HTTPD_MAX_HEADERS][64];
+    int header_count;
+    // What the handler returned
+    esp_err_t err;
+} fake_httpd_resp_t;
+
+/**
+ * @brief Runs `method` `uri` through the first registered handler that matches it, the
+ * way `httpd_uri_match_wildcard` would. `header` holds "Name: value" request headers, one
+ * per line, or is NULL, `body` can be NULL. Returns ESP_ERR_NOT_FOUND if no handler matches.
+ */
+esp_err_t fake_httpd_request(httpd_method_t method, const char* uri, const char* header, const char* body,
+                             fake_httpd_resp_t* resp);
+
+/**
+ * @brief Returns the value of response header `name`, NULL if it wasn't set.
+ */
+const char* fake_httpd_resp_header(const fake_httpd_resp_t* resp, const char* name);
+
+/**
+ * @brief Forgets every registered handler.
+ */
+void fake_httpd_reset(void);
+
+#endif
@@ -0,0 +1,587 @@
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+
+#include "http_json.h"
+
+static const char* TAG = "HTTP JSON";
+
+typedef enum {
+    JSON_STATE_VALUE,
+    // After `[`, a value or `]`
+    JSON_STATE_ARRAY_FIRST,
+    // After `{`, a key or `}`
+    JSON_STATE_OBJECT_FIRST,
+    // After a `,` in an object
+    JSON_STATE_KEY,
+    JSON_STATE_COLON,
+    // After a value, `,` or the end of its container
+    JSON_STATE_AFTER,
+    JSON_STATE_STRING,
+    JSON_STATE_ESCAPE,
+    JSON_STATE_CODE,
+    JSON_STATE_NUMBER,
+    JSON_STATE_LITERAL,
+    JSON_STATE_DONE,
+    JSON_STATE_ERROR,
+} json_state_t;
+
+static void json_writer_put(json_writer_t* writer, const char* data, size_t length) {
+    while (length > 0 && writer->err == ESP_OK) {
+        if (writer->length == sizeof(writer->buffer)) json_writer_flush(writer);
+
+        size_t room = sizeof(writer->buffer) - writer->length;
+        size_t count = (length < room) ? length : room;
+        memcpy(writer->buffer + writer->length, data, count);
+        writer->length += count;
+        data += count;
+        length -= count;
+    }
+}
+
+static void json_writer_escaped(json_writer_t* writer, const char* value) {
+    static const char hex[] = "0123456789abcdef";
+
+    json_writer_put(writer, "\"", 1);
+    while (*value != '\0') {
+        // Runs of plain characters go in one copy
+        size_t run = 0;
+        while (value[run] != '\0' && value[run] != '"' && value[run] != '\\' && (uint8_t)value[run] >= 0x20) run++;
+        json_writer_put(writer, value, run);
+        value += run;
+        if (*value == '\0') break;
+
+        char escape[6] = { '\\', *value };
+        size_t length = 2;
+        switch (*value) {
+            case '"': case '\\': break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hex[(uint8_t)*value >> 4];
+                escape[5] = hex[*value & 0xf];
+                length = 6;
+                break;
+        }
+        json_writer_put(writer, escape, length);
+        value++;
+    }
+    json_writer_put(writer, "\"", 1);
+}
+
+/**
+ * @brief Writes the separator and key that go before every value.
+ */
+static void json_writer_item(json_writer_t* writer, const char* key) {
+    // Several root values only happen in event streams, where the caller frames them
+    if (writer->depth > 0) {
+        uint32_t bit = 1u << writer->depth;
+        if (writer->has_items & bit) json_writer_put(writer, ",", 1);
+        writer->has_items |= bit;
+    }
+
+    if (key != NULL) {
+        json_writer_escaped(writer, key);
+        json_writer_put(writer, ":", 1);
+    }
+}
+
+static void json_writer_open(json_writer_t* writer, const char* key, bool is_object) {
+    json_writer_item(writer, key);
+    if (writer->depth == JSON_MAX_DEPTH) {
+        writer->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    json_writer_put(writer, is_object ? "{" : "[", 1);
+    writer->depth++;
+    uint32_t bit = 1u << writer->depth;
+    writer->has_items &= ~bit;
+    writer->is_object = is_object ? (writer->is_object | bit) : (writer->is_object & ~bit);
+}
+
+void json_writer_init(json_writer_t* writer, httpd_req_t* req) {
+    writer->req = req;
+    writer->err = ESP_OK;
+    writer->length = 0;
+    writer->depth = 0;
+    writer->is_object = 0;
+    writer->has_items = 0;
+}
+
+void json_writer_begin(json_writer_t* writer, httpd_req_t* req) {
+    json_writer_init(writer, req);
+    httpd_resp_set_type(req, "application/json");
+}
+
+void json_write_object(json_writer_t* writer, const char* key) {
+    json_writer_open(writer, key, true);
+}
+
+void json_write_array(json_writer_t* writer, const char* key) {
+    json_writer_open(writer, key, false);
+}
+
+void json_write_end(json_writer_t* writer) {
+    if (writer->depth == 0) {
+        writer->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    bool is_object = writer->is_object & (1u << writer->depth);
+    writer->depth--;
+    json_writer_put(writer, is_object ? "}" : "]", 1);
+}
+
+void json_write_string(json_writer_t* writer, const char* key, const char* value) {
+    json_writer_item(writer, key);
+    json_writer_escaped(writer, value);
+}
+
+void json_write_int(json_writer_t* writer, const char* key, int64_t value) {
+    json_writer_item(writer, key);
+
+    // Filled from the end, printf would be overkill
+    char digits[21];
+    size_t at = sizeof(digits);
+    uint64_t magnitude = (value < 0) ? -(uint64_t)value : (uint64_t)value;
+    do {
+        digits[--at] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) digits[--at] = '-';
+
+    json_writer_put(writer, digits + at, sizeof(digits) - at);
+}
+
+void json_write_bool(json_writer_t* writer, const char* key, bool value) {
+    json_writer_item(writer, key);
+    if (value) {
+        json_writer_put(writer, "true", 4);
+    } else {
+        json_writer_put(writer, "false", 5);
+    }
+}
+
+void json_write_null(json_writer_t* writer, const char* key) {
+    json_writer_item(writer, key);
+    json_writer_put(writer, "null", 4);
+}
+
+void json_write_raw(json_writer_t* writer, const char* text) {
+    json_writer_put(writer, text, strlen(text));
+}
+
+esp_err_t json_writer_flush(json_writer_t* writer) {
+    if (writer->err == ESP_OK && writer->length > 0) {
+        writer->err = httpd_resp_send_chunk(writer->req, writer->buffer, writer->length);
+    }
+    writer->length = 0;
+    return writer->err;
+}
+
+esp_err_t json_writer_finish(json_writer_t* writer) {
+    json_writer_flush(writer);
+    if (writer->err == ESP_OK) writer->err = httpd_resp_send_chunk(writer->req, NULL, 0);
+    return writer->err;
+}
+
+void json_parser_init(json_parser_t* parser, json_parse_cb_t cb, void* ctx) {
+    memset(parser, 0, sizeof(*parser));
+    parser->cb = cb;
+    parser->ctx = ctx;
+    parser->state = JSON_STATE_VALUE;
+}
+
+const char* json_parser_key(const json_parser_t* parser, uint8_t depth) {
+    if (depth == 0 || depth > parser->depth) return NULL;
+    return (parser->is_object & (1u << (depth - 1))) ? parser->keys[depth] : NULL;
+}
+
+bool json_event_copy(const json_event_t* event, char* dst, size_t size) {
+    if (event->type != JSON_STRING || strlen(event->string) >= size) return false;
+    strcpy(dst, event->string);
+    return true;
+}
+
+static void json_parser_emit(json_parser_t* parser, json_event_t* event) {
+    event->depth = parser->depth;
+    event->key = json_parser_key(parser, parser->depth);
+    bool is_item = parser->depth > 0 && !(parser->is_object & (1u << (parser->depth - 1)));
+    event->index = is_item ? parser->index[parser->depth] : -1;
+    parser->cb(parser, event, parser->ctx);
+}
+
+/**
+ * @brief Moves on once a whole value has been read.
+ */
+static void json_parser_value_done(json_parser_t* parser) {
+    parser->state = (parser->depth == 0) ? JSON_STATE_DONE : JSON_STATE_AFTER;
+}
+
+static esp_err_t json_parser_open(json_parser_t* parser, bool is_object) {
+    json_event_t event = { .type = is_object ? JSON_OBJECT : JSON_ARRAY };
+    json_parser_emit(parser, &event);
+
+    if (parser->depth == JSON_MAX_DEPTH) return ESP_ERR_INVALID_SIZE;
+
+    uint32_t bit = 1u << parser->depth;
+    parser->is_object = is_object ? (parser->is_object | bit) : (parser->is_object & ~bit);
+    parser->depth++;
+    parser->index[parser->depth] = 0;
+    parser->keys[parser->depth][0] = '\0';
+    parser->state = is_object ? JSON_STATE_OBJECT_FIRST : JSON_STATE_ARRAY_FIRST;
+    return ESP_OK;
+}
+
+static esp_err_t json_parser_close(json_parser_t* parser, bool is_object) {
+    if (parser->depth == 0) return ESP_ERR_INVALID_ARG;
+
+    bool is_open_object = parser->is_object & (1u << (parser->depth - 1));
+    if (is_open_object != is_object) return ESP_ERR_INVALID_ARG;
+
+    parser->depth--;
+    json_event_t event = { .type = JSON_END };
+    json_parser_emit(parser, &event);
+    json_parser_value_done(parser);
+    return ESP_OK;
+}
+
+static esp_err_t json_parser_append(json_parser_t* parser, const char* bytes, size_t count) {
+    size_t limit = parser->is_key ? JSON_MAX_KEY : JSON_MAX_STRING;
+    if (parser->length + count >= limit) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(parser->text + parser->length, bytes, count);
+    parser->length += count;
+    return ESP_OK;
+}
+
+static esp_err_t json_parser_append_code(json_parser_t* parser, uint32_t code) {
+    char utf8[4];
+    size_t count;
+    if (code < 0x80) {
+        utf8[0] = code;
+        count = 1;
+    } else if (code < 0x800) {
+        utf8[0] = 0xc0 | (code >> 6);
+        utf8[1] = 0x80 | (code & 0x3f);
+        count = 2;
+    } else if (code < 0x10000) {
+        utf8[0] = 0xe0 | (code >> 12);
+        utf8[1] = 0x80 | ((code >> 6) & 0x3f);
+        utf8[2] = 0x80 | (code & 0x3f);
+        count = 3;
+    } else {
+        utf8[0] = 0xf0 | (code >> 18);
+        utf8[1] = 0x80 | ((code >> 12) & 0x3f);
+        utf8[2] = 0x80 | ((code >> 6) & 0x3f);
+        utf8[3] = 0x80 | (code & 0x3f);
+        count = 4;
+    }
+    return json_parser_append(parser, utf8, count);
+}
+
+/**
+ * @brief Handles the `\uXXXX` escape just read, pairing up surrogates.
+ */
+static esp_err_t json_parser_code(json_parser_t* parser) {
+    uint32_t code = parser->code;
+    if (code >= 0xd800 && code < 0xdc00) {
+        if (parser->high_surrogate != 0) return ESP_ERR_INVALID_ARG;
+        parser->high_surrogate = code;
+        return ESP_OK;
+    }
+
+    if (code >= 0xdc00 && code < 0xe000) {
+        if (parser->high_surrogate == 0) return ESP_ERR_INVALID_ARG;
+        code = 0x10000 + ((parser->high_surrogate - 0xd800) << 10) + (code - 0xdc00);
+        parser->high_surrogate = 0;
+    } else if (parser->high_surrogate != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return json_parser_append_code(parser, code);
+}
+
+static esp_err_t json_parser_string_done(json_parser_t* parser) {
+    if (parser->high_surrogate != 0) return ESP_ERR_INVALID_ARG;
+    parser->text[parser->length] = '\0';
+
+    if (parser->is_key) {
+        memcpy(parser->keys[parser->depth], parser->text, parser->length + 1);
+        parser->state = JSON_STATE_COLON;
+        return ESP_OK;
+    }
+
+    json_event_t event = { .type = JSON_STRING, .string = parser->text };
+    json_parser_emit(parser, &event);
+    json_parser_value_done(parser);
+    return ESP_OK;
+}
+
+static bool json_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Moves `text` past a run of digits, false if there wasn't at least one
+static bool json_skip_digits(const char** text) {
+    const char* start = *text;
+    while (json_is_digit(**text)) (*text)++;
+    return *text != start;
+}
+
+static esp_err_t json_parser_number_done(json_parser_t* parser) {
+    parser->text[parser->length] = '\0';
+
+    // strtod takes more than JSON does, like a leading `+`, hex, `inf` and `1.`, so the
+    // text has to match the JSON grammar before it gets there
+    const char* text = parser->text;
+    if (*text == '-') text++;
+    if (text[0] == '0' && json_is_digit(text[1])) return ESP_ERR_INVALID_ARG;
+    if (!json_skip_digits(&text)) return ESP_ERR_INVALID_ARG;
+    if (*text == '.') {
+        text++;
+        if (!json_skip_digits(&text)) return ESP_ERR_INVALID_ARG;
+    }
+    if (*text == 'e' || *text == 'E') {
+        text++;
+        if (*text == '-' || *text == '+') text++;
+        if (!json_skip_digits(&text)) return ESP_ERR_INVALID_ARG;
+    }
+    if (*text != '\0') return ESP_ERR_INVALID_ARG;
+
+    json_event_t event = { .type = JSON_NUMBER, .number = strtod(parser->text, NULL) };
+
+    json_parser_emit(parser, &event);
+    json_parser_value_done(parser);
+    return ESP_OK;
+}
+
+static bool json_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool json_is_number(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static int json_hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Starts reading a value at `c`.
+ */
+static esp_err_t json_parser_value(json_parser_t* parser, char c) {
+    switch (c) {
+        case '{': return json_parser_open(parser, true);
+        case '[': return json_parser_open(parser, false);
+        case '"':
+            parser->is_key = false;
+            parser->length = 0;
+            parser->state = JSON_STATE_STRING;
+            return ESP_OK;
+        case 't': parser->literal = "true"; break;
+        case 'f': parser->literal = "false"; break;
+        case 'n': parser->literal = "null"; break;
+        default:
+            if (c != '-' && (c < '0' || c > '9')) return ESP_ERR_INVALID_ARG;
+            parser->length = 0;
+            parser->state = JSON_STATE_NUMBER;
+            parser->text[parser->length++] = c;
+            return ESP_OK;
+    }
+
+    parser->literal_at = 1;
+    parser->state = JSON_STATE_LITERAL;
+    return ESP_OK;
+}
+
+static esp_err_t json_parser_byte(json_parser_t* parser, char c) {
+    esp_err_t err;
+
+    switch (parser->state) {
+        case JSON_STATE_VALUE:
+            if (json_is_space(c)) return ESP_OK;
+            return json_parser_value(parser, c);
+
+        case JSON_STATE_ARRAY_FIRST:
+            if (json_is_space(c)) return ESP_OK;
+            if (c == ']') return json_parser_close(parser, false);
+            return json_parser_value(parser, c);
+
+        case JSON_STATE_OBJECT_FIRST:
+        case JSON_STATE_KEY:
+            if (json_is_space(c)) return ESP_OK;
+            if (c == '}' && parser->state == JSON_STATE_OBJECT_FIRST) return json_parser_close(parser, true);
+            if (c != '"') return ESP_ERR_INVALID_ARG;
+            parser->is_key = true;
+            parser->length = 0;
+            parser->state = JSON_STATE_STRING;
+            return ESP_OK;
+
+        case JSON_STATE_COLON:
+            if (json_is_space(c)) return ESP_OK;
+            if (c != ':') return ESP_ERR_INVALID_ARG;
+            parser->state = JSON_STATE_VALUE;
+            return ESP_OK;
+
+        case JSON_STATE_AFTER: {
+            if (json_is_space(c)) return ESP_OK;
+            bool is_object = parser->is_object & (1u << (parser->depth - 1));
+            if (c == ',') {
+                if (!is_object) parser->index[parser->depth]++;
+                parser->state = is_object ? JSON_STATE_KEY : JSON_STATE_VALUE;
+                return ESP_OK;
+            }
+            if (c == '}' || c == ']') return json_parser_close(parser, c == '}');
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        case JSON_STATE_STRING:
+            if (c == '"') return json_parser_string_done(parser);
+            if (c == '\\') {
+                parser->state = JSON_STATE_ESCAPE;
+                return ESP_OK;
+            }
+            if ((uint8_t)c < 0x20 || parser->high_surrogate != 0) return ESP_ERR_INVALID_ARG;
+            return json_parser_append(parser, &c, 1);
+
+        case JSON_STATE_ESCAPE: {
+            parser->state = JSON_STATE_STRING;
+            if (c == 'u') {
+                parser->code = 0;
+                parser->code_digits = 0;
+                parser->state = JSON_STATE_CODE;
+                return ESP_OK;
+            }
+
+            // A high surrogate has to be followed by its low half
+            if (parser->high_surrogate != 0) return ESP_ERR_INVALID_ARG;
+
+            char value;
+            switch (c) {
+                case '"': case '\\': case '/': value = c; break;
+                case 'b': value = '\b'; break;
+                case 'f': value = '\f'; break;
+                case 'n': value = '\n'; break;
+                case 'r': value = '\r'; break;
+                case 't': value = '\t'; break;
+                default: return ESP_ERR_INVALID_ARG;
+            }
+            return json_parser_append(parser, &value, 1);
+        }
+
+        case JSON_STATE_CODE: {
+            int digit = json_hex_value(c);
+            if (digit < 0) return ESP_ERR_INVALID_ARG;
+            parser->code = (parser->code << 4) | digit;
+            if (++parser->code_digits < 4) return ESP_OK;
+            parser->state = JSON_STATE_STRING;
+            return json_parser_code(parser);
+        }
+
+        case JSON_STATE_NUMBER:
+            if (json_is_number(c)) {
+                if (parser->length + 1 >= sizeof(parser->text)) return ESP_ERR_INVALID_SIZE;
+                parser->text[parser->length++] = c;
+                return ESP_OK;
+            }
+
+            // The number ended on the character after it, which still needs reading
+            err = json_parser_number_done(parser);
+            if (err != ESP_OK) return err;
+            return json_parser_byte(parser, c);
+
+        case JSON_STATE_LITERAL: {
+            if (c != parser->literal[parser->literal_at]) return ESP_ERR_INVALID_ARG;
+            if (parser->literal[++parser->literal_at] != '\0') return ESP_OK;
+
+            json_event_t event = { .type = JSON_NULL };
+            if (parser->literal[0] != 'n') {
+                event.type = JSON_BOOL;
+                event.boolean = parser->literal[0] == 't';
+            }
+            json_parser_emit(parser, &event);
+            json_parser_value_done(parser);
+            return ESP_OK;
+        }
+
+        case JSON_STATE_DONE:
+            return json_is_space(c) ? ESP_OK : ESP_ERR_INVALID_ARG;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t json_parser_feed(json_parser_t* parser, const char* data, size_t length) {
+    for (size_t i=0; i<length; i++) {
+        esp_err_t err = json_parser_byte(parser, data[i]);
+        if (err != ESP_OK) {
+            parser->state = JSON_STATE_ERROR;
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t json_parser_finish(json_parser_t* parser) {
+    // A number at the very end has nothing after it to end it
+    if (parser->state == JSON_STATE_NUMBER && parser->depth == 0) {
+        esp_err_t err = json_parser_number_done(parser);
+        if (err != ESP_OK) {
+            parser->state = JSON_STATE_ERROR;
+            return err;
+        }
+    }
+
+    return (parser->state == JSON_STATE_DONE) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t http_json_recv(httpd_req_t* req, size_t max_length, json_parse_cb_t cb, void* ctx) {
+    if (req->content_len == 0 || req->content_len > max_length) {
+        ESP_LOGW(TAG, "Rejecting request body of %u bytes", (unsigned)req->content_len);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body missing or too large");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    json_parser_t parser;
+    json_parser_init(&parser, cb, ctx);
+
+    // Parsed as it arrives, so only a piece of the body is ever held
+    char chunk[JSON_RECV_CHUNK];
+    size_t received = 0;
+    esp_err_t err = ESP_OK;
+    while (received < req->content_len && err == ESP_OK) {
+        size_t remaining = req->content_len - received;
+        int ret = httpd_req_recv(req, chunk, (remaining < sizeof(chunk)) ? remaining : sizeof(chunk));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (ret <= 0) {
+            ESP_LOGW(TAG, "Error getting HTTP request content. Content length: %u", (unsigned)req->content_len);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+            return ESP_FAIL;
+        }
+
+        received += ret;
+        err = json_parser_feed(&parser, chunk, ret);
+    }
+
+    if (err == ESP_OK) err = json_parser_finish(&parser);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return err;
+    }
+
+    return ESP_OK;
+}
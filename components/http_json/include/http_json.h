@@ -0,0 +1,159 @@
+#ifndef HTTP_JSON_H
+#define HTTP_JSON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+// JSON for the HTTP API without touching the heap.
+//
+// Responses are written into a buffer inside the writer, which lives on the handler's
+// stack, and sent as a chunk of the response each time it fills. Nothing is built up
+// first, so a response can be any size.
+//
+// Request bodies are read a piece at a time and parsed as they arrive. Every value is
+// handed to a callback, which keeps whatever it needs, so the body never has to fit in
+// memory. Nesting, keys and strings are bounded, and anything past the bounds fails
+// the parse.
+
+#define JSON_WRITER_BUFFER 256
+#define JSON_MAX_DEPTH 8
+// Both include the terminator
+#define JSON_MAX_KEY 24
+#define JSON_MAX_STRING 96
+// Request bodies are read in pieces of this size
+#define JSON_RECV_CHUNK 128
+
+typedef struct {
+    httpd_req_t* req;
+    // First error sending, everything written after one is dropped
+    esp_err_t err;
+    uint16_t length;
+    uint8_t depth;
+    // Bit per depth, set for objects
+    uint32_t is_object;
+    // Bit per depth, set once the container open at that depth has an item
+    uint32_t has_items;
+    char buffer[JSON_WRITER_BUFFER];
+} json_writer_t;
+
+typedef enum {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    // Closes the object or array at the event's depth
+    JSON_END,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOL,
+    JSON_NULL,
+} json_type_t;
+
+typedef struct {
+    json_type_t type;
+    // 0 for the root value, 1 for its items and so on
+    uint8_t depth;
+    // Member name, NULL for array items and the root
+    const char* key;
+    // Position in the parent array, -1 otherwise
+    int index;
+    // Only valid for the matching type, `string` until the callback returns
+    const char* string;
+    double number;
+    bool boolean;
+} json_event_t;
+
+typedef struct json_parser json_parser_t;
+
+typedef void (*json_parse_cb_t)(const json_parser_t* parser, const json_event_t* event, void* ctx);
+
+struct json_parser {
+    json_parse_cb_t cb;
+    void* ctx;
+    uint8_t state;
+    uint8_t depth;
+    uint32_t is_object;
+    // Per depth, the member name or array position of the value at that depth
+    char keys[JSON_MAX_DEPTH + 1][JSON_MAX_KEY];
+    int index[JSON_MAX_DEPTH + 1];
+    // The string, key or number being read
+    char text[JSON_MAX_STRING];
+    uint8_t length;
+    bool is_key;
+    const char* literal;
+    uint8_t literal_at;
+    uint32_t code;
+    uint8_t code_digits;
+    uint16_t high_surrogate;
+};
+
+/**
+ * @brief Starts a response, sets its type to application/json.
+ */
+void json_writer_begin(json_writer_t* writer, httpd_req_t* req);
+
+/**
+ * @brief Like `json_writer_begin`, but leaves the response headers alone.
+ */
+void json_writer_init(json_writer_t* writer, httpd_req_t* req);
+
+// `key` is the member name inside an object, NULL inside an array and for the root
+void json_write_object(json_writer_t* writer, const char* key);
+void json_write_array(json_writer_t* writer, const char* key);
+void json_write_end(json_writer_t* writer);
+void json_write_string(json_writer_t* writer, const char* key, const char* value);
+void json_write_int(json_writer_t* writer, const char* key, int64_t value);
+void json_write_bool(json_writer_t* writer, const char* key, bool value);
+void json_write_null(json_writer_t* writer, const char* key);
+
+/**
+ * @brief Writes `text` as is, for framing around the JSON such as Server-Sent Events.
+ */
+void json_write_raw(json_writer_t* writer, const char* text);
+
+/**
+ * @brief Sends whatever is buffered, without ending the response.
+ */
+esp_err_t json_writer_flush(json_writer_t* writer);
+
+/**
+ * @brief Sends whatever is buffered and ends the response. Returns the first error
+ * sending anything.
+ */
+esp_err_t json_writer_finish(json_writer_t* writer);
+
+void json_parser_init(json_parser_t* parser, json_parse_cb_t cb, void* ctx);
+
+/**
+ * @brief Parses the next `length` bytes, calling back for each value completed by them.
+ * ESP_ERR_INVALID_ARG if they aren't valid JSON, ESP_ERR_INVALID_SIZE if they go past
+ * the bounds. The parser can't be used again after an error.
+ */
+esp_err_t json_parser_feed(json_parser_t* parser, const char* data, size_t length);
+
+/**
+ * @brief Checks a whole value has been parsed.
+ */
+esp_err_t json_parser_finish(json_parser_t* parser);
+
+/**
+ * @brief Name of the member at `depth` on the way to the current value, NULL if the
+ * value there is an array item or the root.
+ */
+const char* json_parser_key(const json_parser_t* parser, uint8_t depth);
+
+/**
+ * @brief Copies a JSON_STRING event's value into `dst`. False if the event isn't a
+ * string or doesn't fit.
+ */
+bool json_event_copy(const json_event_t* event, char* dst, size_t size);
+
+/**
+ * @brief Reads the request body through the parser. Bodies larger than `max_length`
+ * are refused without reading them. On failure the error response has already been
+ * sent.
+ */
+esp_err_t http_json_recv(httpd_req_t* req, size_t max_length, json_parse_cb_t cb, void* ctx);
+
+#endif
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""Generates led_lut.c, the lookup tables behind led_color.h.
+
+Run from this directory after changing any of the constants below:
+    python3 gen_lut.py > led_lut.c
+"""
+
+import colorsys
+import math
+
+GAMMA = 2.2
+
+
+def rows(values, per_row, fmt):
+    for i in range(0, len(values), per_row):
+        yield "    " + " ".join(fmt(v) + "," for v in values[i:i + per_row])
+
+
+def main():
+    sin8 = [round(128 + 127 * math.sin(2 * math.pi * i / 256)) for i in range(256)]
+    gamma16 = [round(65535 * (i / 255) ** GAMMA) for i in range(256)]
+    hue = [tuple(round(255 * c) for c in colorsys.hsv_to_rgb(i / 256, 1, 1)) for i in range(256)]
+
+    print("// Generated by gen_lut.py, do not edit by hand.")
+    print()
+    print('#include "led_color.h"')
+    print()
+    print("const uint8_t led_sin8_lut[256] = {")
+    print("\n".join(rows(sin8, 16, lambda v: "%3d" % v)))
+    print("};")
+    print()
+    print("// Gamma %.1f, so brightness levels are evenly spaced to the eye" % GAMMA)
+    print("const uint16_t led_gamma16_lut[256] = {")
+    print("\n".join(rows(gamma16, 12, lambda v: "%5d" % v)))
+    print("};")
+    print()
+    print("// Fully saturated colors around the hue wheel")
+    print("const rgb_t led_hue_lut[256] = {")
+    print("\n".join(rows(hue, 4, lambda c: "{ .r = %3d, .g = %3d, .b = %3d }" % c)))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
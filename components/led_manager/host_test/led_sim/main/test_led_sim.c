@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <unity.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sdkconfig.h>
+#include <led_manager.h>
+#include <led_api.h>
+
+#include "led_anim.h"
+#include "led_effect.h"
+
+// The engine runs in real time on the FreeRTOS POSIX port, so timing checks leave room
+// for a busy host. Frame counts and output are exact.
+
+#define RECORD_MAX 1024
+// Longest frame period of any effect, a display that drew nothing for longer is static
+#define STATIC_AFTER_MS 200
+
+typedef struct {
+    int64_t time_us;
+    rgb_t first;
+} led_record_t;
+
+static led_record_t records[RECORD_MAX];
+static int record_count = 0;
+
+// Replaces glibc's allocator for the whole program, so allocations made inside libc
+// on the handlers' behalf are counted as well
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+// The LED task keeps drawing while a handler runs, only the test's own thread is counted
+static __thread bool is_counting = false;
+static int allocs = 0;
+
+void* malloc(size_t size) {
+    if (is_counting) allocs++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (is_counting) allocs++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (is_counting) allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+static fake_httpd_resp_t resp;
+
+static led_stats_t led_read_stats(void) {
+    led_stats_t stats;
+    TEST_ESP_OK(led_get_stats(&stats));
+    return stats;
+}
+
+/**
+ * @brief Waits until the engine has stopped drawing. It flushes the recording once it
+ * goes idle, so everything it sent up to here can be read back.
+ */
+static void led_wait_static(void) {
+    uint32_t frames = led_read_stats().frames;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(STATIC_AFTER_MS));
+        uint32_t now = led_read_stats().frames;
+        if (now == frames) return;
+        frames = now;
+    }
+}
+
+static long record_mark(void) {
+    struct stat st;
+    TEST_ASSERT_EQUAL(0, stat(CONFIG_LED_MANAGER_RECORD_PATH, &st));
+    return st.st_size;
+}
+
+/**
+ * @brief Reads every frame recorded after `mark` into `records`, keeping the first pixel
+ * of each. Every test draws a whole ring in one color, so that's all it looks at.
+ */
+static void record_read(long mark) {
+    FILE* file = fopen(CONFIG_LED_MANAGER_RECORD_PATH, "r");
+    TEST_ASSERT_NOT_NULL(file);
+    fseek(file, mark, SEEK_SET);
+
+    char line[256];
+    record_count = 0;
+    while (record_count < RECORD_MAX && fgets(line, sizeof(line), file) != NULL) {
+        long long time_us;
+        unsigned strip, pixel;
+        if (line[0] == '#' || sscanf(line, "%lld %u %6x", &time_us, &strip, &pixel) != 3) continue;
+
+        led_record_t* record = &records[record_count++];
+        record->time_us = time_us;
+        record->first.r = pixel >> 16;
+        record->first.g = (pixel >> 8) & 0xff;
+        record->first.b = pixel & 0xff;
+    }
+    fclose(file);
+}
+
+/**
+ * @brief Runs one request and fails the test if its handler allocated anything.
+ */
+static void api_request(httpd_method_t method, const char* uri, const char* body, const char* status) {
+    allocs = 0;
+    is_counting = true;
+    esp_err_t err = fake_httpd_request(method, uri, NULL, body, &resp);
+    is_counting = false;
+
+    TEST_ESP_OK(err);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(status, resp.status, uri);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocs, uri);
+}
+
+static void test_static_display_sleeps(void) {
+    led_wait_static();
+    long mark = record_mark();
+
+    TEST_ESP_OK(led_set_color(COLOR_RED));
+    led_wait_static();
+    led_stats_t before = led_read_stats();
+
+    // Nothing moves, so a second goes by without a single frame
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    led_stats_t after = led_read_stats();
+    TEST_ASSERT_EQUAL_UINT32(before.frames, after.frames);
+    TEST_ASSERT_EQUAL_UINT32(0, after.fps);
+
+    record_read(mark);
+    TEST_ASSERT_EQUAL(1, record_count);
+    TEST_ASSERT_TRUE(records[0].first.r > 0);
+    TEST_ASSERT_EQUAL(0, records[0].first.g);
+    TEST_ASSERT_EQUAL(0, records[0].first.b);
+}
+
+static void test_expiring_layer_wakes_once(void) {
+    led_wait_static();
+    uint32_t frames = led_read_stats().frames;
+
+    led_item_t alert = {
+        .type = LED_DISPLAY_SOLID,
+        .color = COLOR_GREEN,
+        .brightness = LED_DEFAULT_BRIGHTNESS,
+        .duration_ms = 300,
+    };
+    TEST_ESP_OK(led_layer_set(LED_LAYER_ALERT, &alert));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // One frame to show it and one when it runs out, the engine sleeps in between
+    TEST_ASSERT_EQUAL_UINT32(frames + 2, led_read_stats().frames);
+}
+
+static void test_fade_output(void) {
+    TEST_ESP_OK(led_set_off());
+    led_wait_static();
+    long mark = record_mark();
+    uint32_t frames = led_read_stats().frames;
+
+    TEST_ESP_OK(led_fade_in(COLOR_GREEN));
+    led_wait_static();
+
+    // A frame every LED_SMOOTH_FRAME_MS for the whole fade, less any a busy host dropped
+    uint32_t drawn = led_read_stats().frames - frames;
+    printf("fade in: %u frames\n", (unsigned)drawn);
+    TEST_ASSERT_TRUE(drawn >= LED_FADE_MS / LED_SMOOTH_FRAME_MS / 2);
+    TEST_ASSERT_TRUE(drawn <= LED_FADE_MS / LED_SMOOTH_FRAME_MS + 2);
+
+    // Only ever brighter, give or take the dithering
+    record_read(mark);
+    TEST_ASSERT_TRUE(record_count > 1);
+    for (int i=1; i<record_count; i++) {
+        TEST_ASSERT_EQUAL(0, records[i].first.r);
+        TEST_ASSERT_EQUAL(0, records[i].first.b);
+        TEST_ASSERT_TRUE(records[i].first.g + 1 >= records[i - 1].first.g);
+    }
+    uint8_t full = records[record_count - 1].first.g;
+    TEST_ASSERT_TRUE(full > records[0].first.g);
+
+    mark = record_mark();
+    TEST_ESP_OK(led_fade_out());
+    led_wait_static();
+
+    record_read(mark);
+    TEST_ASSERT_TRUE(record_count > 1);
+    TEST_ASSERT_TRUE(records[0].first.g <= full);
+    for (int i=1; i<record_count; i++) {
+        TEST_ASSERT_TRUE(records[i].first.g <= records[i - 1].first.g + 1);
+    }
+    TEST_ASSERT_EQUAL(0, records[record_count - 1].first.g);
+}
+
+static void test_pulse_keeps_going(void) {
+    TEST_ESP_OK(led_set_off());
+    led_wait_static();
+    long mark = record_mark();
+
+    TEST_ESP_OK(led_set_pulse(COLOR_RED));
+    vTaskDelay(pdMS_TO_TICKS(LED_PULSE_PERIOD_MS * 2));
+
+    // Still drawing well past its first period
+    led_stats_t before = led_read_stats();
+    vTaskDelay(pdMS_TO_TICKS(STATIC_AFTER_MS));
+    led_stats_t after = led_read_stats();
+    TEST_ASSERT_TRUE(after.frames > before.frames);
+    TEST_ASSERT_TRUE(after.fps > 0);
+
+    TEST_ESP_OK(led_set_off());
+    led_wait_static();
+
+    // The second period swings up and down just like the first
+    record_read(mark);
+    TEST_ASSERT_TRUE(record_count > 0);
+    uint8_t low = 255, high = 0;
+    for (int i=0; i<record_count; i++) {
+        if (records[i].time_us - records[0].time_us < LED_PULSE_PERIOD_MS * 1000LL) continue;
+        if (records[i].first.r == 0) continue;  // Switched off
+        if (records[i].first.r < low) low = records[i].first.r;
+        if (records[i].first.r > high) high = records[i].first.r;
+    }
+    printf("second pulse: %u-%u\n", low, high);
+    TEST_ASSERT_TRUE(high > low + 4);
+}
+
+static void test_frame_timing(void) {
+    led_wait_static();
+    led_stats_t stats = led_read_stats();
+
+    uint32_t timed = 0;
+    for (int i=0; i<LED_JITTER_BUCKETS; i++) {
+        timed += stats.jitter[i];
+        printf("jitter < %i ticks: %u\n", 1 << i, (unsigned)stats.jitter[i]);
+    }
+    printf("%u frames, %u missed\n", (unsigned)stats.frames, (unsigned)stats.missed);
+
+    // The first frame after every wakeup has no deadline, every other one is timed
+    TEST_ASSERT_TRUE(timed > 0);
+    TEST_ASSERT_TRUE(timed < stats.frames);
+    TEST_ASSERT_TRUE(stats.missed <= timed / 10);
+    // Frames wake on tick boundaries, so most land in the first bucket
+    TEST_ASSERT_TRUE(stats.jitter[0] >= timed / 2);
+}
+
+static void anim_compile(const char* src, led_program_t* program) {
+    int line;
+    TEST_ESP_OK(led_anim_compile(src, strlen(src), program, &line));
+}
+
+static void anim_compile_error(const char* src, esp_err_t expected, int expected_line) {
+    led_program_t program;
+    int line;
+    TEST_ASSERT_EQUAL_MESSAGE(expected, led_anim_compile(src, strlen(src), &program, &line), src);
+    TEST_ASSERT_EQUAL_MESSAGE(expected_line, line, src);
+}
+
+static void test_anim_compile(void) {
+    led_program_t program;
+    anim_compile("# Comments and blank lines are skipped\n\nloop 1000\nkey 0 ff8000 200 sine\n", &program);
+    TEST_ASSERT_EQUAL(LED_OP_LOOP, program.code[0]);
+    TEST_ASSERT_EQUAL(1000, program.code[1] | (program.code[2] << 8));
+    TEST_ASSERT_EQUAL(LED_OP_KEY, program.code[3]);
+    TEST_ASSERT_EQUAL(0xff, program.code[6]);
+    TEST_ASSERT_EQUAL(0x80, program.code[7]);
+    TEST_ASSERT_EQUAL(200, program.code[9]);
+    TEST_ASSERT_EQUAL(LED_EASE_SINE, program.code[10]);
+    TEST_ASSERT_EQUAL(LED_OP_END, program.code[11]);
+
+    // The default solid pattern isn't written out, other patterns go before the keys
+    anim_compile("key 0 ff0000 10\npattern chase 3\n", &program);
+    TEST_ASSERT_EQUAL(LED_OP_PATTERN, program.code[0]);
+    TEST_ASSERT_EQUAL(LED_PATTERN_CHASE, program.code[1]);
+    TEST_ASSERT_EQUAL(3, program.code[2]);
+    TEST_ASSERT_EQUAL(LED_DELAY, program.code[3] | (program.code[4] << 8));
+    TEST_ASSERT_EQUAL(LED_OP_KEY, program.code[5]);
+
+    anim_compile_error("", ESP_ERR_INVALID_ARG, 0);
+    anim_compile_error("key 0 ff0000\n", ESP_ERR_INVALID_ARG, 1);
+    anim_compile_error("key 0 ff0000 10 bounce\n", ESP_ERR_INVALID_ARG, 1);
+    anim_compile_error("key 100 ff0000 10\nkey 100 00ff00 10\n", ESP_ERR_INVALID_ARG, 2);
+    anim_compile_error("key 0 ff0000 10\npattern spin 4 1\n", ESP_ERR_INVALID_ARG, 2);
+    anim_compile_error("pattern solid\npattern solid\n", ESP_ERR_INVALID_ARG, 2);
+    anim_compile_error("blink\n", ESP_ERR_INVALID_ARG, 1);
+    // Checked once everything is read, so there's no one line to blame
+    anim_compile_error("loop 500\nkey 600 ff0000 10\n", ESP_ERR_INVALID_ARG, 0);
+
+    char src[LED_ANIM_MAX_SOURCE] = "";
+    for (int i=0; i<=LED_ANIM_MAX_KEYS; i++) {
+        snprintf(src + strlen(src), sizeof(src) - strlen(src), "key %d ff0000 10\n", i * 10);
+    }
+    anim_compile_error(src, ESP_ERR_NO_MEM, LED_ANIM_MAX_KEYS + 1);
+}
+
+static led_anim_frame_t anim_run(const led_program_t* program, uint32_t t) {
+    led_anim_frame_t frame = { .color = COLOR_OFF };
+    led_anim_run(program, t, &frame);
+    return frame;
+}
+
+static void test_anim_run(void) {
+    led_program_t program;
+
+    anim_compile("key 0 ff0000 100\nkey 1000 0000ff 200\n", &program);
+    led_anim_frame_t frame = anim_run(&program, 0);
+    TEST_ASSERT_EQUAL(255, frame.color.r);
+    TEST_ASSERT_EQUAL(100, frame.level);
+    TEST_ASSERT_TRUE(frame.is_easing);
+    frame = anim_run(&program, 500);
+    TEST_ASSERT_INT_WITHIN(2, 150, frame.level);
+    TEST_ASSERT_FALSE(frame.is_done);
+    // Holds the last key once it's past the end
+    frame = anim_run(&program, 5000);
+    TEST_ASSERT_EQUAL(255, frame.color.b);
+    TEST_ASSERT_EQUAL(200, frame.level);
+    TEST_ASSERT_TRUE(frame.is_done);
+
+    // Holds the first key until it's reached, without going static in the meantime
+    anim_compile("key 300 00ff00 80\nkey 600 00ff00 160\n", &program);
+    frame = anim_run(&program, 100);
+    TEST_ASSERT_EQUAL(80, frame.level);
+    TEST_ASSERT_EQUAL_UINT32(200, frame.hold_ms);
+    TEST_ASSERT_FALSE(frame.is_done);
+
+    // A loop whose first key is after 0 is still easing in from the last key before it
+    anim_compile("loop 1000\nkey 250 ff0000 200\nkey 750 0000ff 0\n", &program);
+    frame = anim_run(&program, 0);
+    TEST_ASSERT_INT_WITHIN(2, 100, frame.level);
+    TEST_ASSERT_TRUE(frame.is_easing);
+    TEST_ASSERT_INT_WITHIN(2, 100, anim_run(&program, 1000).level);
+    TEST_ASSERT_INT_WITHIN(2, 200, anim_run(&program, 1249).level);
+    TEST_ASSERT_INT_WITHIN(2, 0, anim_run(&program, 1750).level);
+    TEST_ASSERT_INT_WITHIN(2, 50, anim_run(&program, 1875).level);
+    TEST_ASSERT_FALSE(anim_run(&program, 999999).is_done);
+
+    // A step key jumps when it's reached and holds until then
+    anim_compile("key 0 ff0000 100\nkey 400 00ff00 100 step\n", &program);
+    frame = anim_run(&program, 100);
+    TEST_ASSERT_EQUAL(255, frame.color.r);
+    TEST_ASSERT_FALSE(frame.is_easing);
+    TEST_ASSERT_EQUAL_UINT32(300, frame.hold_ms);
+    frame = anim_run(&program, 400);
+    TEST_ASSERT_EQUAL(255, frame.color.g);
+    TEST_ASSERT_TRUE(frame.is_done);
+}
+
+static void test_step_key_holds_still(void) {
+    const char* src = "key 0 ff0000 100\nkey 400 00ff00 100 step\n";
+    uint8_t id;
+    TEST_ESP_OK(led_anim_load("step", src, strlen(src), &id));
+
+    led_item_t item = { .type = LED_DISPLAY_ANIMATION, .animation = id, .brightness = LED_DEFAULT_BRIGHTNESS };
+    led_layer_state_t layer = { 0 };
+    led_effect_start(&layer, &item, 1000);
+    TEST_ASSERT_FALSE(led_effect_frame(&layer, 100));
+    TEST_ASSERT_EQUAL_UINT32(0, led_effect_interval(&layer));
+    TEST_ASSERT_EQUAL_UINT32(1400, layer.wakes);
+
+    // A pattern still moves while the color holds
+    src = "pattern spin 4 80\nkey 0 ff0000 100\nkey 400 00ff00 100 step\n";
+    TEST_ESP_OK(led_anim_load("step", src, strlen(src), &id));
+    led_effect_start(&layer, &item, 1000);
+    TEST_ASSERT_FALSE(led_effect_frame(&layer, 100));
+    TEST_ASSERT_EQUAL_UINT32(80, led_effect_interval(&layer));
+
+    // Played for real, it draws once to show it and once for the step, nothing in between
+    src = "key 0 ff0000 100\nkey 400 00ff00 100 step\n";
+    TEST_ESP_OK(led_anim_load("step", src, strlen(src), &id));
+    TEST_ESP_OK(led_set_off());
+    led_wait_static();
+    uint32_t frames = led_read_stats().frames;
+
+    TEST_ESP_OK(led_set_animation("step"));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ASSERT_EQUAL_UINT32(frames + 2, led_read_stats().frames);
+
+    TEST_ESP_OK(led_set_off());
+}
+
+static void test_handlers_do_not_allocate(void) {
+    fake_httpd_reset();
+    TEST_ESP_OK(led_api_register(NULL));
+
+    api_request(HTTP_PUT, "/api/animations/breathe", "loop 1000\nkey 0 0000ff 20\nkey 500 00ffff 120 sine\n", "200 OK");
+    api_request(HTTP_GET, "/api/animations", NULL, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"breathe\""));
+    api_request(HTTP_POST, "/api/animations/breathe", NULL, "200 OK");
+
+    // Saved where it would be loaded from on boot
+    char path[64];
+    snprintf(path, sizeof(path), "%s/breathe.anim", CONFIG_SETUP_FS_BASE);
+    struct stat st;
+    TEST_ASSERT_EQUAL(0, stat(path, &st));
+    unlink(path);
+
+    api_request(HTTP_PUT, "/api/animations/broken", "key 0 0000ff\n", "400 Bad Request");
+    api_request(HTTP_PUT, "/api/animations/empty", "", "400 Bad Request");
+    api_request(HTTP_POST, "/api/animations/missing", NULL, "404 Not Found");
+
+    TEST_ESP_OK(led_set_off());
+}
+
+void app_main(void) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    TEST_ESP_OK(led_init(NULL));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_static_display_sleeps);
+    RUN_TEST(test_expiring_layer_wakes_once);
+    RUN_TEST(test_fade_output);
+    RUN_TEST(test_pulse_keeps_going);
+    RUN_TEST(test_frame_timing);
+    RUN_TEST(test_anim_compile);
+    RUN_TEST(test_anim_run);
+    RUN_TEST(test_step_key_holds_still);
+    RUN_TEST(test_handlers_do_not_allocate);
+    exit(UNITY_END());
+}
@@ -0,0 +1,18 @@
+#ifndef LED_API_H
+#define LED_API_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief Registers the `/api/animations` endpoints. Must be called before any wildcard
+ * handler that would also match them.
+ *
+ * GET  /api/animations         List the loaded animations.
+ * PUT  /api/animations/<name>  Compile and load the animation source in the body, and
+ *                              save it so it is loaded again on boot.
+ * POST /api/animations/<name>  Play a loaded animation.
+ */
+esp_err_t led_api_register(httpd_handle_t server);
+
+#endif
@@ -1,16 +1,30 @@
 #ifndef LED_MANAGER_H
 #define LED_MANAGER_H
 
-#include <led_strip.h>
-
-#define LED_PIN GPIO_NUM_12
-#define NUM_LEDS 16
-// Ideally the default brightness should be a multiple
-// of the fade steps to help create a smooth fade effect
-#define LED_DEFAULT_BRIGHTNESS 32
-#define LED_BRIGHTNESS_STEP 2
+#include <stddef.h>
+#include <esp_err.h>
+#include <rgb.h>
+
+#define LED_MAX_STRIPS 4
+// Brightness is a perceptual level, gamma corrected on the way out, so 100 is
+// about 32/255 of full power
+#define LED_DEFAULT_BRIGHTNESS 100
+#define LED_FADE_MS 800
+#define LED_PULSE_PERIOD_MS 2000
+// How long a progress arc takes to slide to a new value
+#define LED_PROGRESS_EASE_MS 400
+// Frame period while anything is fading or easing, where 20Hz steps are visible
+#define LED_SMOOTH_FRAME_MS 10
+// Step time of the effects that move a pixel at a time, spin and chase
 #define LED_DELAY 50
-#define LED_TICKS_PER_SECOND 1000/LED_DELAY
+#define LED_SPIN_TAIL 4
+// Frame jitter histogram, bucket i counts frames that started less than (1 << i) ticks
+// from their deadline, the last bucket counts everything beyond that
+#define LED_JITTER_BUCKETS 6
+#define LED_ANIM_MAX 8
+#define LED_ANIM_NAME_LENGTH 16
+#define LED_ANIM_MAX_SOURCE 2048
+#define LED_CHASE_SPACING 3
 
 static const rgb_t COLOR_ORANGE = {
     .r = 255,
@@ -42,21 +56,106 @@ typedef enum {
     LED_DISPLAY_PULSE,
     LED_DISPLAY_FADE_IN,
     LED_DISPLAY_FADE_OUT,
+    LED_DISPLAY_CHASE,
+    LED_DISPLAY_PROGRESS,
+    // A loaded animation, see `led_anim_load`
+    LED_DISPLAY_ANIMATION,
 } led_display_type_t;
 
+/**
+ * @brief Layers are composited bottom to top every frame, so anything on a higher layer
+ * is drawn over the layers below it without disturbing them.
+ */
+typedef enum {
+    LED_LAYER_BASE,      // Connection status and anything set with the plain led_* calls
+    LED_LAYER_PROGRESS,  // Long running progress, e.g. a Pomodoro arc
+    LED_LAYER_ALERT,     // Short lived alerts, usually given a duration
+    LED_LAYER_MAX,
+} led_layer_t;
+
+typedef enum {
+    LED_BLEND_NORMAL,   // Lit pixels cover the layers below, unlit ones let them through
+    LED_BLEND_ADD,      // Adds to the layers below
+    LED_BLEND_REPLACE,  // Hides the layers below entirely, unlit pixels are black
+} led_blend_t;
+
 typedef struct {
     rgb_t color;
     led_display_type_t type;
     uint8_t brightness;
+    // Only used by LED_DISPLAY_PROGRESS, 0-255 of the way around the ring
+    uint8_t progress;
+    // Only used by LED_DISPLAY_ANIMATION, the id `led_anim_load` gave it
+    uint8_t animation;
+    led_blend_t blend;
+    // The layer is cleared after this long, 0 keeps it until it is replaced
+    uint16_t duration_ms;
 } led_item_t;
 
-esp_err_t led_init(void);
+typedef struct {
+    int gpio;
+    uint16_t length;
+} led_strip_geometry_t;
+
+/**
+ * @brief Strips the LED engine drives. Every strip is its own ring and shows the same
+ * layers, laid out over its own length.
+ */
+typedef struct {
+    uint8_t strip_count;
+    led_strip_geometry_t strips[LED_MAX_STRIPS];
+} led_config_t;
+
+typedef struct {
+    // Frames drawn in the last full second, 0 while the display is static
+    uint32_t fps;
+    uint32_t frames;
+    // Frames that started after their deadline had already passed
+    uint32_t missed;
+    uint32_t jitter[LED_JITTER_BUCKETS];
+    uint32_t posted;
+    // Posts that repeated the command already waiting for their layer
+    uint32_t coalesced;
+    // Commands replaced by a newer one for the same layer before they were shown
+    uint32_t dropped;
+} led_stats_t;
+
+/**
+ * @brief Fills `config` with the single strip set in menuconfig.
+ */
+void led_config_default(led_config_t* config);
+
+/**
+ * @brief Starts the LED engine on the strips in `config`, or the menuconfig defaults if
+ * it is NULL.
+ */
+esp_err_t led_init(const led_config_t* config);
+esp_err_t led_layer_set(led_layer_t layer, const led_item_t* item);
+esp_err_t led_layer_clear(led_layer_t layer);
 esp_err_t led_set_color(rgb_t color);
 esp_err_t led_set_pulse(rgb_t color);
+esp_err_t led_set_spin(rgb_t color);
+esp_err_t led_set_chase(rgb_t color);
+esp_err_t led_set_progress(rgb_t color, uint8_t progress);
 esp_err_t led_set_off();
 esp_err_t led_fade_in(rgb_t color);
 esp_err_t led_fade_in_ISR(rgb_t color);
 esp_err_t led_fade_out(void);
 esp_err_t led_fade_out_ISR(void);
+esp_err_t led_set_animation(const char* name);
+esp_err_t led_get_stats(led_stats_t* stats);
+
+/**
+ * @brief Compiles animation source (see led_anim.c for the format) and loads it as
+ * `name`, replacing any animation already loaded with that name.
+ */
+esp_err_t led_anim_load(const char* name, const char* src, size_t len, uint8_t* id);
+
+/**
+ * @brief Loads every `<name>.anim` file in `dir`.
+ */
+esp_err_t led_anim_load_dir(const char* dir);
+esp_err_t led_anim_find(const char* name, uint8_t* id);
+esp_err_t led_anim_get_name(uint8_t id, char* name);
 
 #endif
\ No newline at end of file
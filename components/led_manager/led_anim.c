@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+
+#include "led_anim.h"
+#include "led_color.h"
+
+// Animation source is line based, `#` starts a comment:
+//
+//   # Slow blue breathe with a spinner over it
+//   loop 3000
+//   pattern spin 4 80
+//   key 0    0000ff 20
+//   key 1500 00ffff 120 sine
+//   key 3000 0000ff 20 sine
+//
+//   loop <period_ms>                      Repeat every period, easing from the last key
+//                                         round into the first, otherwise hold the last key
+//   pattern solid                         Light the whole ring (the default)
+//   pattern spin <tail> [step_ms]         A head with a fading tail, one pixel per step
+//   pattern chase <spacing> [step_ms]     Every spacing'th pixel, moving one per step
+//                                         (step_ms is at least LED_SMOOTH_FRAME_MS)
+//   key <at_ms> <rrggbb> <level> [ease]   Color and brightness at a point in time, eased
+//                                         into from the key before it with linear (the
+//                                         default), sine or step
+
+#define LED_ANIM_MAX_LINE 96
+#define LED_ANIM_EXTENSION ".anim"
+
+static const char *TAG = "LED Anim";
+
+typedef struct {
+    char name[LED_ANIM_NAME_LENGTH];
+    bool is_used;
+    led_program_t program;
+} led_anim_slot_t;
+
+static led_anim_slot_t slots[LED_ANIM_MAX];
+static portMUX_TYPE slots_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    uint16_t at;
+    rgb_t color;
+    uint8_t level;
+    led_ease_t ease;
+} led_anim_key_t;
+
+static inline uint16_t read16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint8_t* write16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xff;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static bool parse_uint(const char* token, uint32_t max, uint32_t* value) {
+    if (token == NULL) return false;
+
+    char* end;
+    unsigned long parsed = strtoul(token, &end, 10);
+    if (end == token || *end != '\0' || parsed > max) return false;
+
+    *value = parsed;
+    return true;
+}
+
+static bool parse_color(const char* token, rgb_t* color) {
+    if (token == NULL || strlen(token) != 6) return false;
+
+    char* end;
+    unsigned long parsed = strtoul(token, &end, 16);
+    if (*end != '\0') return false;
+
+    color->r = parsed >> 16;
+    color->g = (parsed >> 8) & 0xff;
+    color->b = parsed & 0xff;
+    return true;
+}
+
+static bool parse_ease(const char* token, led_ease_t* ease) {
+    if (token == NULL || strcmp(token, "linear") == 0) {
+        *ease = LED_EASE_LINEAR;
+    } else if (strcmp(token, "sine") == 0) {
+        *ease = LED_EASE_SINE;
+    } else if (strcmp(token, "step") == 0) {
+        *ease = LED_EASE_STEP;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t led_anim_compile(const char* src, size_t len, led_program_t* program, int* line_number) {
+    led_anim_key_t keys[LED_ANIM_MAX_KEYS];
+    int key_count = 0;
+    uint32_t period = 0;
+    bool has_pattern = false;
+    uint32_t pattern = LED_PATTERN_SOLID;
+    uint32_t pattern_arg = 0;
+    uint32_t step_ms = LED_DELAY;
+
+    *line_number = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        char line[LED_ANIM_MAX_LINE];
+        (*line_number)++;
+
+        const char* eol = memchr(src + pos, '\n', len - pos);
+        size_t line_len = (eol ? (size_t)(eol - src) : len) - pos;
+        if (line_len >= sizeof(line)) return ESP_ERR_INVALID_SIZE;
+
+        memcpy(line, src + pos, line_len);
+        line[line_len] = '\0';
+        pos += line_len + 1;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        char* save;
+        const char* keyword = strtok_r(line, " \t\r", &save);
+        if (keyword == NULL) continue;
+
+        const char* args[4];
+        for (int i=0; i<4; i++) args[i] = strtok_r(NULL, " \t\r", &save);
+
+        if (strcmp(keyword, "loop") == 0) {
+            if (!parse_uint(args[0], UINT16_MAX, &period) || period == 0 || args[1] != NULL) return ESP_ERR_INVALID_ARG;
+        } else if (strcmp(keyword, "pattern") == 0) {
+            if (has_pattern || args[0] == NULL) return ESP_ERR_INVALID_ARG;
+            has_pattern = true;
+
+            if (strcmp(args[0], "solid") == 0) {
+                pattern = LED_PATTERN_SOLID;
+                if (args[1] != NULL) return ESP_ERR_INVALID_ARG;
+                continue;
+            } else if (strcmp(args[0], "spin") == 0) {
+                pattern = LED_PATTERN_SPIN;
+            } else if (strcmp(args[0], "chase") == 0) {
+                pattern = LED_PATTERN_CHASE;
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+
+            if (!parse_uint(args[1], UINT8_MAX, &pattern_arg) || pattern_arg == 0) return ESP_ERR_INVALID_ARG;
+            // Frames never go out faster than the smooth rate, and anything under a tick
+            // would ask the LED task for a zero tick delay
+            if (args[2] != NULL && (!parse_uint(args[2], UINT16_MAX, &step_ms) || step_ms < LED_SMOOTH_FRAME_MS)) return ESP_ERR_INVALID_ARG;
+            if (args[3] != NULL) return ESP_ERR_INVALID_ARG;
+        } else if (strcmp(keyword, "key") == 0) {
+            if (key_count == LED_ANIM_MAX_KEYS) return ESP_ERR_NO_MEM;
+
+            led_anim_key_t* key = &keys[key_count];
+            uint32_t at, level;
+            if (!parse_uint(args[0], UINT16_MAX, &at) || !parse_color(args[1], &key->color)) return ESP_ERR_INVALID_ARG;
+            if (!parse_uint(args[2], UINT8_MAX, &level) || !parse_ease(args[3], &key->ease)) return ESP_ERR_INVALID_ARG;
+
+            // Keys have to be in order, so the interpreter never has to sort them
+            if (key_count > 0 && at <= keys[key_count - 1].at) return ESP_ERR_INVALID_ARG;
+
+            key->at = at;
+            key->level = level;
+            key_count++;
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    *line_number = 0;
+    if (key_count == 0) return ESP_ERR_INVALID_ARG;
+    if (period != 0 && period < keys[key_count - 1].at) return ESP_ERR_INVALID_ARG;
+
+    uint8_t* out = program->code;
+    if (period != 0) {
+        *out++ = LED_OP_LOOP;
+        out = write16(out, period);
+    }
+    if (pattern != LED_PATTERN_SOLID) {
+        *out++ = LED_OP_PATTERN;
+        *out++ = pattern;
+        *out++ = pattern_arg;
+        out = write16(out, step_ms);
+    }
+    for (int i=0; i<key_count; i++) {
+        *out++ = LED_OP_KEY;
+        out = write16(out, keys[i].at);
+        *out++ = keys[i].color.r;
+        *out++ = keys[i].color.g;
+        *out++ = keys[i].color.b;
+        *out++ = keys[i].level;
+        *out++ = keys[i].ease;
+    }
+    *out = LED_OP_END;
+
+    return ESP_OK;
+}
+
+static inline rgb_t key_color(const uint8_t* key) {
+    rgb_t color = { .r = key[3], .g = key[4], .b = key[5] };
+    return color;
+}
+
+void led_anim_run(const led_program_t* program, uint32_t t, led_anim_frame_t* frame) {
+    const uint8_t* pc = program->code;
+    const uint8_t* first = NULL;
+    const uint8_t* last = NULL;
+    const uint8_t* prev = NULL;
+    const uint8_t* next = NULL;
+    uint32_t period = 0;
+
+    frame->pattern = LED_PATTERN_SOLID;
+    frame->is_easing = false;
+    frame->hold_ms = 0;
+
+    while (*pc != LED_OP_END) {
+        switch (*pc) {
+            case LED_OP_LOOP:
+                period = read16(pc + 1);
+                t %= period;
+                pc += 3;
+                break;
+            case LED_OP_PATTERN:
+                frame->pattern = pc[1];
+                frame->arg = pc[2];
+                frame->step_ms = read16(pc + 3);
+                pc += 5;
+                break;
+            case LED_OP_KEY:
+                if (first == NULL) first = pc;
+                last = pc;
+                if (read16(pc + 1) <= t) {
+                    prev = pc;
+                } else if (next == NULL) {
+                    next = pc;
+                }
+                pc += 8;
+                break;
+            default:
+                // Only the compiler writes programs, so this can't happen
+                frame->is_done = true;
+                return;
+        }
+    }
+
+    // An empty program leaves the frame as the caller set it up
+    if (first == NULL) {
+        frame->is_done = frame->pattern == LED_PATTERN_SOLID;
+        return;
+    }
+
+    if (period != 0 && (prev == NULL || next == NULL)) {
+        // Before the first key or past the last one of a loop, easing round from the
+        // last key to the first
+        prev = last;
+        next = first;
+    } else if (prev == NULL) {
+        // Before the first key, hold it until it's reached
+        frame->color = key_color(first);
+        frame->level = first[6];
+        frame->hold_ms = read16(first + 1) - t;
+        frame->is_done = false;
+        return;
+    }
+
+    if (next == NULL) {
+        frame->color = key_color(prev);
+        frame->level = prev[6];
+        frame->is_done = period == 0 && frame->pattern == LED_PATTERN_SOLID;
+        return;
+    }
+
+    // Times that wrap round the end of a loop are counted on into the next period
+    uint32_t from_at = read16(prev + 1);
+    uint32_t to_at = read16(next + 1);
+    if (to_at <= from_at) to_at += period;
+    if (t < from_at) t += period;
+
+    uint8_t amount = (to_at > from_at) ? ((t - from_at) * 255) / (to_at - from_at) : 255;
+    switch (next[7]) {
+        case LED_EASE_SINE:
+            amount = 255 - led_sin8(64 + (amount >> 1));
+            break;
+        case LED_EASE_STEP:
+            amount = 0;
+            break;
+    }
+
+    frame->color = led_rgb_lerp(key_color(prev), key_color(next), amount);
+    frame->level = led_mix8(prev[6], next[6], amount);
+    frame->is_easing = next[7] != LED_EASE_STEP;
+    frame->is_done = false;
+    if (next[7] == LED_EASE_STEP) frame->hold_ms = to_at - t;
+}
+
+void led_anim_get(uint8_t id, led_program_t* program) {
+    portENTER_CRITICAL_SAFE(&slots_lock);
+    if (id < LED_ANIM_MAX && slots[id].is_used) {
+        *program = slots[id].program;
+    } else {
+        program->code[0] = LED_OP_END;
+    }
+    portEXIT_CRITICAL_SAFE(&slots_lock);
+}
+
+static bool is_valid_name(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= LED_ANIM_NAME_LENGTH) return false;
+
+    for (size_t i=0; i<len; i++) {
+        char c = name[i];
+        bool is_valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+        if (!is_valid) return false;
+    }
+
+    return true;
+}
+
+esp_err_t led_anim_load(const char* name, const char* src, size_t len, uint8_t* id) {
+    if (name == NULL || src == NULL || !is_valid_name(name)) return ESP_ERR_INVALID_ARG;
+
+    led_program_t program;
+    int line;
+    esp_err_t err = led_anim_compile(src, len, &program, &line);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error compiling animation `%s` at line %d. Error: %s", name, line, esp_err_to_name(err));
+        return err;
+    }
+
+    // Replace an animation with the same name, otherwise take the first free slot
+    int slot = -1;
+    portENTER_CRITICAL_SAFE(&slots_lock);
+    for (int i=0; i<LED_ANIM_MAX; i++) {
+        if (slots[i].is_used && strcmp(slots[i].name, name) == 0) {
+            slot = i;
+            break;
+        }
+        if (!slots[i].is_used && slot == -1) slot = i;
+    }
+    if (slot != -1) {
+        strcpy(slots[slot].name, name);
+        slots[slot].program = program;
+        slots[slot].is_used = true;
+    }
+    portEXIT_CRITICAL_SAFE(&slots_lock);
+
+    if (slot == -1) {
+        ESP_LOGW(TAG, "No free animation slots for `%s`", name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (id != NULL) *id = slot;
+    return ESP_OK;
+}
+
+esp_err_t led_anim_find(const char* name, uint8_t* id) {
+    if (name == NULL || id == NULL) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL_SAFE(&slots_lock);
+    for (int i=0; i<LED_ANIM_MAX; i++) {
+        if (slots[i].is_used && strcmp(slots[i].name, name) == 0) {
+            *id = i;
+            err = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&slots_lock);
+
+    return err;
+}
+
+esp_err_t led_anim_get_name(uint8_t id, char* name) {
+    if (id >= LED_ANIM_MAX || name == NULL) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL_SAFE(&slots_lock);
+    if (slots[id].is_used) {
+        strcpy(name, slots[id].name);
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL_SAFE(&slots_lock);
+
+    return err;
+}
+
+/**
+ * @brief Reads and loads one animation file. `file_name` is the bare file name, the
+ * animation is named after it without the extension.
+ */
+static esp_err_t led_anim_load_file(const char* dir, const char* file_name) {
+    char name[LED_ANIM_NAME_LENGTH];
+    size_t name_len = strlen(file_name) - strlen(LED_ANIM_EXTENSION);
+    if (name_len == 0 || name_len >= sizeof(name)) return ESP_ERR_INVALID_ARG;
+
+    memcpy(name, file_name, name_len);
+    name[name_len] = '\0';
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", dir, file_name);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return ESP_ERR_NOT_FOUND;
+
+    char* src = malloc(LED_ANIM_MAX_SOURCE);
+    if (src == NULL) {
+        fclose(file);
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t len = fread(src, 1, LED_ANIM_MAX_SOURCE, file);
+    bool is_truncated = !feof(file);
+    fclose(file);
+
+    esp_err_t err = is_truncated ? ESP_ERR_INVALID_SIZE : led_anim_load(name, src, len, NULL);
+    free(src);
+
+    return err;
+}
+
+esp_err_t led_anim_load_dir(const char* dir) {
+    if (dir == NULL) return ESP_ERR_INVALID_ARG;
+
+    DIR* handle = opendir(dir);
+    if (handle == NULL) {
+        ESP_LOGW(TAG, "Error opening `%s`", dir);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int loaded = 0;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        size_t ext_len = strlen(LED_ANIM_EXTENSION);
+        if (len <= ext_len || strcmp(entry->d_name + len - ext_len, LED_ANIM_EXTENSION) != 0) continue;
+
+        esp_err_t err = led_anim_load_file(dir, entry->d_name);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Error loading `%s`. Error: %s", entry->d_name, esp_err_to_name(err));
+            continue;
+        }
+        loaded++;
+    }
+    closedir(handle);
+
+    ESP_LOGI(TAG, "Loaded %d animations from %s", loaded, dir);
+    return ESP_OK;
+}
@@ -0,0 +1,79 @@
+#ifndef LED_ANIM_H
+#define LED_ANIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <rgb.h>
+
+#include "led_manager.h"
+
+// Animations are written as text (see led_anim.c for the format) and compiled once, when
+// they are loaded, into the bytecode below. The LED task only ever runs the bytecode,
+// once per frame, so none of the parsing happens on the frame path.
+//
+// Every op is one opcode byte followed by its operands, multi-byte operands are little
+// endian. The compiler always emits LOOP and PATTERN (if any) before the keys, and keys
+// in time order.
+
+typedef enum {
+    LED_OP_END,
+    LED_OP_LOOP,     // period_ms:u16, time wraps at the period instead of holding at the end
+    LED_OP_PATTERN,  // pattern:u8 arg:u8 step_ms:u16
+    LED_OP_KEY,      // at_ms:u16 r:u8 g:u8 b:u8 level:u8 ease:u8, eases in from the key before it
+} led_op_t;
+
+typedef enum {
+    LED_PATTERN_SOLID,
+    LED_PATTERN_SPIN,   // arg is the tail length
+    LED_PATTERN_CHASE,  // arg is the spacing between lit pixels
+} led_pattern_t;
+
+typedef enum {
+    LED_EASE_LINEAR,
+    LED_EASE_SINE,
+    LED_EASE_STEP,
+} led_ease_t;
+
+#define LED_ANIM_MAX_KEYS 16
+#define LED_ANIM_MAX_CODE (3 + 5 + LED_ANIM_MAX_KEYS * 8 + 1)
+
+typedef struct {
+    uint8_t code[LED_ANIM_MAX_CODE];
+} led_program_t;
+
+/**
+ * @brief Everything one frame of a program works out.
+ */
+typedef struct {
+    rgb_t color;
+    uint8_t level;
+    led_pattern_t pattern;
+    uint8_t arg;
+    uint16_t step_ms;
+    // Set if color or level are still changing, as opposed to only the pattern moving
+    bool is_easing;
+    // Waiting on a step key, how long (ms) color and level stay as they are
+    uint32_t hold_ms;
+    bool is_done;
+} led_anim_frame_t;
+
+/**
+ * @brief Compiles `len` bytes of animation source into `program`. On failure `line` is
+ * set to the line the error was found on.
+ */
+esp_err_t led_anim_compile(const char* src, size_t len, led_program_t* program, int* line);
+
+/**
+ * @brief Runs `program` for `t` ms into the animation.
+ */
+void led_anim_run(const led_program_t* program, uint32_t t, led_anim_frame_t* frame);
+
+/**
+ * @brief Copies the program loaded as `id` into `program`. An empty slot gives a program
+ * with no keys, which shows the item's own color.
+ */
+void led_anim_get(uint8_t id, led_program_t* program);
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include <sdkconfig.h>
+#include <http_json.h>
+
+#include "led_manager.h"
+#include "led_api.h"
+
+#define LED_API_PREFIX "/api/animations/"
+
+static const char* TAG = "LED API";
+
+static bool api_get_uri_name(httpd_req_t* req, char* name) {
+    const char* start = req->uri + strlen(LED_API_PREFIX);
+    size_t len = strcspn(start, "?");
+    if (len == 0 || len >= LED_ANIM_NAME_LENGTH) return false;
+
+    memcpy(name, start, len);
+    name[len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Saves the source under the SPIFFS base, where `led_anim_load_dir` finds it on boot.
+ * Written with a plain file descriptor, `fopen` would allocate a FILE and its buffer.
+ */
+static esp_err_t api_save_source(const char* name, const char* src, size_t len) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s.anim", CONFIG_SETUP_FS_BASE, name);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return ESP_FAIL;
+
+    ssize_t written = write(fd, src, len);
+    close(fd);
+
+    return (written == (ssize_t)len) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t api_get_animations_handler(httpd_req_t* req) {
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_array(&json, "animations");
+
+    for (int i=0; i<LED_ANIM_MAX; i++) {
+        char name[LED_ANIM_NAME_LENGTH];
+        if (led_anim_get_name(i, name) == ESP_OK) json_write_string(&json, NULL, name);
+    }
+
+    json_write_end(&json);
+    json_write_end(&json);
+    return json_writer_finish(&json);
+}
+
+static esp_err_t api_put_animation_handler(httpd_req_t* req) {
+    char name[LED_ANIM_NAME_LENGTH];
+    if (!api_get_uri_name(req, name)) return httpd_resp_send_404(req);
+
+    if (req->content_len == 0 || req->content_len > LED_ANIM_MAX_SOURCE) {
+        ESP_LOGW(TAG, "Rejecting animation of %u bytes", (unsigned)req->content_len);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body missing or too large");
+    }
+
+    // Handlers all run on the server's one task, so a single buffer does for every upload
+    static char src[LED_ANIM_MAX_SOURCE];
+
+    // The body can arrive over several reads
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, src + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (ret <= 0) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+        }
+        received += ret;
+    }
+
+    // Compiled here on the HTTP server task, the LED task only ever sees the bytecode
+    uint8_t id;
+    esp_err_t err = led_anim_load(name, src, received, &id);
+    if (err == ESP_OK) {
+        err = api_save_source(name, src, received);
+        if (err != ESP_OK) ESP_LOGW(TAG, "Error saving animation `%s`, it won't be loaded on boot", name);
+        err = ESP_OK;
+    }
+
+    if (err == ESP_ERR_NO_MEM) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No free animation slots");
+    } else if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid animation");
+    }
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_int(&json, "id", id);
+    json_write_end(&json);
+    return json_writer_finish(&json);
+}
+
+static esp_err_t api_post_animation_handler(httpd_req_t* req) {
+    char name[LED_ANIM_NAME_LENGTH];
+    if (!api_get_uri_name(req, name)) return httpd_resp_send_404(req);
+
+    esp_err_t err = led_set_animation(name);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_404(req);
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error playing animation `%s`. Error: %s", name, esp_err_to_name(err));
+        return httpd_resp_send_500(req);
+    }
+
+    return httpd_resp_send(req, NULL, 0);
+}
+
+esp_err_t led_api_register(httpd_handle_t server) {
+    static const httpd_uri_t api_get_animations = {
+        .uri = "/api/animations",
+        .method = HTTP_GET,
+        .handler = api_get_animations_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_put_animation = {
+        .uri = LED_API_PREFIX "*",
+        .method = HTTP_PUT,
+        .handler = api_put_animation_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_post_animation = {
+        .uri = LED_API_PREFIX "*",
+        .method = HTTP_POST,
+        .handler = api_post_animation_handler,
+        .user_ctx = NULL
+    };
+
+    const httpd_uri_t* handlers[] = { &api_get_animations, &api_put_animation, &api_post_animation };
+    for (int i=0; i<sizeof(handlers) / sizeof(handlers[0]); i++) {
+        esp_err_t err = httpd_register_uri_handler(server, handlers[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error registering %s. Error: %s", handlers[i]->uri, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
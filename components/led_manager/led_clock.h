@@ -0,0 +1,27 @@
+#ifndef LED_CLOCK_H
+#define LED_CLOCK_H
+
+#include <stdint.h>
+#include <sdkconfig.h>
+
+// Monotonic clock (us) animations and recorded frames are timed against. Unlike the
+// tick count it has microsecond resolution and doesn't depend on how often the LED
+// task gets to run.
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+
+static inline int64_t led_clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+#else
+#include <esp_timer.h>
+
+static inline int64_t led_clock_us(void) {
+    return esp_timer_get_time();
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef LED_COLOR_H
+#define LED_COLOR_H
+
+#include <stdint.h>
+#include <rgb.h>
+
+// Integer only color pipeline. The tables are generated by gen_lut.py into led_lut.c.
+
+extern const uint8_t led_sin8_lut[256];
+extern const uint16_t led_gamma16_lut[256];
+extern const rgb_t led_hue_lut[256];
+
+static inline uint8_t led_scale8(uint8_t value, uint8_t scale) {
+    return (value * (scale + 1)) >> 8;
+}
+
+/**
+ * @brief Sine over a 0-255 angle, returned as 128 +/- 127.
+ */
+static inline uint8_t led_sin8(uint8_t angle) {
+    return led_sin8_lut[angle];
+}
+
+static inline rgb_t led_rgb_scale(rgb_t color, uint8_t scale) {
+    rgb_t out = {
+        .r = led_scale8(color.r, scale),
+        .g = led_scale8(color.g, scale),
+        .b = led_scale8(color.b, scale),
+    };
+    return out;
+}
+
+static inline uint8_t led_add8(uint8_t a, uint8_t b) {
+    uint16_t sum = a + b;
+    return (sum > 255) ? 255 : sum;
+}
+
+static inline rgb_t led_rgb_add(rgb_t a, rgb_t b) {
+    rgb_t out = {
+        .r = led_add8(a.r, b.r),
+        .g = led_add8(a.g, b.g),
+        .b = led_add8(a.b, b.b),
+    };
+    return out;
+}
+
+/**
+ * @brief Rounded a*(255-amount)/255 + b*amount/255, exact at both ends so a fully
+ * transparent layer leaves what's below it untouched.
+ */
+static inline uint8_t led_mix8(uint8_t a, uint8_t b, uint8_t amount) {
+    uint32_t x = a * (255 - amount) + b * amount + 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/**
+ * @brief Mixes `a` towards `b` by `amount`/255.
+ */
+static inline rgb_t led_rgb_lerp(rgb_t a, rgb_t b, uint8_t amount) {
+    rgb_t out = {
+        .r = led_mix8(a.r, b.r, amount),
+        .g = led_mix8(a.g, b.g, amount),
+        .b = led_mix8(a.b, b.b, amount),
+    };
+    return out;
+}
+
+static inline rgb_t led_hsv(uint8_t hue, uint8_t saturation, uint8_t value) {
+    static const rgb_t white = { .r = 255, .g = 255, .b = 255 };
+    return led_rgb_scale(led_rgb_lerp(white, led_hue_lut[hue], saturation), value);
+}
+
+/**
+ * @brief `color` scaled by a 16 bit `gain`, with `bias`/65536 added before truncating.
+ * 0x8000 rounds to nearest, a bias that changes every frame dithers.
+ */
+static inline rgb_t led_rgb_gain(rgb_t color, uint16_t gain, uint16_t bias) {
+    rgb_t out = {
+        .r = ((uint32_t)color.r * gain + bias) >> 16,
+        .g = ((uint32_t)color.g * gain + bias) >> 16,
+        .b = ((uint32_t)color.b * gain + bias) >> 16,
+    };
+    return out;
+}
+
+/**
+ * @brief Final pixel value for `color` shown at perceptual brightness `level`. Gamma is
+ * applied to the level rather than the color, so colors keep their hue when dimmed.
+ */
+static inline rgb_t led_pixel(rgb_t color, uint8_t level) {
+    return led_rgb_gain(color, led_gamma16_lut[level], 0x8000);
+}
+
+/**
+ * @brief Temporal dither bias for pixel `index` on frame `seq`. Each pixel cycles
+ * through four evenly spaced thresholds, offset from its neighbours so the ring as a
+ * whole doesn't flicker, and averages out to rounding over four frames.
+ */
+static inline uint16_t led_dither_bias(uint32_t seq, uint16_t index) {
+    static const uint16_t thresholds[4] = { 0x2000, 0xa000, 0x6000, 0xe000 };
+    return thresholds[(seq + index) & 3];
+}
+
+#endif
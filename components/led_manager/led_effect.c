@@ -0,0 +1,97 @@
+#include <string.h>
+#include <rgb.h>
+
+#include "led_effect.h"
+#include "led_color.h"
+
+void led_effect_start(led_layer_state_t* layer, const led_item_t* item, uint32_t now) {
+    rgb_t last_color = (layer->item.type == LED_DISPLAY_ANIMATION) ? layer->anim.color : layer->item.color;
+    uint8_t last_level = layer->is_active ? layer->level : 0;
+    bool was_progress = layer->is_active && layer->item.type == LED_DISPLAY_PROGRESS;
+
+    layer->item = *item;
+    layer->is_active = true;
+    layer->is_static = false;
+    layer->start = now;
+    layer->expires = item->duration_ms ? now + item->duration_ms : 0;
+
+    // Fades pick up from wherever the layer's last effect left off
+    layer->fade_from = (item->type == LED_DISPLAY_FADE_IN) ? 0 : last_level;
+    if (item->type == LED_DISPLAY_FADE_OUT) layer->item.color = last_color;
+
+    // Copied so an animation can be replaced while a layer is still playing it
+    if (item->type == LED_DISPLAY_ANIMATION) led_anim_get(item->animation, &layer->program);
+
+    // A new progress value slides the arc over from where it is, rather than jumping
+    layer->progress_from = was_progress ? layer->progress : item->progress << 8;
+    layer->progress = layer->progress_from;
+}
+
+bool led_effect_frame(led_layer_state_t* layer, uint32_t t) {
+    const led_item_t* item = &layer->item;
+    bool is_done = true;
+    layer->wakes = 0;
+
+    switch (item->type) {
+        case LED_DISPLAY_SOLID:
+            layer->level = item->brightness;
+            break;
+        case LED_DISPLAY_PROGRESS: {
+            uint32_t elapsed = (t < LED_PROGRESS_EASE_MS) ? t : LED_PROGRESS_EASE_MS;
+            int delta = (item->progress << 8) - layer->progress_from;
+            layer->progress = layer->progress_from + (delta * (int)elapsed) / LED_PROGRESS_EASE_MS;
+            layer->level = item->brightness;
+            is_done = elapsed == LED_PROGRESS_EASE_MS || delta == 0;
+            break;
+        }
+        case LED_DISPLAY_SPIN:
+        case LED_DISPLAY_CHASE:
+            layer->level = item->brightness;
+            is_done = false;
+            break;
+        case LED_DISPLAY_PULSE:
+            // Swing half the item's brightness either side of it, for as long as the layer
+            // lasts. Only a `duration_ms` ends it.
+            layer->level = item->brightness + ((((int)led_sin8(((t % LED_PULSE_PERIOD_MS) * 256) / LED_PULSE_PERIOD_MS) - 128) * item->brightness) >> 8);
+            is_done = false;
+            break;
+        case LED_DISPLAY_ANIMATION:
+            // Falls back to the item's own color if the program has no keys
+            layer->anim.color = item->color;
+            layer->anim.level = item->brightness;
+            led_anim_run(&layer->program, t, &layer->anim);
+            layer->level = layer->anim.level;
+            is_done = layer->anim.is_done;
+            // A solid pattern waiting on a step key draws nothing new until the step
+            if (layer->anim.hold_ms != 0 && layer->anim.pattern == LED_PATTERN_SOLID) {
+                layer->wakes = layer->start + t + layer->anim.hold_ms;
+            }
+            break;
+        case LED_DISPLAY_FADE_IN:
+        case LED_DISPLAY_FADE_OUT: {
+            // Step evenly through perceptual levels from wherever the last effect left off
+            uint32_t elapsed = (t < LED_FADE_MS) ? t : LED_FADE_MS;
+            layer->level = layer->fade_from + ((item->brightness - layer->fade_from) * (int)elapsed) / LED_FADE_MS;
+            is_done = elapsed == LED_FADE_MS;
+            break;
+        }
+    }
+
+    layer->gain = led_gamma16_lut[layer->level];
+    return is_done;
+}
+
+uint32_t led_effect_interval(const led_layer_state_t* layer) {
+    switch (layer->item.type) {
+        case LED_DISPLAY_SPIN:
+        case LED_DISPLAY_CHASE:
+            // These move a whole pixel at a time, drawing in between changes nothing
+            return LED_DELAY;
+        case LED_DISPLAY_ANIMATION:
+            if (layer->wakes != 0) return 0;
+            if (layer->anim.is_easing || layer->anim.pattern == LED_PATTERN_SOLID) return LED_SMOOTH_FRAME_MS;
+            return layer->anim.step_ms;
+        default:
+            return LED_SMOOTH_FRAME_MS;
+    }
+}
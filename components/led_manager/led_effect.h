@@ -0,0 +1,111 @@
+#ifndef LED_EFFECT_H
+#define LED_EFFECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <rgb.h>
+
+#include "led_manager.h"
+#include "led_anim.h"
+#include "led_color.h"
+
+/**
+ * @brief State of one compositor layer. Only touched by the LED task.
+ */
+typedef struct {
+    led_item_t item;
+    bool is_active;
+    // Set once the effect has stopped changing, so the frame it leaves is final
+    bool is_static;
+    // Time (ms) the effect started, and the time the layer is cleared (0 for never)
+    uint32_t start;
+    uint32_t expires;
+    // Time (ms) an effect holding still needs its next frame, 0 if it isn't holding
+    uint32_t wakes;
+    uint8_t level;
+    uint8_t fade_from;
+    // Progress arc as drawn, in 1/256ths of `item.progress`, and where it eases from
+    uint16_t progress;
+    uint16_t progress_from;
+    // Gamma corrected gain for `level`, worked out once per frame
+    uint16_t gain;
+    // LED_DISPLAY_ANIMATION only, the layer's own copy of the program and what it
+    // worked out for the current frame
+    led_program_t program;
+    led_anim_frame_t anim;
+} led_layer_state_t;
+
+typedef struct {
+    rgb_t color;
+    uint8_t alpha;
+} led_rgba_t;
+
+/**
+ * @brief Starts `item` on `layer` at `now` (ms), carrying over anything it continues
+ * from, like the color and brightness a fade out starts from.
+ */
+void led_effect_start(led_layer_state_t* layer, const led_item_t* item, uint32_t now);
+
+/**
+ * @brief Works out everything about the effect `t` ms in that is the same for every
+ * pixel. Returns true if the effect won't change after this frame.
+ */
+bool led_effect_frame(led_layer_state_t* layer, uint32_t t);
+
+/**
+ * @brief How often (ms) the layer's effect needs a new frame while it is animating, or 0
+ * if it is holding still until `wakes`.
+ */
+uint32_t led_effect_interval(const led_layer_state_t* layer);
+
+static const led_rgba_t LED_TRANSPARENT = { .color = { { 0 } }, .alpha = 0 };
+
+static inline led_rgba_t led_spin_pixel(const led_layer_state_t* layer, rgb_t color, uint16_t index, uint16_t len, uint32_t step, uint8_t tail, uint16_t bias) {
+    // A bright head with a tail that fades out behind it
+    uint32_t behind = (step + len - index) % len;
+    if (behind >= tail) return LED_TRANSPARENT;
+
+    uint8_t level = led_scale8(layer->level, 255 >> (behind < 8 ? behind : 8));
+    led_rgba_t out = { .color = led_rgb_gain(color, led_gamma16_lut[level], bias), .alpha = 255 };
+    return out;
+}
+
+/**
+ * @brief Pixel `index` of a `len` pixel ring for the layer `t` ms in. `bias` is the
+ * rounding bias for the final pixel value, see `led_rgb_gain`. Inline so the render
+ * kernels specialized for a fixed `len` can fold it into their loop.
+ */
+static inline led_rgba_t led_effect_pixel(const led_layer_state_t* layer, uint16_t index, uint16_t len, uint32_t t, uint16_t bias) {
+    const led_item_t* item = &layer->item;
+    rgb_t color = (item->type == LED_DISPLAY_ANIMATION) ? layer->anim.color : item->color;
+    led_rgba_t out = { .color = led_rgb_gain(color, layer->gain, bias), .alpha = 255 };
+
+    switch (item->type) {
+        case LED_DISPLAY_SPIN:
+            return led_spin_pixel(layer, color, index, len, t / LED_DELAY, LED_SPIN_TAIL, bias);
+        case LED_DISPLAY_CHASE:
+            return ((index + t / LED_DELAY) % LED_CHASE_SPACING == 0) ? out : LED_TRANSPARENT;
+        case LED_DISPLAY_PROGRESS: {
+            // Light progress/255 of the ring, with the last pixel partly covering what's below
+            int level = ((layer->progress * len) >> 8) - index * 255;
+            if (level <= 0) return LED_TRANSPARENT;
+            if (level < 255) out.alpha = level;
+            return out;
+        }
+        case LED_DISPLAY_ANIMATION: {
+            const led_anim_frame_t* anim = &layer->anim;
+            switch (anim->pattern) {
+                case LED_PATTERN_SPIN:
+                    return led_spin_pixel(layer, color, index, len, t / anim->step_ms, anim->arg, bias);
+                case LED_PATTERN_CHASE:
+                    return ((index + t / anim->step_ms) % anim->arg == 0) ? out : LED_TRANSPARENT;
+                default:
+                    return out;
+            }
+        }
+        default:
+            return out;
+    }
+}
+
+#endif
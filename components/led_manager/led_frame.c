@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+
+#include "led_frame.h"
+
+static const char *TAG = "LED Frame";
+
+// Both buffers are one allocation, every strip's pixels one after another
+static rgb_t* frame_buf = NULL;
+static rgb_t* front = NULL;
+static rgb_t* back = NULL;
+
+static uint8_t strip_count = 0;
+static uint16_t strip_length[LED_MAX_STRIPS];
+static uint32_t strip_offset[LED_MAX_STRIPS];
+
+static inline bool rgb_equal(rgb_t a, rgb_t b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+esp_err_t led_frame_init(const led_config_t* config) {
+    uint32_t total = 0;
+    for (int i=0; i<config->strip_count; i++) {
+        strip_offset[i] = total;
+        strip_length[i] = config->strips[i].length;
+        total += config->strips[i].length;
+    }
+
+    free(frame_buf);
+    frame_buf = calloc(2 * total, sizeof(rgb_t));
+    if (frame_buf == NULL) {
+        strip_count = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    strip_count = config->strip_count;
+    front = frame_buf;
+    back = frame_buf + total;
+
+    return ESP_OK;
+}
+
+rgb_t* led_frame_back(uint8_t strip) {
+    return back + strip_offset[strip];
+}
+
+uint16_t led_frame_length(uint8_t strip) {
+    return strip_length[strip];
+}
+
+uint8_t led_frame_strips(void) {
+    return strip_count;
+}
+
+bool led_frame_present(const led_output_t* output) {
+    bool is_sent = false;
+
+    for (int s=0; s<strip_count; s++) {
+        const rgb_t* old = front + strip_offset[s];
+        const rgb_t* new = back + strip_offset[s];
+
+        // Only the range between the first and last changed pixel goes out
+        int start = 0;
+        int end = strip_length[s];
+        while (start < end && rgb_equal(old[start], new[start])) start++;
+        while (end > start && rgb_equal(old[end - 1], new[end - 1])) end--;
+        if (start == end) continue;
+
+        esp_err_t err = output->send(s, &new[start], start, end - start);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Error presenting strip %d pixels %d-%d. Error: %s", s, start, end, esp_err_to_name(err));
+        }
+        is_sent = true;
+    }
+
+    // The new back buffer is two frames old, but effects draw every pixel of every
+    // frame, so only its comparison against the new front matters
+    rgb_t* tmp = front;
+    front = back;
+    back = tmp;
+
+    return is_sent;
+}
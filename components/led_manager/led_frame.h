@@ -0,0 +1,33 @@
+#ifndef LED_FRAME_H
+#define LED_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include <rgb.h>
+
+#include "led_manager.h"
+#include "led_output.h"
+
+// Double buffered framebuffer for every strip, sized from the config at init. Effects
+// draw a whole frame of final pixel values (see `led_pixel`) straight into the back
+// buffer, then `led_frame_present` sends only the pixels that differ from what is
+// already on each strip, and skips strips where nothing changed.
+// Only used from the LED task.
+
+esp_err_t led_frame_init(const led_config_t* config);
+
+/**
+ * @brief Back buffer for `strip`, `led_frame_length(strip)` pixels long.
+ */
+rgb_t* led_frame_back(uint8_t strip);
+uint16_t led_frame_length(uint8_t strip);
+uint8_t led_frame_strips(void);
+
+/**
+ * @brief Sends the changed part of each strip's back buffer to `output` and swaps
+ * buffers. Returns true if anything was sent.
+ */
+bool led_frame_present(const led_output_t* output);
+
+#endif
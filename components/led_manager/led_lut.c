@@ -0,0 +1,116 @@
+// Generated by gen_lut.py, do not edit by hand.
+
+#include "led_color.h"
+
+const uint8_t led_sin8_lut[256] = {
+    128, 131, 134, 137, 140, 144, 147, 150, 153, 156, 159, 162, 165, 168, 171, 174,
+    177, 179, 182, 185, 188, 191, 193, 196, 199, 201, 204, 206, 209, 211, 213, 216,
+    218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 239, 240, 241, 243, 244,
+    245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+    255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+    245, 244, 243, 241, 240, 239, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+    218, 216, 213, 211, 209, 206, 204, 201, 199, 196, 193, 191, 188, 185, 182, 179,
+    177, 174, 171, 168, 165, 162, 159, 156, 153, 150, 147, 144, 140, 137, 134, 131,
+    128, 125, 122, 119, 116, 112, 109, 106, 103, 100,  97,  94,  91,  88,  85,  82,
+     79,  77,  74,  71,  68,  65,  63,  60,  57,  55,  52,  50,  47,  45,  43,  40,
+     38,  36,  34,  32,  30,  28,  26,  24,  22,  21,  19,  17,  16,  15,  13,  12,
+     11,  10,   8,   7,   6,   6,   5,   4,   3,   3,   2,   2,   2,   1,   1,   1,
+      1,   1,   1,   1,   2,   2,   2,   3,   3,   4,   5,   6,   6,   7,   8,  10,
+     11,  12,  13,  15,  16,  17,  19,  21,  22,  24,  26,  28,  30,  32,  34,  36,
+     38,  40,  43,  45,  47,  50,  52,  55,  57,  60,  63,  65,  68,  71,  74,  77,
+     79,  82,  85,  88,  91,  94,  97, 100, 103, 106, 109, 112, 116, 119, 122, 125,
+};
+
+// Gamma 2.2, so brightness levels are evenly spaced to the eye
+const uint16_t led_gamma16_lut[256] = {
+        0,     0,     2,     4,     7,    11,    17,    24,    32,    42,    53,    65,
+       79,    94,   111,   129,   148,   169,   192,   216,   242,   270,   299,   330,
+      362,   396,   432,   469,   508,   549,   591,   635,   681,   729,   779,   830,
+      883,   938,   995,  1053,  1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+     1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,  2334,  2427,  2521,  2618,
+     2717,  2817,  2920,  3024,  3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,
+     4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,  5115,  5257,  5401,  5547,
+     5695,  5845,  5998,  6152,  6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+     7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,  9111,  9305,  9501,  9699,
+     9900, 10102, 10307, 10515, 10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254,
+    12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140, 14386, 14635, 14885, 15138,
+    15394, 15652, 15912, 16174, 16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694, 20996, 21301, 21609, 21919,
+    22231, 22546, 22863, 23182, 23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826,
+    26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627, 28988, 29351, 29717, 30086,
+    30457, 30830, 31206, 31585, 31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981, 38402, 38825, 39252, 39680,
+    40112, 40546, 40982, 41421, 41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025,
+    45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793, 49275, 49761, 50249, 50739,
+    51232, 51728, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295,
+    63851, 64410, 64971, 65535,
+};
+
+// Fully saturated colors around the hue wheel
+const rgb_t led_hue_lut[256] = {
+    { .r = 255, .g =   0, .b =   0 }, { .r = 255, .g =   6, .b =   0 }, { .r = 255, .g =  12, .b =   0 }, { .r = 255, .g =  18, .b =   0 },
+    { .r = 255, .g =  24, .b =   0 }, { .r = 255, .g =  30, .b =   0 }, { .r = 255, .g =  36, .b =   0 }, { .r = 255, .g =  42, .b =   0 },
+    { .r = 255, .g =  48, .b =   0 }, { .r = 255, .g =  54, .b =   0 }, { .r = 255, .g =  60, .b =   0 }, { .r = 255, .g =  66, .b =   0 },
+    { .r = 255, .g =  72, .b =   0 }, { .r = 255, .g =  78, .b =   0 }, { .r = 255, .g =  84, .b =   0 }, { .r = 255, .g =  90, .b =   0 },
+    { .r = 255, .g =  96, .b =   0 }, { .r = 255, .g = 102, .b =   0 }, { .r = 255, .g = 108, .b =   0 }, { .r = 255, .g = 114, .b =   0 },
+    { .r = 255, .g = 120, .b =   0 }, { .r = 255, .g = 126, .b =   0 }, { .r = 255, .g = 131, .b =   0 }, { .r = 255, .g = 137, .b =   0 },
+    { .r = 255, .g = 143, .b =   0 }, { .r = 255, .g = 149, .b =   0 }, { .r = 255, .g = 155, .b =   0 }, { .r = 255, .g = 161, .b =   0 },
+    { .r = 255, .g = 167, .b =   0 }, { .r = 255, .g = 173, .b =   0 }, { .r = 255, .g = 179, .b =   0 }, { .r = 255, .g = 185, .b =   0 },
+    { .r = 255, .g = 191, .b =   0 }, { .r = 255, .g = 197, .b =   0 }, { .r = 255, .g = 203, .b =   0 }, { .r = 255, .g = 209, .b =   0 },
+    { .r = 255, .g = 215, .b =   0 }, { .r = 255, .g = 221, .b =   0 }, { .r = 255, .g = 227, .b =   0 }, { .r = 255, .g = 233, .b =   0 },
+    { .r = 255, .g = 239, .b =   0 }, { .r = 255, .g = 245, .b =   0 }, { .r = 255, .g = 251, .b =   0 }, { .r = 253, .g = 255, .b =   0 },
+    { .r = 247, .g = 255, .b =   0 }, { .r = 241, .g = 255, .b =   0 }, { .r = 235, .g = 255, .b =   0 }, { .r = 229, .g = 255, .b =   0 },
+    { .r = 223, .g = 255, .b =   0 }, { .r = 217, .g = 255, .b =   0 }, { .r = 211, .g = 255, .b =   0 }, { .r = 205, .g = 255, .b =   0 },
+    { .r = 199, .g = 255, .b =   0 }, { .r = 193, .g = 255, .b =   0 }, { .r = 187, .g = 255, .b =   0 }, { .r = 181, .g = 255, .b =   0 },
+    { .r = 175, .g = 255, .b =   0 }, { .r = 169, .g = 255, .b =   0 }, { .r = 163, .g = 255, .b =   0 }, { .r = 157, .g = 255, .b =   0 },
+    { .r = 151, .g = 255, .b =   0 }, { .r = 145, .g = 255, .b =   0 }, { .r = 139, .g = 255, .b =   0 }, { .r = 133, .g = 255, .b =   0 },
+    { .r = 128, .g = 255, .b =   0 }, { .r = 122, .g = 255, .b =   0 }, { .r = 116, .g = 255, .b =   0 }, { .r = 110, .g = 255, .b =   0 },
+    { .r = 104, .g = 255, .b =   0 }, { .r =  98, .g = 255, .b =   0 }, { .r =  92, .g = 255, .b =   0 }, { .r =  86, .g = 255, .b =   0 },
+    { .r =  80, .g = 255, .b =   0 }, { .r =  74, .g = 255, .b =   0 }, { .r =  68, .g = 255, .b =   0 }, { .r =  62, .g = 255, .b =   0 },
+    { .r =  56, .g = 255, .b =   0 }, { .r =  50, .g = 255, .b =   0 }, { .r =  44, .g = 255, .b =   0 }, { .r =  38, .g = 255, .b =   0 },
+    { .r =  32, .g = 255, .b =   0 }, { .r =  26, .g = 255, .b =   0 }, { .r =  20, .g = 255, .b =   0 }, { .r =  14, .g = 255, .b =   0 },
+    { .r =   8, .g = 255, .b =   0 }, { .r =   2, .g = 255, .b =   0 }, { .r =   0, .g = 255, .b =   4 }, { .r =   0, .g = 255, .b =  10 },
+    { .r =   0, .g = 255, .b =  16 }, { .r =   0, .g = 255, .b =  22 }, { .r =   0, .g = 255, .b =  28 }, { .r =   0, .g = 255, .b =  34 },
+    { .r =   0, .g = 255, .b =  40 }, { .r =   0, .g = 255, .b =  46 }, { .r =   0, .g = 255, .b =  52 }, { .r =   0, .g = 255, .b =  58 },
+    { .r =   0, .g = 255, .b =  64 }, { .r =   0, .g = 255, .b =  70 }, { .r =   0, .g = 255, .b =  76 }, { .r =   0, .g = 255, .b =  82 },
+    { .r =   0, .g = 255, .b =  88 }, { .r =   0, .g = 255, .b =  94 }, { .r =   0, .g = 255, .b = 100 }, { .r =   0, .g = 255, .b = 106 },
+    { .r =   0, .g = 255, .b = 112 }, { .r =   0, .g = 255, .b = 118 }, { .r =   0, .g = 255, .b = 124 }, { .r =   0, .g = 255, .b = 129 },
+    { .r =   0, .g = 255, .b = 135 }, { .r =   0, .g = 255, .b = 141 }, { .r =   0, .g = 255, .b = 147 }, { .r =   0, .g = 255, .b = 153 },
+    { .r =   0, .g = 255, .b = 159 }, { .r =   0, .g = 255, .b = 165 }, { .r =   0, .g = 255, .b = 171 }, { .r =   0, .g = 255, .b = 177 },
+    { .r =   0, .g = 255, .b = 183 }, { .r =   0, .g = 255, .b = 189 }, { .r =   0, .g = 255, .b = 195 }, { .r =   0, .g = 255, .b = 201 },
+    { .r =   0, .g = 255, .b = 207 }, { .r =   0, .g = 255, .b = 213 }, { .r =   0, .g = 255, .b = 219 }, { .r =   0, .g = 255, .b = 225 },
+    { .r =   0, .g = 255, .b = 231 }, { .r =   0, .g = 255, .b = 237 }, { .r =   0, .g = 255, .b = 243 }, { .r =   0, .g = 255, .b = 249 },
+    { .r =   0, .g = 255, .b = 255 }, { .r =   0, .g = 249, .b = 255 }, { .r =   0, .g = 243, .b = 255 }, { .r =   0, .g = 237, .b = 255 },
+    { .r =   0, .g = 231, .b = 255 }, { .r =   0, .g = 225, .b = 255 }, { .r =   0, .g = 219, .b = 255 }, { .r =   0, .g = 213, .b = 255 },
+    { .r =   0, .g = 207, .b = 255 }, { .r =   0, .g = 201, .b = 255 }, { .r =   0, .g = 195, .b = 255 }, { .r =   0, .g = 189, .b = 255 },
+    { .r =   0, .g = 183, .b = 255 }, { .r =   0, .g = 177, .b = 255 }, { .r =   0, .g = 171, .b = 255 }, { .r =   0, .g = 165, .b = 255 },
+    { .r =   0, .g = 159, .b = 255 }, { .r =   0, .g = 153, .b = 255 }, { .r =   0, .g = 147, .b = 255 }, { .r =   0, .g = 141, .b = 255 },
+    { .r =   0, .g = 135, .b = 255 }, { .r =   0, .g = 129, .b = 255 }, { .r =   0, .g = 124, .b = 255 }, { .r =   0, .g = 118, .b = 255 },
+    { .r =   0, .g = 112, .b = 255 }, { .r =   0, .g = 106, .b = 255 }, { .r =   0, .g = 100, .b = 255 }, { .r =   0, .g =  94, .b = 255 },
+    { .r =   0, .g =  88, .b = 255 }, { .r =   0, .g =  82, .b = 255 }, { .r =   0, .g =  76, .b = 255 }, { .r =   0, .g =  70, .b = 255 },
+    { .r =   0, .g =  64, .b = 255 }, { .r =   0, .g =  58, .b = 255 }, { .r =   0, .g =  52, .b = 255 }, { .r =   0, .g =  46, .b = 255 },
+    { .r =   0, .g =  40, .b = 255 }, { .r =   0, .g =  34, .b = 255 }, { .r =   0, .g =  28, .b = 255 }, { .r =   0, .g =  22, .b = 255 },
+    { .r =   0, .g =  16, .b = 255 }, { .r =   0, .g =  10, .b = 255 }, { .r =   0, .g =   4, .b = 255 }, { .r =   2, .g =   0, .b = 255 },
+    { .r =   8, .g =   0, .b = 255 }, { .r =  14, .g =   0, .b = 255 }, { .r =  20, .g =   0, .b = 255 }, { .r =  26, .g =   0, .b = 255 },
+    { .r =  32, .g =   0, .b = 255 }, { .r =  38, .g =   0, .b = 255 }, { .r =  44, .g =   0, .b = 255 }, { .r =  50, .g =   0, .b = 255 },
+    { .r =  56, .g =   0, .b = 255 }, { .r =  62, .g =   0, .b = 255 }, { .r =  68, .g =   0, .b = 255 }, { .r =  74, .g =   0, .b = 255 },
+    { .r =  80, .g =   0, .b = 255 }, { .r =  86, .g =   0, .b = 255 }, { .r =  92, .g =   0, .b = 255 }, { .r =  98, .g =   0, .b = 255 },
+    { .r = 104, .g =   0, .b = 255 }, { .r = 110, .g =   0, .b = 255 }, { .r = 116, .g =   0, .b = 255 }, { .r = 122, .g =   0, .b = 255 },
+    { .r = 128, .g =   0, .b = 255 }, { .r = 133, .g =   0, .b = 255 }, { .r = 139, .g =   0, .b = 255 }, { .r = 145, .g =   0, .b = 255 },
+    { .r = 151, .g =   0, .b = 255 }, { .r = 157, .g =   0, .b = 255 }, { .r = 163, .g =   0, .b = 255 }, { .r = 169, .g =   0, .b = 255 },
+    { .r = 175, .g =   0, .b = 255 }, { .r = 181, .g =   0, .b = 255 }, { .r = 187, .g =   0, .b = 255 }, { .r = 193, .g =   0, .b = 255 },
+    { .r = 199, .g =   0, .b = 255 }, { .r = 205, .g =   0, .b = 255 }, { .r = 211, .g =   0, .b = 255 }, { .r = 217, .g =   0, .b = 255 },
+    { .r = 223, .g =   0, .b = 255 }, { .r = 229, .g =   0, .b = 255 }, { .r = 235, .g =   0, .b = 255 }, { .r = 241, .g =   0, .b = 255 },
+    { .r = 247, .g =   0, .b = 255 }, { .r = 253, .g =   0, .b = 255 }, { .r = 255, .g =   0, .b = 251 }, { .r = 255, .g =   0, .b = 245 },
+    { .r = 255, .g =   0, .b = 239 }, { .r = 255, .g =   0, .b = 233 }, { .r = 255, .g =   0, .b = 227 }, { .r = 255, .g =   0, .b = 221 },
+    { .r = 255, .g =   0, .b = 215 }, { .r = 255, .g =   0, .b = 209 }, { .r = 255, .g =   0, .b = 203 }, { .r = 255, .g =   0, .b = 197 },
+    { .r = 255, .g =   0, .b = 191 }, { .r = 255, .g =   0, .b = 185 }, { .r = 255, .g =   0, .b = 179 }, { .r = 255, .g =   0, .b = 173 },
+    { .r = 255, .g =   0, .b = 167 }, { .r = 255, .g =   0, .b = 161 }, { .r = 255, .g =   0, .b = 155 }, { .r = 255, .g =   0, .b = 149 },
+    { .r = 255, .g =   0, .b = 143 }, { .r = 255, .g =   0, .b = 137 }, { .r = 255, .g =   0, .b = 131 }, { .r = 255, .g =   0, .b = 126 },
+    { .r = 255, .g =   0, .b = 120 }, { .r = 255, .g =   0, .b = 114 }, { .r = 255, .g =   0, .b = 108 }, { .r = 255, .g =   0, .b = 102 },
+    { .r = 255, .g =   0, .b =  96 }, { .r = 255, .g =   0, .b =  90 }, { .r = 255, .g =   0, .b =  84 }, { .r = 255, .g =   0, .b =  78 },
+    { .r = 255, .g =   0, .b =  72 }, { .r = 255, .g =   0, .b =  66 }, { .r = 255, .g =   0, .b =  60 }, { .r = 255, .g =   0, .b =  54 },
+    { .r = 255, .g =   0, .b =  48 }, { .r = 255, .g =   0, .b =  42 }, { .r = 255, .g =   0, .b =  36 }, { .r = 255, .g =   0, .b =  30 },
+    { .r = 255, .g =   0, .b =  24 }, { .r = 255, .g =   0, .b =  18 }, { .r = 255, .g =   0, .b =  12 }, { .r = 255, .g =   0, .b =   6 },
+};
@@ -1,155 +1,428 @@
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include <esp_err.h>
 #include <esp_log.h>
-#include <led_strip.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/FreeRTOSConfig.h>
 #include <FreeRTOSConfig.h>
 #include <freertos/task.h>
-#include <freertos/queue.h>
+#include <sdkconfig.h>
 
 #include "led_manager.h"
+#include "led_frame.h"
+#include "led_color.h"
+#include "led_effect.h"
+#include "led_output.h"
+#include "led_clock.h"
 
 static const char *TAG = "LED Manager";
-static QueueHandle_t led_queue;
+static TaskHandle_t led_task_handle = NULL;
+
+typedef struct {
+    led_layer_t layer;
+    bool is_clear;
+    led_item_t item;
+} led_cmd_t;
+
+// Latest-wins mailbox with a slot per layer. Producers overwrite whatever the LED task
+// hasn't taken yet instead of waiting for space, so posting never blocks. The second
+// slot only ever holds a fade out queued behind the fade in it finishes.
+typedef struct {
+    led_cmd_t cmds[2];
+    uint8_t count;
+} led_mailbox_t;
+
+static led_mailbox_t mailbox[LED_LAYER_MAX];
+static led_stats_t stats;
+static portMUX_TYPE mailbox_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static led_layer_state_t layers[LED_LAYER_MAX];
+
+#if CONFIG_IDF_TARGET_LINUX
+static const led_output_t* output = &led_output_record;
+#else
+static const led_output_t* output = &led_output_strip;
+#endif
+
+static bool is_fade(led_display_type_t type) {
+    return type == LED_DISPLAY_FADE_IN || type == LED_DISPLAY_FADE_OUT;
+}
 
-static rgb_t last_color;
+static bool led_cmd_equal(const led_cmd_t* a, const led_cmd_t* b) {
+    if (a->layer != b->layer || a->is_clear != b->is_clear) return false;
+    if (a->is_clear) return true;
 
-static led_strip_t strip = {
-    .type = LED_STRIP_WS2812,
-    .length = NUM_LEDS,
-    .gpio = LED_PIN,
-    .buf = NULL,
-    .brightness = 20,
-};
+    const led_item_t* x = &a->item;
+    const led_item_t* y = &b->item;
+    return x->type == y->type && x->color.r == y->color.r && x->color.g == y->color.g && x->color.b == y->color.b
+        && x->brightness == y->brightness && x->progress == y->progress && x->animation == y->animation && x->blend == y->blend
+        && x->duration_ms == y->duration_ms;
+}
 
-union display_data_t {
-    int brightness;
-};
+// Frame timing accounting, only touched by the LED task
+static uint32_t frames;
+static uint32_t fps;
+static uint32_t fps_window_start;
+static uint32_t fps_window_frames;
+static uint32_t missed;
+static uint32_t jitter[LED_JITTER_BUCKETS];
+
+static inline rgb_t led_blend(rgb_t below, led_rgba_t above, led_blend_t blend) {
+    switch (blend) {
+        case LED_BLEND_ADD:
+            return led_rgb_add(below, led_rgb_scale(above.color, above.alpha));
+        case LED_BLEND_REPLACE:
+            return led_rgb_scale(above.color, above.alpha);
+        default:
+            return led_rgb_lerp(below, above.color, above.alpha);
+    }
+}
 
-static void led_task(void* args) {
-    led_item_t led_item;
-    int t = 0;
-    bool display_done = false;
+/**
+ * @brief Puts `cmd` in its layer's mailbox. Must be called with `mailbox_lock` held.
+ */
+static void led_mailbox_put(const led_cmd_t* cmd) {
+    led_mailbox_t* box = &mailbox[cmd->layer];
+    stats.posted++;
+
+    // The same command again changes nothing, e.g. a status that is re-sent unchanged
+    if (box->count > 0 && led_cmd_equal(&box->cmds[box->count - 1], cmd)) {
+        stats.coalesced++;
+        return;
+    }
+
+    // A fade out finishes the fade in waiting ahead of it, so a flash still plays out
+    bool follows_fade_in = box->count == 1 && !box->cmds[0].is_clear && box->cmds[0].item.type == LED_DISPLAY_FADE_IN;
+    if (follows_fade_in && !cmd->is_clear && cmd->item.type == LED_DISPLAY_FADE_OUT) {
+        box->cmds[box->count++] = *cmd;
+        return;
+    }
+
+    stats.dropped += box->count;
+    box->cmds[0] = *cmd;
+    box->count = 1;
+}
+
+/**
+ * @brief Starts the next command for every layer that is free to take one. A layer part
+ * way through a fade keeps its command waiting, so fades sent one after another play in
+ * order. Anything else is replaced straight away.
+ */
+static void led_take_commands(uint32_t now) {
+    for (int i=0; i<LED_LAYER_MAX; i++) {
+        led_layer_state_t* layer = &layers[i];
+        if (layer->is_active && !layer->is_static && is_fade(layer->item.type)) continue;
+
+        led_mailbox_t* box = &mailbox[i];
+        led_cmd_t cmd;
+        bool has_cmd = false;
+
+        portENTER_CRITICAL_SAFE(&mailbox_lock);
+        if (box->count > 0) {
+            cmd = box->cmds[0];
+            box->cmds[0] = box->cmds[1];
+            box->count--;
+            has_cmd = true;
+        }
+        portEXIT_CRITICAL_SAFE(&mailbox_lock);
+
+        if (!has_cmd) continue;
+
+        if (cmd.is_clear) {
+            layer->is_active = false;
+        } else {
+            led_effect_start(layer, &cmd.item, now);
+        }
+    }
+}
+
+/**
+ * @brief Composites every active layer into one strip's back buffer. Always inlined into
+ * the kernels below, so with a constant `len` the compiler can unroll the pixel loop and
+ * turn the ring arithmetic in `led_effect_pixel` into constant operations.
+ */
+static inline __attribute__((always_inline)) void led_render(rgb_t* pixels, uint16_t len, uint32_t now, uint32_t seq, bool is_dithering) {
+    // One pass over the strip, each pixel goes through every layer bottom to top
+    for (uint16_t p=0; p<len; p++) {
+        uint16_t bias = is_dithering ? led_dither_bias(seq, p) : 0x8000;
+        rgb_t color = COLOR_OFF;
+
+        for (int i=0; i<LED_LAYER_MAX; i++) {
+            const led_layer_state_t* layer = &layers[i];
+            if (!layer->is_active) continue;
+
+            color = led_blend(color, led_effect_pixel(layer, p, len, now - layer->start, bias), layer->item.blend);
+        }
+        pixels[p] = color;
+    }
+}
+
+// Kernels for the common ring sizes, anything else goes through the generic one
+#define LED_RENDER_KERNEL(LEN) \
+    static void led_render_##LEN(rgb_t* pixels, uint32_t now, uint32_t seq, bool is_dithering) { \
+        led_render(pixels, LEN, now, seq, is_dithering); \
+    }
+
+LED_RENDER_KERNEL(16)
+LED_RENDER_KERNEL(24)
+LED_RENDER_KERNEL(60)
+
+static void led_render_strip(uint8_t strip, uint32_t now, uint32_t seq, bool is_dithering) {
+    rgb_t* pixels = led_frame_back(strip);
+    uint16_t len = led_frame_length(strip);
+
+    switch (len) {
+        case 16:
+            led_render_16(pixels, now, seq, is_dithering);
+            break;
+        case 24:
+            led_render_24(pixels, now, seq, is_dithering);
+            break;
+        case 60:
+            led_render_60(pixels, now, seq, is_dithering);
+            break;
+        default:
+            led_render(pixels, len, now, seq, is_dithering);
+            break;
+    }
+}
+
+/**
+ * @brief Draws the frame for `now` (ms) of every layer into the framebuffer. Returns how
+ * soon (ms) the next frame is needed, or 0 if every layer is static.
+ */
+static uint32_t led_compose(uint32_t now, uint32_t seq) {
+    uint32_t interval = 0;
+
+    for (int i=0; i<LED_LAYER_MAX; i++) {
+        led_layer_state_t* layer = &layers[i];
+        if (!layer->is_active) continue;
+
+        if (layer->expires != 0 && (int32_t)(now - layer->expires) >= 0) {
+            layer->is_active = false;
+            continue;
+        }
+
+        layer->is_static = led_effect_frame(layer, now - layer->start);
+        if (layer->is_static) continue;
+
+        // Run as fast as the most demanding layer needs. One holding still asks for no
+        // frames at all, `led_idle_timeout` wakes the task for it.
+        uint32_t layer_interval = led_effect_interval(layer);
+        if (layer_interval != 0 && (interval == 0 || layer_interval < interval)) interval = layer_interval;
+    }
 
-    // Wait forever for first time to make sure we have something to display
-    xQueueReceive(led_queue, &led_item, portMAX_DELAY);
+    // Dither while animating so slow fades at low brightness don't step visibly. The
+    // last frame before going static is rounded, it has to hold still on its own.
+    bool is_dithering = interval != 0 && interval <= LED_SMOOTH_FRAME_MS;
+
+    for (uint8_t s=0; s<led_frame_strips(); s++) {
+        led_render_strip(s, now, seq, is_dithering);
+    }
+
+    return interval;
+}
+
+/**
+ * @brief How long the LED task can block for once nothing is animating, which is until
+ * the next layer expires or one holding still needs its next frame.
+ */
+static TickType_t led_idle_timeout(uint32_t now) {
+    uint32_t wait_ms = UINT32_MAX;
+
+    for (int i=0; i<LED_LAYER_MAX; i++) {
+        if (!layers[i].is_active) continue;
+
+        uint32_t deadlines[] = { layers[i].expires, layers[i].is_static ? 0 : layers[i].wakes };
+        for (int d=0; d<sizeof(deadlines) / sizeof(deadlines[0]); d++) {
+            if (deadlines[d] == 0) continue;
+
+            int32_t remaining = (int32_t)(deadlines[d] - now);
+            if (remaining < 0) remaining = 0;
+            if ((uint32_t)remaining < wait_ms) wait_ms = remaining;
+        }
+    }
+
+    // Round up so we never wake before the layer expires and spin. A timeout counts
+    // whole ticks from the tick we're part way through, so it can end up to a tick early.
+    if (wait_ms == UINT32_MAX) return portMAX_DELAY;
+    return (wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1;
+}
+
+/**
+ * @brief Records how far from its deadline a frame started. Frames are woken on tick
+ * boundaries, so the buckets are whole ticks and anything in the first is on time.
+ */
+static void led_record_jitter(int64_t now_us, int64_t deadline_us) {
+    int64_t error = now_us - deadline_us;
+    if (error < 0) error = -error;
+
+    int64_t tick_us = 1000 * portTICK_PERIOD_MS;
+    int bucket = 0;
+    while (bucket < LED_JITTER_BUCKETS - 1 && error >= (tick_us << bucket)) bucket++;
+    jitter[bucket]++;
+}
+
+static void led_count_frame(uint32_t now) {
+    frames++;
+    fps_window_frames++;
+
+    uint32_t elapsed = now - fps_window_start;
+    if (elapsed >= 1000) {
+        fps = (fps_window_frames * 1000) / elapsed;
+        fps_window_start = now;
+        fps_window_frames = 0;
+    }
+}
+
+static void led_task(void* args) {
+    bool is_awake = false;
+    uint32_t seq = 0;
+    TickType_t last_wake = 0;
+    // The same deadline as `last_wake`, on the microsecond clock
+    int64_t deadline_us = 0;
+    uint32_t interval = 0;
 
     while (1) {
-        // Transitions
-        // Only do transitions if a new item has been received
-        if (display_done && xQueueReceive(led_queue, &led_item, 0) == pdPASS) {
-            // If here, then there is a new lighting effect that should take place
-            ESP_LOGI(TAG, "Got new item from queue.");
-
-            switch (led_item.type) {
-                case LED_DISPLAY_FADE_IN:
-                    strip.brightness = 0;
-                    led_strip_fill(&strip, 0, strip.length, led_item.color);
-                    led_strip_flush(&strip);
-                    break;
-                default:
-                    break;
-            }
-
-            t = 0;
-            // if (led_item.type != LED_DISPLAY_FADE_OUT)
-            //     last_color = led_item.color;
-
-            if (led_item.type == LED_DISPLAY_FADE_OUT) {
-                led_item.color = last_color;
-            } else {
-                last_color = led_item.color;
-            }
-            display_done = false;
+        // Animation time comes from the monotonic clock rather than a frame count, so
+        // effects keep their timing even when frames run late
+        int64_t now_us = led_clock_us();
+        uint32_t now = (uint32_t)(now_us / 1000);
+
+        if (!is_awake) {
+            output->resume();
+            is_awake = true;
+            fps_window_start = now;
+            fps_window_frames = 0;
+            // Frames are scheduled from here until the display goes static again
+            last_wake = xTaskGetTickCount();
+            deadline_us = now_us;
+        } else {
+            led_record_jitter(now_us, deadline_us);
         }
 
-        // Actions
-        switch (led_item.type) {
-            case LED_DISPLAY_SOLID:
-                strip.brightness = led_item.brightness;
-                led_strip_fill(&strip, 0, strip.length, led_item.color);
-                led_strip_flush(&strip);
-                display_done = true;
-                break;
-            case LED_DISPLAY_SPIN:
-                display_done = true;
-                break;
-            case LED_DISPLAY_PULSE:
-                // brightness = (led_item.brightness / 4) * sin(t / 2pi) + led_item.brightness
-                strip.brightness = (int)((led_item.brightness / 2) * sinf(((float)t) / (2 * 3.14159)) + led_item.brightness);
-                ESP_LOGI(TAG, "Pulsing LED brightness to %i", strip.brightness);
-                led_strip_fill(&strip, 0, strip.length, led_item.color);
-                led_strip_flush(&strip);
-
-                // Set it as done after X * LED_TICKS_PER_SECOND seconds
-                display_done = (t >= 2 * LED_TICKS_PER_SECOND);
-                break;
-            case LED_DISPLAY_FADE_IN:
-                if (strip.brightness != led_item.brightness) {
-                    if (strip.brightness > led_item.brightness) {
-                        ESP_LOGI(TAG, "Fade in complete");
-                        strip.brightness = led_item.brightness;
-                    } else if (strip.brightness < led_item.brightness) {
-                        strip.brightness += LED_BRIGHTNESS_STEP;
-                    }
-                    ESP_LOGI(TAG, "Fading in brightness to %i", strip.brightness);
-                    led_strip_fill(&strip, 0, strip.length, led_item.color);
-                    led_strip_flush(&strip);
-                } else {
-                    display_done = true;
-                }
-                break;
-            case LED_DISPLAY_FADE_OUT:
-                if (strip.brightness != led_item.brightness) {
-                    if (strip.brightness < led_item.brightness) {
-                        ESP_LOGI(TAG, "Fade out complete");
-                        strip.brightness = led_item.brightness;
-                    } else if (strip.brightness > led_item.brightness) {
-                        strip.brightness -= LED_BRIGHTNESS_STEP;
-                    }
-                    ESP_LOGI(TAG, "Fading out brightness to %i", strip.brightness);
-                    led_strip_fill(&strip, 0, strip.length, last_color);
-                    led_strip_flush(&strip);
-                } else {
-                    display_done = true;
-                }
-                break;
+        led_take_commands(now);
+        interval = led_compose(now, seq++);
+        led_count_frame(now);
+
+        // Only sends anything if the frame differs from the one already showing
+        led_frame_present(output);
+
+        if (interval == 0) {
+            output->suspend();
+            is_awake = false;
+            fps = 0;
+
+            // Nothing is animating, so sleep until there is something new to show or a
+            // layer runs out. A static display costs no wakeups at all.
+            ulTaskNotifyTake(pdTRUE, led_idle_timeout(now));
+            continue;
         }
 
-        t++;
-        // Run at roughly 10Hz
-        vTaskDelay(pdMS_TO_TICKS(LED_DELAY));
+        // Frames go out on fixed deadlines, so the time spent drawing and sending one
+        // doesn't push every later frame back. If the deadline has already gone, drop
+        // the frames we are behind on and carry on from now rather than rushing them.
+        TickType_t period = pdMS_TO_TICKS(interval);
+        if (period == 0) period = 1;  // xTaskDelayUntil asserts on a zero increment
+        deadline_us += (int64_t)period * portTICK_PERIOD_MS * 1000;
+        if (xTaskDelayUntil(&last_wake, period) == pdFALSE) {
+            missed++;
+            last_wake = xTaskGetTickCount();
+            deadline_us = led_clock_us();
+        }
     }
 }
 
-esp_err_t led_init() {
+static esp_err_t led_post(const led_cmd_t* cmd) {
+    if (cmd->layer >= LED_LAYER_MAX) return ESP_ERR_INVALID_ARG;
+    if (led_task_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    portENTER_CRITICAL_SAFE(&mailbox_lock);
+    led_mailbox_put(cmd);
+    portEXIT_CRITICAL_SAFE(&mailbox_lock);
+
+    xTaskNotifyGive(led_task_handle);
+    return ESP_OK;
+}
+
+static esp_err_t led_post_ISR(const led_cmd_t* cmd) {
+    if (cmd->layer >= LED_LAYER_MAX) return ESP_ERR_INVALID_ARG;
+    if (led_task_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    portENTER_CRITICAL_SAFE(&mailbox_lock);
+    led_mailbox_put(cmd);
+    portEXIT_CRITICAL_SAFE(&mailbox_lock);
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(led_task_handle, &higher_priority_task_woken);
+    if (higher_priority_task_woken) portYIELD_FROM_ISR();
+
+    return ESP_OK;
+}
+
+void led_config_default(led_config_t* config) {
+    memset(config, 0, sizeof(*config));
+    config->strip_count = 1;
+    config->strips[0].gpio = CONFIG_LED_MANAGER_STRIP_GPIO;
+    config->strips[0].length = CONFIG_LED_MANAGER_STRIP_LENGTH;
+}
+
+esp_err_t led_init(const led_config_t* config) {
     ESP_LOGI(TAG, "Initializing LED Manager");
-    led_strip_install();
 
-    led_strip_init(&strip);
+    led_config_t default_config;
+    if (config == NULL) {
+        led_config_default(&default_config);
+        config = &default_config;
+    }
+
+    if (config->strip_count == 0 || config->strip_count > LED_MAX_STRIPS) return ESP_ERR_INVALID_ARG;
+    for (int i=0; i<config->strip_count; i++) {
+        if (config->strips[i].length == 0) return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = led_frame_init(config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error allocating framebuffers. Error: %s", esp_err_to_name(err));
+        return err;
+    }
 
-    led_queue = xQueueCreate(5, sizeof(led_item_t));
+    err = output->init(config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error initializing %s output. Error: %s", output->name, esp_err_to_name(err));
+        return err;
+    }
 
-    xTaskCreate(led_task, "LED Manager", configMINIMAL_STACK_SIZE + 2048, NULL, tskIDLE_PRIORITY + 5, NULL);
+    if (xTaskCreate(led_task, "LED Manager", configMINIMAL_STACK_SIZE + 2048, NULL, tskIDLE_PRIORITY + 5, &led_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Error creating LED task");
+        return ESP_ERR_NO_MEM;
+    }
 
     ESP_LOGI(TAG, "Finished initializing LED Manager");
 
     return ESP_OK;
 }
 
+esp_err_t led_layer_set(led_layer_t layer, const led_item_t* item) {
+    if (item == NULL) return ESP_ERR_INVALID_ARG;
+
+    led_cmd_t cmd = { .layer = layer, .item = *item };
+    return led_post(&cmd);
+}
+
+esp_err_t led_layer_clear(led_layer_t layer) {
+    led_cmd_t cmd = { .layer = layer, .is_clear = true };
+    return led_post(&cmd);
+}
+
 esp_err_t led_set_color(rgb_t color) {
     led_item_t led_item = {
         .type = LED_DISPLAY_SOLID,
         .color = color,
         .brightness = LED_DEFAULT_BRIGHTNESS
     };
-    
-    xQueueSend(led_queue, &led_item, portMAX_DELAY);
 
-    return ESP_OK;
+    return led_layer_set(LED_LAYER_BASE, &led_item);
 }
 
 esp_err_t led_set_pulse(rgb_t color) {
@@ -159,9 +432,38 @@ esp_err_t led_set_pulse(rgb_t color) {
         .brightness = LED_DEFAULT_BRIGHTNESS
     };
 
-    xQueueSend(led_queue, &led_item, portMAX_DELAY);
+    return led_layer_set(LED_LAYER_BASE, &led_item);
+}
 
-    return ESP_OK;
+esp_err_t led_set_spin(rgb_t color) {
+    led_item_t led_item = {
+        .type = LED_DISPLAY_SPIN,
+        .color = color,
+        .brightness = LED_DEFAULT_BRIGHTNESS
+    };
+
+    return led_layer_set(LED_LAYER_BASE, &led_item);
+}
+
+esp_err_t led_set_chase(rgb_t color) {
+    led_item_t led_item = {
+        .type = LED_DISPLAY_CHASE,
+        .color = color,
+        .brightness = LED_DEFAULT_BRIGHTNESS
+    };
+
+    return led_layer_set(LED_LAYER_BASE, &led_item);
+}
+
+esp_err_t led_set_progress(rgb_t color, uint8_t progress) {
+    led_item_t led_item = {
+        .type = LED_DISPLAY_PROGRESS,
+        .color = color,
+        .brightness = LED_DEFAULT_BRIGHTNESS,
+        .progress = progress
+    };
+
+    return led_layer_set(LED_LAYER_BASE, &led_item);
 }
 
 esp_err_t led_set_off() {
@@ -171,33 +473,43 @@ esp_err_t led_set_off() {
         .brightness = 0
     };
 
-    xQueueSend(led_queue, &led_item, portMAX_DELAY);
-
-    return ESP_OK;
+    return led_layer_set(LED_LAYER_BASE, &led_item);
 }
 
-esp_err_t led_fade_in(rgb_t color) {
+esp_err_t led_set_animation(const char* name) {
     led_item_t led_item = {
-        .type = LED_DISPLAY_FADE_IN,
-        .color = color,
+        .type = LED_DISPLAY_ANIMATION,
+        .color = COLOR_OFF,
         .brightness = LED_DEFAULT_BRIGHTNESS
     };
 
-    xQueueSend(led_queue, &led_item, portMAX_DELAY);
+    esp_err_t err = led_anim_find(name, &led_item.animation);
+    if (err != ESP_OK) return err;
 
-    return ESP_OK;
+    return led_layer_set(LED_LAYER_BASE, &led_item);
 }
 
-esp_err_t led_fade_in_ISR(rgb_t color) {
+esp_err_t led_fade_in(rgb_t color) {
     led_item_t led_item = {
         .type = LED_DISPLAY_FADE_IN,
         .color = color,
         .brightness = LED_DEFAULT_BRIGHTNESS
     };
 
-    xQueueSendFromISR(led_queue, &led_item, NULL);
+    return led_layer_set(LED_LAYER_BASE, &led_item);
+}
+
+esp_err_t led_fade_in_ISR(rgb_t color) {
+    led_cmd_t cmd = {
+        .layer = LED_LAYER_BASE,
+        .item = {
+            .type = LED_DISPLAY_FADE_IN,
+            .color = color,
+            .brightness = LED_DEFAULT_BRIGHTNESS
+        }
+    };
 
-    return ESP_OK;
+    return led_post_ISR(&cmd);
 }
 
 esp_err_t led_fade_out(void) {
@@ -207,19 +519,34 @@ esp_err_t led_fade_out(void) {
         .brightness = 0
     };
 
-    xQueueSend(led_queue, &led_item, portMAX_DELAY);
-
-    return ESP_OK;
+    return led_layer_set(LED_LAYER_BASE, &led_item);
 }
 
 esp_err_t led_fade_out_ISR(void) {
-    led_item_t led_item = {
-        .type = LED_DISPLAY_FADE_OUT,
-        .color = { { 0 } },
-        .brightness = 0
+    led_cmd_t cmd = {
+        .layer = LED_LAYER_BASE,
+        .item = {
+            .type = LED_DISPLAY_FADE_OUT,
+            .color = { { 0 } },
+            .brightness = 0
+        }
     };
 
-    xQueueSendFromISR(led_queue, &led_item, NULL);
+    return led_post_ISR(&cmd);
+}
+
+esp_err_t led_get_stats(led_stats_t* out) {
+    if (out == NULL) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL_SAFE(&mailbox_lock);
+    *out = stats;
+    portEXIT_CRITICAL_SAFE(&mailbox_lock);
+
+    // Only the LED task writes these, a copy taken mid-update can be off by one frame
+    out->fps = fps;
+    out->frames = frames;
+    out->missed = missed;
+    memcpy(out->jitter, jitter, sizeof(jitter));
 
     return ESP_OK;
 }
@@ -0,0 +1,36 @@
+#ifndef LED_OUTPUT_H
+#define LED_OUTPUT_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <rgb.h>
+#include <sdkconfig.h>
+
+#include "led_manager.h"
+
+// Where finished frames go. On the ESP32 that's the ring through RMT, on the linux
+// target frames are recorded to a file instead, so the engine's timing and output can
+// be checked without any hardware. Only used from the LED task.
+
+typedef struct {
+    const char* name;
+    esp_err_t (*init)(const led_config_t* config);
+
+    /**
+     * @brief Starts sending pixels [start, start + count) of a frame to `strip`. May
+     * return before they are out, but `pixels` can be reused as soon as it does.
+     */
+    esp_err_t (*send)(uint8_t strip, const rgb_t* pixels, uint16_t start, uint16_t count);
+
+    // Called before the first frame after being idle, and once the engine goes idle
+    void (*resume)(void);
+    void (*suspend)(void);
+} led_output_t;
+
+#if CONFIG_IDF_TARGET_LINUX
+extern const led_output_t led_output_record;
+#else
+extern const led_output_t led_output_strip;
+#endif
+
+#endif
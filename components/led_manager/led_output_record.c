@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <sdkconfig.h>
+
+#include "led_output.h"
+#include "led_clock.h"
+
+static const char *TAG = "LED Record";
+
+static FILE* record_file = NULL;
+static int64_t record_start_us;
+
+// Every strip as last sent, so every recorded line is a complete strip
+static rgb_t* shown = NULL;
+static uint8_t strip_count = 0;
+static uint16_t strip_length[LED_MAX_STRIPS];
+static uint32_t strip_offset[LED_MAX_STRIPS];
+
+static esp_err_t record_init(const led_config_t* config) {
+    uint32_t total = 0;
+    for (int i=0; i<config->strip_count; i++) {
+        strip_offset[i] = total;
+        strip_length[i] = config->strips[i].length;
+        total += config->strips[i].length;
+    }
+
+    shown = calloc(total, sizeof(rgb_t));
+    if (shown == NULL) return ESP_ERR_NO_MEM;
+    strip_count = config->strip_count;
+
+    record_file = fopen(CONFIG_LED_MANAGER_RECORD_PATH, "w");
+    if (record_file == NULL) {
+        ESP_LOGE(TAG, "Error opening `%s`", CONFIG_LED_MANAGER_RECORD_PATH);
+        return ESP_FAIL;
+    }
+
+    record_start_us = led_clock_us();
+    fprintf(record_file, "# time_us strip, then the strip's pixels as rrggbb\n");
+
+    return ESP_OK;
+}
+
+static esp_err_t record_send(uint8_t strip, const rgb_t* pixels, uint16_t start, uint16_t count) {
+    if (record_file == NULL) return ESP_ERR_INVALID_STATE;
+    if (strip >= strip_count) return ESP_ERR_INVALID_ARG;
+
+    rgb_t* strip_pixels = shown + strip_offset[strip];
+    memcpy(&strip_pixels[start], pixels, count * sizeof(rgb_t));
+
+    fprintf(record_file, "%lld %u", (long long)(led_clock_us() - record_start_us), strip);
+    for (int i=0; i<strip_length[strip]; i++) {
+        fprintf(record_file, " %02x%02x%02x", strip_pixels[i].r, strip_pixels[i].g, strip_pixels[i].b);
+    }
+    fputc('\n', record_file);
+
+    return ESP_OK;
+}
+
+static void record_resume(void) {
+}
+
+static void record_suspend(void) {
+    // Nothing else gets sent until something changes, so this is a good time to write out
+    if (record_file != NULL) fflush(record_file);
+}
+
+const led_output_t led_output_record = {
+    .name = "record",
+    .init = record_init,
+    .send = record_send,
+    .resume = record_resume,
+    .suspend = record_suspend,
+};
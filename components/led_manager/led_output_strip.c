@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <led_strip.h>
+#include <freertos/FreeRTOS.h>
+#include <power_manager.h>
+
+#include "led_output.h"
+
+static const char *TAG = "LED Strip";
+
+// Longest a frame can take to go out, a 60 LED frame takes about 2ms
+#define LED_STRIP_TIMEOUT_MS 100
+
+// One per configured strip, each on its own RMT channel
+static led_strip_t* strips = NULL;
+static uint8_t strip_count = 0;
+
+static esp_err_t strip_init(const led_config_t* config) {
+    if (config->strip_count > RMT_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+
+    strips = calloc(config->strip_count, sizeof(led_strip_t));
+    if (strips == NULL) return ESP_ERR_NO_MEM;
+
+    led_strip_install();
+
+    for (int i=0; i<config->strip_count; i++) {
+        strips[i].type = LED_STRIP_WS2812;
+        strips[i].length = config->strips[i].length;
+        strips[i].gpio = config->strips[i].gpio;
+        strips[i].channel = (rmt_channel_t)i;
+        strips[i].buf = NULL;
+        // Brightness is applied by `led_pixel`, the driver passes pixels through untouched
+        strips[i].brightness = 255;
+
+        esp_err_t err = led_strip_init(&strips[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error initializing strip %d on GPIO %d. Error: %s", i, config->strips[i].gpio, esp_err_to_name(err));
+            return err;
+        }
+        strip_count = i + 1;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t strip_send(uint8_t strip, const rgb_t* pixels, uint16_t start, uint16_t count) {
+    if (strip >= strip_count) return ESP_ERR_INVALID_ARG;
+
+    // RMT reads the driver's buffer while it sends, so the last frame has to be out
+    // before it's touched. Since the flush below doesn't wait, the next frame is drawn
+    // while this one is still going out.
+    esp_err_t err = led_strip_wait(&strips[strip], pdMS_TO_TICKS(LED_STRIP_TIMEOUT_MS));
+    if (err == ESP_OK) err = led_strip_set_pixels(&strips[strip], start, count, (rgb_t*)pixels);
+    if (err == ESP_OK) err = led_strip_flush(&strips[strip]);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error sending strip %u pixels %u-%u. Error: %s", strip, start, start + count, esp_err_to_name(err));
+    }
+
+    return err;
+}
+
+static void strip_resume(void) {
+    power_note_wakeup(POWER_CLIENT_LED);
+    power_acquire(POWER_CLIENT_LED);
+}
+
+static void strip_suspend(void) {
+    // Let the last frame finish going out before APB is allowed to drop
+    for (int i=0; i<strip_count; i++) {
+        led_strip_wait(&strips[i], pdMS_TO_TICKS(LED_STRIP_TIMEOUT_MS));
+    }
+    power_release(POWER_CLIENT_LED);
+}
+
+const led_output_t led_output_strip = {
+    .name = "strip",
+    .init = strip_init,
+    .send = strip_send,
+    .resume = strip_resume,
+    .suspend = strip_suspend,
+};
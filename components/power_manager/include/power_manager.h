@@ -0,0 +1,17 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <esp_err.h>
+
+#include "power_stats.h"
+
+esp_err_t power_init(void);
+esp_err_t power_acquire(power_client_t client);
+esp_err_t power_release(power_client_t client);
+void power_publish_deadline(int64_t deadline);
+void power_note_wakeup(power_client_t client);
+esp_err_t power_get_stats(power_stats_t* stats);
+const char* power_state_name(power_state_t state);
+const char* power_client_name(power_client_t client);
+
+#endif
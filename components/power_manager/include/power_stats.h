@@ -0,0 +1,52 @@
+#ifndef POWER_STATS_H
+#define POWER_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Plain C accounting for the power manager. Nothing here touches ESP-IDF, time comes
+// from the clock passed to `power_stats_init`, so it can be driven by a virtual clock.
+
+typedef enum {
+    POWER_CLIENT_TASKS,
+    POWER_CLIENT_LED,
+    POWER_CLIENT_HTTP,
+    POWER_CLIENT_MAX
+} power_client_t;
+
+typedef enum {
+    POWER_STATE_ACTIVE,       // At least one client holds a lock
+    POWER_STATE_IDLE,         // No locks, but awake
+    POWER_STATE_LIGHT_SLEEP,  // Actually in light sleep, as reported by `power_stats_slept`
+    POWER_STATE_MAX
+} power_state_t;
+
+typedef struct {
+    int64_t residency_us[POWER_STATE_MAX];
+    uint32_t wakeups[POWER_CLIENT_MAX];
+    uint32_t acquires[POWER_CLIENT_MAX];
+    uint32_t sleeps;
+    power_state_t state;
+    int64_t next_deadline;
+} power_stats_t;
+
+typedef int64_t (*power_clock_t)(void);
+
+typedef struct {
+    power_clock_t clock;
+    int64_t last_change;
+    uint16_t locks[POWER_CLIENT_MAX];
+    power_stats_t stats;
+} power_accounting_t;
+
+#define POWER_NO_DEADLINE INT64_MAX
+
+void power_stats_init(power_accounting_t* acct, power_clock_t clock);
+void power_stats_acquire(power_accounting_t* acct, power_client_t client);
+void power_stats_release(power_accounting_t* acct, power_client_t client);
+void power_stats_deadline(power_accounting_t* acct, int64_t deadline);
+void power_stats_wakeup(power_accounting_t* acct, power_client_t client);
+void power_stats_slept(power_accounting_t* acct, int64_t slept_us);
+void power_stats_get(power_accounting_t* acct, power_stats_t* stats);
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <sdkconfig.h>
+
+#include "power_manager.h"
+
+static const char* TAG = "Power Manager";
+
+static power_accounting_t accounting;
+static portMUX_TYPE accounting_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t locks[POWER_CLIENT_MAX];
+
+// The LED strip is driven by the RMT peripheral, which is clocked from APB, so it has
+// to keep APB (and with it, no light sleep) for as long as a frame can be in flight.
+static const esp_pm_lock_type_t lock_types[POWER_CLIENT_MAX] = {
+    [POWER_CLIENT_TASKS] = ESP_PM_CPU_FREQ_MAX,
+    [POWER_CLIENT_LED] = ESP_PM_APB_FREQ_MAX,
+    [POWER_CLIENT_HTTP] = ESP_PM_CPU_FREQ_MAX,
+};
+
+#endif
+
+static const char* client_names[POWER_CLIENT_MAX] = {
+    [POWER_CLIENT_TASKS] = "tasks",
+    [POWER_CLIENT_LED] = "led",
+    [POWER_CLIENT_HTTP] = "http",
+};
+
+static const char* state_names[POWER_STATE_MAX] = {
+    [POWER_STATE_ACTIVE] = "active",
+    [POWER_STATE_IDLE] = "idle",
+    [POWER_STATE_LIGHT_SLEEP] = "light_sleep",
+};
+
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Called by the idle task right after light sleep ends, with the time it actually slept.
+// CONFIG_PM_SLP_IRAM_OPT is off, so the sleep path runs from flash and this can too.
+static esp_err_t power_sleep_exit_cb(int64_t slept_us, void* arg) {
+    portENTER_CRITICAL_SAFE(&accounting_lock);
+    power_stats_slept(&accounting, slept_us);
+    portEXIT_CRITICAL_SAFE(&accounting_lock);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t power_init(void) {
+    power_stats_init(&accounting, esp_timer_get_time);
+
+#ifdef CONFIG_PM_ENABLE
+    esp_err_t err;
+
+    esp_pm_config_esp32_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_POWER_MIN_CPU_FREQ_MHZ,
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#else
+        .light_sleep_enable = false,
+#endif
+    };
+
+    err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_pm_configure`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int i=0; i<POWER_CLIENT_MAX; i++) {
+        err = esp_pm_lock_create(lock_types[i], 0, client_names[i], &locks[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error creating `%s` power lock. Error: %s", client_names[i], esp_err_to_name(err));
+            return err;
+        }
+    }
+
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t sleep_cbs = {
+        .exit_cb = power_sleep_exit_cb,
+    };
+    err = esp_pm_light_sleep_register_cbs(&sleep_cbs);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_pm_light_sleep_register_cbs`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_LIGHT_SLEEP_CALLBACKS is not set, light sleep residency isn't measured");
+#endif
+
+    ESP_LOGI(TAG, "Power management enabled, %i-%i MHz, light sleep %s", pm_config.min_freq_mhz,
+             pm_config.max_freq_mhz, pm_config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_ENABLE is not set, only accounting power states");
+#endif
+
+    return ESP_OK;
+}
+
+esp_err_t power_acquire(power_client_t client) {
+    if (client >= POWER_CLIENT_MAX) return ESP_ERR_INVALID_ARG;
+
+#ifdef CONFIG_PM_ENABLE
+    esp_err_t err = esp_pm_lock_acquire(locks[client]);
+    if (err != ESP_OK) return err;
+#endif
+
+    portENTER_CRITICAL_SAFE(&accounting_lock);
+    power_stats_acquire(&accounting, client);
+    portEXIT_CRITICAL_SAFE(&accounting_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t power_release(power_client_t client) {
+    if (client >= POWER_CLIENT_MAX) return ESP_ERR_INVALID_ARG;
+
+#ifdef CONFIG_PM_ENABLE
+    esp_err_t err = esp_pm_lock_release(locks[client]);
+    if (err != ESP_OK) return err;
+#endif
+
+    portENTER_CRITICAL_SAFE(&accounting_lock);
+    power_stats_release(&accounting, client);
+    portEXIT_CRITICAL_SAFE(&accounting_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Called by the task dispatcher before it blocks, with the esp_timer time of the
+ * next thing it has to do. Tickless idle sleeps until then on its own, this is only kept
+ * so the stats show what the next wakeup is.
+ */
+void power_publish_deadline(int64_t deadline) {
+    portENTER_CRITICAL_SAFE(&accounting_lock);
+    power_stats_deadline(&accounting, deadline);
+    portEXIT_CRITICAL_SAFE(&accounting_lock);
+}
+
+void power_note_wakeup(power_client_t client) {
+    if (client >= POWER_CLIENT_MAX) return;
+
+    portENTER_CRITICAL_SAFE(&accounting_lock);
+    power_stats_wakeup(&accounting, client);
+    portEXIT_CRITICAL_SAFE(&accounting_lock);
+}
+
+esp_err_t power_get_stats(power_stats_t* stats) {
+    if (stats == NULL) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL_SAFE(&accounting_lock);
+    power_stats_get(&accounting, stats);
+    portEXIT_CRITICAL_SAFE(&accounting_lock);
+
+    return ESP_OK;
+}
+
+const char* power_state_name(power_state_t state) {
+    return (state < POWER_STATE_MAX) ? state_names[state] : "unknown";
+}
+
+const char* power_client_name(power_client_t client) {
+    return (client < POWER_CLIENT_MAX) ? client_names[client] : "unknown";
+}
@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "power_stats.h"
+
+static power_state_t power_stats_eval(const power_accounting_t* acct) {
+    for (int i=0; i<POWER_CLIENT_MAX; i++) {
+        if (acct->locks[i] > 0) return POWER_STATE_ACTIVE;
+    }
+
+    // Light sleep is never entered as a state, slept time is moved over once it's over
+    return POWER_STATE_IDLE;
+}
+
+/**
+ * @brief Charges the time since the last change to the state we were in, then moves to
+ * whatever state the current locks and deadline allow.
+ */
+static void power_stats_update(power_accounting_t* acct) {
+    int64_t now = acct->clock();
+
+    acct->stats.residency_us[acct->stats.state] += now - acct->last_change;
+    acct->last_change = now;
+    acct->stats.state = power_stats_eval(acct);
+}
+
+void power_stats_init(power_accounting_t* acct, power_clock_t clock) {
+    memset(acct, 0, sizeof(*acct));
+    acct->clock = clock;
+    acct->last_change = clock();
+    acct->stats.next_deadline = POWER_NO_DEADLINE;
+    acct->stats.state = POWER_STATE_IDLE;
+}
+
+void power_stats_acquire(power_accounting_t* acct, power_client_t client) {
+    acct->locks[client]++;
+    acct->stats.acquires[client]++;
+    power_stats_update(acct);
+}
+
+void power_stats_release(power_accounting_t* acct, power_client_t client) {
+    if (acct->locks[client] > 0) acct->locks[client]--;
+    power_stats_update(acct);
+}
+
+void power_stats_deadline(power_accounting_t* acct, int64_t deadline) {
+    acct->stats.next_deadline = deadline;
+    power_stats_update(acct);
+}
+
+void power_stats_wakeup(power_accounting_t* acct, power_client_t client) {
+    acct->stats.wakeups[client]++;
+    power_stats_update(acct);
+}
+
+/**
+ * @brief Called once light sleep has ended with how long it lasted. Nothing can change
+ * state while the chip sleeps, so the whole sleep was charged to the current state
+ * since the last change, and is moved from there to light sleep.
+ */
+void power_stats_slept(power_accounting_t* acct, int64_t slept_us) {
+    power_stats_update(acct);
+
+    int64_t* awake_us = &acct->stats.residency_us[acct->stats.state];
+    if (slept_us > *awake_us) slept_us = *awake_us;
+    *awake_us -= slept_us;
+    acct->stats.residency_us[POWER_STATE_LIGHT_SLEEP] += slept_us;
+    acct->stats.sleeps++;
+}
+
+void power_stats_get(power_accounting_t* acct, power_stats_t* stats) {
+    power_stats_update(acct);
+    *stats = acct->stats;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <esp_log.h>
+#include <nvs_flash.h>
+#include <esp_http_server.h>
+#include <task_manager.h>
+#include <task_api.h>
+#include <task_sim.h>
+
+#define SIM_EPOCH 1700000000
+#define US_PER_MIN (60LL * 1000 * 1000)
+
+// Replaces glibc's allocator for the whole program, so allocations made inside libc
+// on the handlers' behalf, like strdup's, are counted as well
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+static bool is_counting = false;
+static int allocs = 0;
+
+void* malloc(size_t size) {
+    if (is_counting) allocs++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (is_counting) allocs++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (is_counting) allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+static fake_httpd_resp_t resp;
+static int64_t sim_now = 0;
+static bool was_counting = false;
+
+// The dispatcher isn't the handler's to answer for, so counting pauses while it runs.
+// That includes the runs a GET's snapshot waits on in the middle of the handler.
+static void api_dispatch_begin(void) {
+    was_counting = is_counting;
+    is_counting = false;
+}
+
+static void api_dispatch_end(int64_t deadline) {
+    is_counting = was_counting;
+}
+
+/**
+ * @brief Runs one request and fails the test if its handler allocated anything.
+ */
+static void api_request(httpd_method_t method, const char* uri, const char* header, const char* body,
+                        const char* status) {
+    allocs = 0;
+    is_counting = true;
+    esp_err_t err = fake_httpd_request(method, uri, header, body, &resp);
+    is_counting = false;
+
+    TEST_ESP_OK(err);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(status, resp.status, uri);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocs, uri);
+
+    sim_now += US_PER_MIN;
+    task_sim_run_until(sim_now);
+}
+
+static task_handle_t api_response_id(void) {
+    unsigned id;
+    TEST_ASSERT_EQUAL(1, sscanf(resp.body, "{\"id\":%u}", &id));
+    return id;
+}
+
+static void api_start_empty(void) {
+    TEST_ESP_OK(nvs_flash_erase());
+    TEST_ESP_OK(nvs_flash_init());
+
+    sim_now = 0;
+    task_sim_set_clock(sim_now, SIM_EPOCH);
+    TEST_ESP_OK(task_init());
+
+    fake_httpd_reset();
+    TEST_ESP_OK(task_api_register(NULL));
+}
+
+static void test_handlers_do_not_allocate(void) {
+    api_start_empty();
+    char uri[32];
+
+    api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":\"repeating\",\"mode\":\"every\",\"interval_min\":5}", "200 OK");
+    task_handle_t every = api_response_id();
+    api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":\"pomodoro\",\"rounds\":4,\"enabled\":false}", "200 OK");
+    task_handle_t pomodoro = api_response_id();
+
+    api_request(HTTP_GET, "/api/tasks", NULL, NULL, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"repeating\""));
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"pomodoro\""));
+
+    char etag[64];
+    TEST_ASSERT_NOT_NULL(fake_httpd_resp_header(&resp, "ETag"));
+    snprintf(etag, sizeof(etag), "If-None-Match: %s", fake_httpd_resp_header(&resp, "ETag"));
+    api_request(HTTP_GET, "/api/tasks", etag, NULL, "304 Not Modified");
+
+    snprintf(uri, sizeof(uri), "/api/tasks/%u", (unsigned)every);
+    api_request(HTTP_PUT, uri, NULL, "{\"type\":\"repeating\",\"mode\":\"daily\",\"hour\":7,\"minute\":30}", "200 OK");
+    api_request(HTTP_PUT, uri, NULL, "{\"enabled\":false}", "200 OK");
+    api_request(HTTP_PUT, uri, NULL, "{\"type\":\"repeating\",\"mode\":\"every\",\"interval_min\":1,\"enabled\":false}",
+                "200 OK");
+
+    char batch[160];
+    snprintf(batch, sizeof(batch),
+             "{\"ops\":[{\"op\":\"create\",\"task\":{\"type\":\"one_time\",\"in\":60}},"
+             "{\"op\":\"update\",\"id\":%u,\"task\":{\"enabled\":true}},{\"op\":\"delete\",\"id\":%u}]}",
+             (unsigned)pomodoro, (unsigned)pomodoro);
+    api_request(HTTP_POST, "/api/tasks/batch", NULL, batch, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"ok\":true"));
+
+    api_request(HTTP_DELETE, uri, NULL, NULL, "200 OK");
+}
+
+static void test_errors_do_not_allocate(void) {
+    api_start_empty();
+
+    api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":", "400 Bad Request");
+    api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":\"repeating\",\"interval_min\":1.}", "400 Bad Request");
+    api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":\"repeating\",\"interval_min\":-5}", "400 Bad Request");
+    api_request(HTTP_PUT, "/api/tasks/999", NULL, "{\"enabled\":true}", "404 Not Found");
+    api_request(HTTP_DELETE, "/api/tasks/-1", NULL, NULL, "404 Not Found");
+    api_request(HTTP_POST, "/api/tasks/batch", NULL, "{\"ops\":{}}", "400 Bad Request");
+
+    for (int i=0; i<CONFIG_TASK_MANAGER_MAX_POMODOROS; i++) {
+        api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":\"pomodoro\"}", "200 OK");
+    }
+    api_request(HTTP_POST, "/api/tasks", NULL, "{\"type\":\"pomodoro\"}", "409 Conflict");
+}
+
+static void test_list_spans_chunks(void) {
+    api_start_empty();
+
+    // More tasks than the handler copies out at a time
+    for (int i=0; i<40; i++) {
+        task_config_t config = TASK_REPEATING_EVERY_CONFIG(i + 1);
+        TEST_ESP_OK(task_add(&config, NULL));
+        if (i % 16 == 15) task_sim_run_until(sim_now);
+    }
+    task_sim_run_until(sim_now);
+
+    api_request(HTTP_GET, "/api/tasks", NULL, NULL, "200 OK");
+    TEST_ASSERT_FALSE(resp.is_truncated);
+    int listed = 0;
+    for (const char* at = resp.body; (at = strstr(at, "\"id\":")) != NULL; at++) listed++;
+    TEST_ASSERT_EQUAL(40, listed);
+    TEST_ASSERT_EQUAL_STRING("}]}", resp.body + resp.length - 3);
+}
+
+void app_main(void) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    task_sim_set_wait_hooks(api_dispatch_end, api_dispatch_begin);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_handlers_do_not_allocate);
+    RUN_TEST(test_errors_do_not_allocate);
+    RUN_TEST(test_list_spans_chunks);
+    exit(UNITY_END());
+}
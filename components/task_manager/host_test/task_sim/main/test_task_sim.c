@@ -0,0 +1,787 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unity.h>
+#include <esp_log.h>
+#include <nvs_flash.h>
+#include <task_manager.h>
+#include <task_sim.h>
+#include <power_stats.h>
+
+#define US_PER_SEC (1000LL * 1000)
+#define US_PER_MIN (60 * US_PER_SEC)
+#define SIM_EPOCH 1700000000
+#define SIM_MINUTES 120
+
+// The command ring only holds 32 commands and nothing drains it until the
+// virtual clock runs, so long runs of adds and cancels stop to let it catch up
+#define SIM_DRAIN_EVERY 16
+#define RESTORE_RUNS 10
+
+static const uint16_t sim_sizes[] = { 10, 100, 1000, 10000 };
+static const uint16_t restore_sizes[] = { 32, 256 };
+static task_handle_t handles[MAX_TASKS];
+static task_info_t snapshot[MAX_TASKS];
+static int64_t sim_now = 0;
+
+static void sim_drain(void) {
+    task_sim_run_until(sim_now);
+}
+
+static void sim_start_empty(void) {
+    // Every run starts from an empty table and the same point in time
+    TEST_ESP_OK(nvs_flash_erase());
+    TEST_ESP_OK(nvs_flash_init());
+
+    sim_now = 0;
+    task_sim_set_clock(sim_now, SIM_EPOCH);
+    TEST_ESP_OK(task_init());
+}
+
+static void sim_add_interval_tasks(uint16_t count) {
+    task_batch_begin();
+    for (uint16_t i=0; i<count; i++) {
+        // Spread the tasks over every interval from 1 to 60 minutes
+        task_config_t config = TASK_REPEATING_EVERY_CONFIG(i % 60 + 1);
+        TEST_ESP_OK(task_add(&config, &handles[i]));
+        if (i % SIM_DRAIN_EVERY == SIM_DRAIN_EVERY - 1) sim_drain();
+    }
+    TEST_ESP_OK(task_batch_end());
+    sim_drain();
+}
+
+static void sim_cancel_tasks(uint16_t count) {
+    task_batch_begin();
+    for (uint16_t i=0; i<count; i++) {
+        TEST_ESP_OK(task_cancel(handles[i]));
+        if (i % SIM_DRAIN_EVERY == SIM_DRAIN_EVERY - 1) sim_drain();
+    }
+    TEST_ESP_OK(task_batch_end());
+    sim_drain();
+}
+
+static uint64_t sim_op_mean(const task_op_stats_t* op) {
+    return op->count ? op->total_cycles / op->count : 0;
+}
+
+/**
+ * @brief Adds `count` interval tasks, runs them for two simulated hours and cancels them
+ * again, then prints how the scheduler did. Host nanoseconds stand in for CPU cycles.
+ */
+static void sim_run_interval_tasks(uint16_t count) {
+    sim_start_empty();
+    sim_add_interval_tasks(count);
+
+    uint32_t expected = 0;
+    for (uint16_t i=0; i<count; i++) {
+        expected += SIM_MINUTES / (i % 60 + 1);
+    }
+
+    sim_now = SIM_MINUTES * US_PER_MIN;
+    task_sim_run_until(sim_now);
+    sim_cancel_tasks(count);
+
+    task_stats_t stats;
+    TEST_ESP_OK(task_get_stats(&stats));
+
+    printf("%5u tasks: %6u fired, %6u wakeups, fire error max %lli us mean %lli us, "
+           "insert %llu/%u ns, cancel %llu/%u ns, next-due %llu/%u ns (mean/max)\n",
+           count, (unsigned)stats.fired, (unsigned)stats.wakeups,
+           stats.fire_error_max_us, stats.fired ? stats.fire_error_total_us / stats.fired : 0,
+           sim_op_mean(&stats.insert), (unsigned)stats.insert.max_cycles,
+           sim_op_mean(&stats.cancel), (unsigned)stats.cancel.max_cycles,
+           sim_op_mean(&stats.next_due), (unsigned)stats.next_due.max_cycles);
+
+    TEST_ASSERT_EQUAL_UINT32(expected, stats.fired);
+    TEST_ASSERT_EQUAL_UINT32(count, stats.insert.count);
+    TEST_ASSERT_EQUAL_UINT32(count, stats.cancel.count);
+    // The virtual clock lands on every deadline exactly
+    TEST_ASSERT_EQUAL_INT64(0, stats.fire_error_max_us);
+}
+
+static void test_scheduler_scaling(void) {
+    for (int i=0; i<sizeof(sim_sizes) / sizeof(sim_sizes[0]) && sim_sizes[i] <= MAX_TASKS; i++) {
+        sim_run_interval_tasks(sim_sizes[i]);
+    }
+}
+
+static int64_t host_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Saves a table of `count` tasks, then times `task_init` loading it back the
+ * same way it does at boot. This is host time, flash reads on the device come on top.
+ */
+static void sim_restore_tasks(uint16_t count) {
+    sim_start_empty();
+    sim_add_interval_tasks(count);
+
+    // The first boot runs with cold caches, so take the best of a few
+    int64_t best = INT64_MAX;
+    int64_t total = 0;
+    for (int i=0; i<RESTORE_RUNS; i++) {
+        int64_t start = host_now_us();
+        TEST_ESP_OK(task_init());
+        int64_t elapsed = host_now_us() - start;
+        total += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+
+    printf("%5u tasks: restored in %lli us best, %lli us mean\n", count, best, total / RESTORE_RUNS);
+
+    uint16_t restored;
+    TEST_ESP_OK(task_snapshot(snapshot, MAX_TASKS, NULL, &restored));
+    TEST_ASSERT_EQUAL_UINT16(count, restored);
+    for (uint16_t i=0; i<restored; i++) {
+        TEST_ASSERT_EQUAL_UINT32(handles[i], snapshot[i].handle);
+        TEST_ASSERT_TRUE(snapshot[i].is_enabled);
+    }
+
+    sim_cancel_tasks(count);
+}
+
+static void test_restore_time(void) {
+    for (int i=0; i<sizeof(restore_sizes) / sizeof(restore_sizes[0]) && restore_sizes[i] <= MAX_TASKS; i++) {
+        sim_restore_tasks(restore_sizes[i]);
+    }
+}
+
+static void test_stale_handles_are_dropped(void) {
+    sim_start_empty();
+    sim_add_interval_tasks(2);
+    sim_cancel_tasks(1);
+
+    // The cancelled slot is reused, its old handle must not reach the new task
+    task_handle_t reused;
+    task_config_t config = TASK_REPEATING_EVERY_CONFIG(5);
+    TEST_ESP_OK(task_add(&config, &reused));
+    sim_drain();
+    TEST_ASSERT_NOT_EQUAL(handles[0], reused);
+
+    TEST_ESP_OK(task_cancel(handles[0]));
+    sim_drain();
+
+    task_info_t tasks[3];
+    uint16_t count;
+    TEST_ESP_OK(task_snapshot(tasks, 3, NULL, &count));
+    TEST_ASSERT_EQUAL_UINT16(2, count);
+
+    TEST_ESP_OK(task_cancel(handles[1]));
+    TEST_ESP_OK(task_cancel(reused));
+    sim_drain();
+}
+
+static void test_stale_handles_survive_reboot(void) {
+    sim_start_empty();
+    sim_add_interval_tasks(2);
+    sim_cancel_tasks(1);
+
+    // Only the live task is stored, the cancelled slot's generation is lost on reboot
+    TEST_ESP_OK(task_init());
+    TEST_ASSERT_FALSE(task_exists(handles[0]));
+    TEST_ASSERT_TRUE(task_exists(handles[1]));
+
+    task_handle_t reused;
+    task_config_t config = TASK_REPEATING_EVERY_CONFIG(5);
+    TEST_ESP_OK(task_add(&config, &reused));
+    sim_drain();
+    TEST_ASSERT_NOT_EQUAL(handles[0], reused);
+    TEST_ASSERT_FALSE(task_exists(handles[0]));
+
+    // A handle from before the reboot is ignored rather than cancelling the new task
+    TEST_ESP_OK(task_cancel(handles[0]));
+    sim_drain();
+    TEST_ASSERT_TRUE(task_exists(reused));
+
+    TEST_ESP_OK(task_cancel(handles[1]));
+    TEST_ESP_OK(task_cancel(reused));
+    sim_drain();
+}
+
+static int paused_fires = 0;
+
+static void count_fires(const task_event_t* event, void* arg) {
+    paused_fires++;
+}
+
+static void test_paused_add_never_fires(void) {
+    sim_start_empty();
+    task_set_event_handler(count_fires, NULL);
+
+    // Already due, so it would fire on the first pass if it was ever scheduled
+    task_handle_t handle;
+    task_config_t config = TASK_ONE_TIME_AT_CONFIG(SIM_EPOCH - 60);
+    TEST_ESP_OK(task_add_paused(&config, &handle));
+    sim_now += US_PER_MIN;
+    task_sim_run_until(sim_now);
+    TEST_ASSERT_EQUAL(0, paused_fires);
+
+    uint16_t count;
+    TEST_ESP_OK(task_snapshot(snapshot, 1, NULL, &count));
+    TEST_ASSERT_EQUAL_UINT16(1, count);
+    TEST_ASSERT_FALSE(snapshot[0].is_enabled);
+    TEST_ASSERT_EQUAL(0, snapshot[0].next_fire);
+
+    TEST_ESP_OK(task_resume(handle));
+    sim_drain();
+    TEST_ASSERT_EQUAL(1, paused_fires);
+
+    task_set_event_handler(NULL, NULL);
+    TEST_ESP_OK(task_cancel(handle));
+    sim_drain();
+}
+
+#define POMODORO_MAX_EVENTS 8
+
+typedef struct {
+    int64_t at_min;
+    task_pomodoro_phase_t phase;
+    uint8_t round;
+    uint32_t duration_s;
+} pomodoro_event_t;
+
+static pomodoro_event_t pomodoro_events[POMODORO_MAX_EVENTS];
+static int pomodoro_event_count = 0;
+
+static void record_pomodoro_events(const task_event_t* event, void* arg) {
+    if (pomodoro_event_count == POMODORO_MAX_EVENTS) return;
+
+    pomodoro_event_t* recorded = &pomodoro_events[pomodoro_event_count++];
+    recorded->at_min = task_sim_now() / US_PER_MIN;
+    recorded->phase = event->phase;
+    recorded->round = event->round;
+    recorded->duration_s = event->phase_duration_s;
+}
+
+static void pomodoro_run_to(int64_t minute) {
+    sim_now = minute * US_PER_MIN;
+    sim_drain();
+}
+
+static void pomodoro_assert_event(int i, int64_t at_min, task_pomodoro_phase_t phase, uint8_t round,
+                                  uint32_t duration_s) {
+    TEST_ASSERT_TRUE(i < pomodoro_event_count);
+    TEST_ASSERT_EQUAL_INT64(at_min, pomodoro_events[i].at_min);
+    TEST_ASSERT_EQUAL(phase, pomodoro_events[i].phase);
+    TEST_ASSERT_EQUAL(round, pomodoro_events[i].round);
+    TEST_ASSERT_EQUAL_UINT32(duration_s, pomodoro_events[i].duration_s);
+}
+
+static void test_pomodoro_controls(void) {
+    sim_start_empty();
+    pomodoro_event_count = 0;
+    task_set_event_handler(record_pomodoro_events, NULL);
+
+    task_handle_t handle;
+    task_config_t config = TASK_POMODORO_DEFAULT_CONFIG();
+    config.pomodoro.rounds = 3;
+    TEST_ESP_OK(task_add(&config, &handle));
+    sim_drain();
+    pomodoro_assert_event(0, 0, TASK_POMODORO_WORK, 0, 25 * 60);
+
+    // Skipped 10 minutes in, the break starts then and the next work 5 minutes later
+    pomodoro_run_to(10);
+    TEST_ESP_OK(task_pomodoro_skip(handle));
+    sim_drain();
+    pomodoro_assert_event(1, 10, TASK_POMODORO_SHORT_BREAK, 0, 5 * 60);
+    pomodoro_run_to(15);
+    pomodoro_assert_event(2, 15, TASK_POMODORO_WORK, 1, 25 * 60);
+
+    // Three more minutes of work, then paused with three minutes of the break left
+    pomodoro_run_to(20);
+    TEST_ESP_OK(task_pomodoro_extend(handle, 3));
+    pomodoro_run_to(45);
+    pomodoro_assert_event(3, 43, TASK_POMODORO_SHORT_BREAK, 1, 5 * 60);
+    TEST_ESP_OK(task_pause(handle));
+    pomodoro_run_to(60);
+    TEST_ASSERT_EQUAL(4, pomodoro_event_count);
+
+    TEST_ESP_OK(task_resume(handle));
+    pomodoro_run_to(63);
+    pomodoro_assert_event(4, 63, TASK_POMODORO_WORK, 2, 25 * 60);
+
+    // Only the last round ends in the long break, then it starts over
+    pomodoro_run_to(103);
+    pomodoro_assert_event(5, 88, TASK_POMODORO_LONG_BREAK, 2, 15 * 60);
+    pomodoro_assert_event(6, 103, TASK_POMODORO_WORK, 0, 25 * 60);
+    TEST_ASSERT_EQUAL(7, pomodoro_event_count);
+
+    task_set_event_handler(NULL, NULL);
+    TEST_ESP_OK(task_cancel(handle));
+    sim_drain();
+}
+
+static void test_pomodoro_sessions_run_out(void) {
+    sim_start_empty();
+
+    task_handle_t pomodoros[CONFIG_TASK_MANAGER_MAX_POMODOROS];
+    task_config_t config = TASK_POMODORO_DEFAULT_CONFIG();
+    for (int i=0; i<CONFIG_TASK_MANAGER_MAX_POMODOROS; i++) {
+        // A paused one holds its session too
+        TEST_ESP_OK((i == 0) ? task_add_paused(&config, &pomodoros[i]) : task_add(&config, &pomodoros[i]));
+    }
+
+    // Turned down straight away rather than added and never started
+    task_handle_t handle;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, task_add(&config, &handle));
+    task_config_t every = TASK_REPEATING_EVERY_CONFIG(5);
+    TEST_ESP_OK(task_add(&every, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, task_update(handle, &config));
+    sim_drain();
+
+    // Updating one that already is a Pomodoro keeps its session
+    config.pomodoro.rounds = 2;
+    TEST_ESP_OK(task_update(pomodoros[1], &config));
+    sim_drain();
+
+    uint16_t count;
+    TEST_ESP_OK(task_snapshot(snapshot, MAX_TASKS, NULL, &count));
+    TEST_ASSERT_EQUAL_UINT16(CONFIG_TASK_MANAGER_MAX_POMODOROS + 1, count);
+    for (int i=0; i<count; i++) {
+        TEST_ASSERT_EQUAL(snapshot[i].handle != pomodoros[0], snapshot[i].is_enabled);
+    }
+
+    // A cancelled one frees its session for the next
+    TEST_ESP_OK(task_cancel(pomodoros[0]));
+    sim_drain();
+    TEST_ESP_OK(task_update(handle, &config));
+    sim_drain();
+    TEST_ESP_OK(task_snapshot(snapshot, MAX_TASKS, NULL, &count));
+    for (int i=0; i<count; i++) {
+        TEST_ASSERT_EQUAL(TASK_TYPE_POMODORO, snapshot[i].config.type);
+        TEST_ASSERT_TRUE(snapshot[i].is_enabled);
+    }
+}
+
+static void test_update_and_pause_together(void) {
+    sim_start_empty();
+    paused_fires = 0;
+    task_set_event_handler(count_fires, NULL);
+
+    task_handle_t handle;
+    task_config_t every = TASK_REPEATING_EVERY_CONFIG(5);
+    TEST_ESP_OK(task_add(&every, &handle));
+    sim_drain();
+
+    // Already due, a separate pause would come too late to stop it firing once
+    task_config_t due = TASK_ONE_TIME_AT_CONFIG(SIM_EPOCH - 60);
+    TEST_ESP_OK(task_update_enabled(handle, &due, false));
+    sim_now += US_PER_MIN;
+    sim_drain();
+    TEST_ASSERT_EQUAL(0, paused_fires);
+
+    uint16_t count;
+    TEST_ESP_OK(task_snapshot(snapshot, 1, NULL, &count));
+    TEST_ASSERT_FALSE(snapshot[0].is_enabled);
+    TEST_ASSERT_EQUAL(TASK_TYPE_ONE_TIME, snapshot[0].config.type);
+
+    TEST_ESP_OK(task_update_enabled(handle, &every, true));
+    sim_now += 5 * US_PER_MIN;
+    sim_drain();
+    TEST_ASSERT_EQUAL(1, paused_fires);
+
+    task_set_event_handler(NULL, NULL);
+    TEST_ESP_OK(task_cancel(handle));
+    sim_drain();
+}
+
+static void test_snapshot_in_chunks(void) {
+    sim_start_empty();
+    sim_add_interval_tasks(100);
+    // Holes in the table are skipped over
+    for (int i=0; i<100; i+=3) {
+        TEST_ESP_OK(task_cancel(handles[i]));
+        sim_drain();
+    }
+
+    uint16_t offset = 0;
+    uint16_t count;
+    uint16_t total = 0;
+    do {
+        TEST_ESP_OK(task_snapshot(&snapshot[total], 7, &offset, &count));
+        total += count;
+    } while (count == 7);
+
+    TEST_ASSERT_EQUAL_UINT16(66, total);
+    for (int i=0, t=0; i<100; i++) {
+        if (i % 3 == 0) continue;
+        TEST_ASSERT_EQUAL_UINT32(handles[i], snapshot[t++].handle);
+    }
+    sim_cancel_tasks(100);
+}
+
+#define CLOCK_MAX_FIRES 8
+#define SECS_PER_DAY (24 * 60 * 60)
+
+static task_handle_t clock_fired_handle[CLOCK_MAX_FIRES];
+static time_t clock_fired_wall[CLOCK_MAX_FIRES];
+static int clock_fires = 0;
+
+static void record_clock_fires(const task_event_t* event, void* arg) {
+    if (clock_fires < CLOCK_MAX_FIRES) {
+        clock_fired_handle[clock_fires] = event->handle;
+        clock_fired_wall[clock_fires] = task_sim_wall_time();
+    }
+    clock_fires++;
+}
+
+/**
+ * @brief Like `sim_start_empty`, but with the wall clock reading `epoch` and every fire
+ * recorded with the wall time it happened at.
+ */
+static void clock_start(time_t epoch) {
+    TEST_ESP_OK(nvs_flash_erase());
+    TEST_ESP_OK(nvs_flash_init());
+
+    sim_now = 0;
+    task_sim_set_clock(sim_now, epoch);
+    TEST_ESP_OK(task_init());
+
+    clock_fires = 0;
+    task_set_event_handler(record_clock_fires, NULL);
+}
+
+static void clock_stop(void) {
+    task_set_event_handler(NULL, NULL);
+    TEST_ESP_OK(task_set_timezone(CONFIG_TASK_MANAGER_TIMEZONE));
+    sim_drain();
+}
+
+static void test_relative_task_survives_first_sync(void) {
+    // Boots with no idea of the time, the wall clock starts at 0
+    clock_start(0);
+
+    task_handle_t handle;
+    task_config_t config = TASK_ONE_TIME_IN_CONFIG(10 * 60);
+    TEST_ESP_OK(task_add(&config, &handle));
+    sim_now += 5 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+
+    // The first sync steps the clock by 53 years, the task is still due 5 minutes on
+    task_sim_step_wall_clock(SIM_EPOCH);
+    sim_drain();
+    TEST_ASSERT_EQUAL(0, clock_fires);
+
+    uint16_t count;
+    TEST_ESP_OK(task_snapshot(snapshot, 1, NULL, &count));
+    TEST_ASSERT_EQUAL_INT64(SIM_EPOCH + 5 * 60, snapshot[0].config.one_time.at);
+    TEST_ASSERT_EQUAL_INT64(SIM_EPOCH + 5 * 60, snapshot[0].next_fire);
+
+    sim_now += 5 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+    TEST_ASSERT_EQUAL(1, clock_fires);
+    TEST_ASSERT_EQUAL_INT64(SIM_EPOCH + 5 * 60, clock_fired_wall[0]);
+
+    TEST_ESP_OK(task_cancel(handle));
+    clock_stop();
+}
+
+static void test_clock_step_moves_calendar_tasks(void) {
+    // SIM_EPOCH is 22:13:20 UTC
+    clock_start(SIM_EPOCH);
+
+    task_handle_t daily, at, every;
+    task_config_t daily_config = TASK_REPEATING_DAILY_CONFIG(23, 0);
+    task_config_t at_config = TASK_ONE_TIME_AT_CONFIG(SIM_EPOCH + 60 * 60);
+    task_config_t every_config = TASK_REPEATING_EVERY_CONFIG(40);
+    TEST_ESP_OK(task_add(&daily_config, &daily));
+    TEST_ESP_OK(task_add(&at_config, &at));
+    TEST_ESP_OK(task_add(&every_config, &every));
+    sim_drain();
+
+    // Half an hour forward, the calendar tasks come closer and the interval doesn't move
+    task_sim_step_wall_clock(SIM_EPOCH + 30 * 60);
+    sim_now += 45 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+
+    TEST_ASSERT_EQUAL(3, clock_fires);
+    TEST_ASSERT_EQUAL_UINT32(daily, clock_fired_handle[0]);
+    TEST_ASSERT_EQUAL_INT64(23 * 60 * 60, clock_fired_wall[0] % SECS_PER_DAY);
+    TEST_ASSERT_EQUAL_UINT32(at, clock_fired_handle[1]);
+    TEST_ASSERT_EQUAL_INT64(SIM_EPOCH + 60 * 60, clock_fired_wall[1]);
+    TEST_ASSERT_EQUAL_UINT32(every, clock_fired_handle[2]);
+    TEST_ASSERT_EQUAL_INT64(SIM_EPOCH + 30 * 60 + 40 * 60, clock_fired_wall[2]);
+
+    TEST_ESP_OK(task_cancel(daily));
+    TEST_ESP_OK(task_cancel(every));
+
+    // An hour back pushes an absolute time an hour further out
+    time_t due = task_sim_wall_time() + 30 * 60;
+    task_config_t later_config = TASK_ONE_TIME_AT_CONFIG(due);
+    TEST_ESP_OK(task_update(at, &later_config));
+    TEST_ESP_OK(task_resume(at));
+    sim_drain();
+    task_sim_step_wall_clock(task_sim_wall_time() - 60 * 60);
+    sim_now += 89 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+    TEST_ASSERT_EQUAL(3, clock_fires);
+    sim_now += US_PER_MIN;
+    task_sim_run_until(sim_now);
+    TEST_ASSERT_EQUAL(4, clock_fires);
+    TEST_ASSERT_EQUAL_INT64(due, clock_fired_wall[3]);
+
+    TEST_ESP_OK(task_cancel(at));
+    clock_stop();
+}
+
+static void test_timezone_change_moves_daily_tasks(void) {
+    clock_start(SIM_EPOCH);
+
+    task_handle_t handle;
+    task_config_t config = TASK_REPEATING_DAILY_CONFIG(9, 0);
+    TEST_ESP_OK(task_add(&config, &handle));
+    sim_drain();
+
+    // 09:00 in New York is 14:00 UTC the next day
+    TEST_ESP_OK(task_set_timezone("EST5"));
+    sim_now += 24 * 60 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+
+    time_t midnight = SIM_EPOCH - SIM_EPOCH % SECS_PER_DAY;
+    TEST_ASSERT_EQUAL(1, clock_fires);
+    TEST_ASSERT_EQUAL_INT64(midnight + SECS_PER_DAY + 14 * 60 * 60, clock_fired_wall[0]);
+
+    TEST_ESP_OK(task_cancel(handle));
+    clock_stop();
+}
+
+static void test_daily_task_across_dst(void) {
+    // Friday 2024-03-29 12:00 UTC, Central Europe springs forward on Sunday the 31st
+    clock_start(1711713600);
+    TEST_ESP_OK(task_set_timezone("CET-1CEST,M3.5.0,M10.5.0/3"));
+
+    task_handle_t handle;
+    task_config_t config = TASK_REPEATING_DAILY_CONFIG(7, 30);
+    TEST_ESP_OK(task_add(&config, &handle));
+    sim_now += 4 * 24 * 60 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+
+    TEST_ASSERT_EQUAL(4, clock_fires);
+    for (int i=0; i<4; i++) {
+        struct tm tm;
+        localtime_r(&clock_fired_wall[i], &tm);
+        TEST_ASSERT_EQUAL(7, tm.tm_hour);
+        TEST_ASSERT_EQUAL(30, tm.tm_min);
+    }
+    // Saturday to Sunday is an hour short
+    TEST_ASSERT_EQUAL_INT64(23 * 60 * 60, clock_fired_wall[1] - clock_fired_wall[0]);
+    TEST_ASSERT_EQUAL_INT64(24 * 60 * 60, clock_fired_wall[2] - clock_fired_wall[1]);
+
+    TEST_ESP_OK(task_cancel(handle));
+    clock_stop();
+}
+
+#define MIXED_DAYS 90
+#define MIXED_END_US ((int64_t)MIXED_DAYS * SECS_PER_DAY * US_PER_SEC)
+
+typedef struct {
+    task_config_t config;
+    task_handle_t handle;
+    // Fires, plus the event a Pomodoro sends when it starts
+    uint32_t events;
+    uint32_t drifted;
+} mixed_task_t;
+
+static mixed_task_t mixed_tasks[] = {
+    { .config = TASK_REPEATING_EVERY_CONFIG(7) },
+    { .config = TASK_REPEATING_EVERY_CONFIG(45) },
+    { .config = TASK_REPEATING_DAILY_CONFIG(7, 30) },
+    { .config = TASK_REPEATING_DAILY_CONFIG(22, 15) },
+    { .config = TASK_ONE_TIME_AT_CONFIG(SIM_EPOCH + 10 * SECS_PER_DAY) },
+    { .config = TASK_ONE_TIME_IN_CONFIG(45 * SECS_PER_DAY + 17) },
+    { .config = TASK_POMODORO_DEFAULT_CONFIG() },
+};
+
+#define MIXED_COUNT (sizeof(mixed_tasks) / sizeof(mixed_tasks[0]))
+
+/**
+ * @brief Where the `n`th phase of a default Pomodoro started, in minutes from the start
+ * of the session.
+ */
+static int64_t pomodoro_phase_start_min(uint32_t n) {
+    const int64_t cycle = TASK_POMODORO_ROUNDS * TASK_POMODORO_WORK_MIN +
+                          (TASK_POMODORO_ROUNDS - 1) * TASK_POMODORO_SHORT_BREAK_MIN + TASK_POMODORO_LONG_BREAK_MIN;
+    uint32_t phase = n % (2 * TASK_POMODORO_ROUNDS);
+    int64_t start = (n / (2 * TASK_POMODORO_ROUNDS)) * cycle;
+
+    // Work and short break alternate, and only the last break is long
+    start += ((phase + 1) / 2) * TASK_POMODORO_WORK_MIN + (phase / 2) * TASK_POMODORO_SHORT_BREAK_MIN;
+    return start;
+}
+
+/**
+ * @brief Checks a fire landed exactly where the task's schedule says, measured from
+ * when everything was added at monotonic 0 rather than from the previous fire.
+ */
+static bool mixed_is_on_time(const mixed_task_t* task) {
+    const task_config_t* config = &task->config;
+    int64_t now = task_sim_now();
+    time_t wall = task_sim_wall_time();
+
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            if (config->repeating.mode == TASK_REPEAT_EVERY) {
+                return now == task->events * config->repeating.interval_min * US_PER_MIN;
+            }
+            return now % US_PER_SEC == 0 &&
+                   wall % SECS_PER_DAY == config->repeating.hour * 60 * 60 + config->repeating.minute * 60;
+        case TASK_TYPE_ONE_TIME:
+            return wall == (config->one_time.is_relative ? SIM_EPOCH : 0) + config->one_time.at;
+        case TASK_TYPE_POMODORO:
+            return now == pomodoro_phase_start_min(task->events - 1) * US_PER_MIN;
+    }
+    return false;
+}
+
+static void record_mixed_fires(const task_event_t* event, void* arg) {
+    for (int i=0; i<MIXED_COUNT; i++) {
+        mixed_task_t* task = &mixed_tasks[i];
+        if (task->handle != event->handle) continue;
+
+        task->events++;
+        if (!mixed_is_on_time(task)) task->drifted++;
+    }
+}
+
+/**
+ * @brief How many times a daily task at `hour`:`minute` UTC falls within the run.
+ */
+static uint32_t daily_fires_expected(uint8_t hour, uint8_t minute) {
+    time_t end = SIM_EPOCH + MIXED_DAYS * SECS_PER_DAY;
+    time_t first = SIM_EPOCH - SIM_EPOCH % SECS_PER_DAY + hour * 60 * 60 + minute * 60;
+    if (first <= SIM_EPOCH) first += SECS_PER_DAY;
+    return (first <= end) ? (end - first) / SECS_PER_DAY + 1 : 0;
+}
+
+static void test_mixed_tasks_for_months(void) {
+    sim_start_empty();
+    task_set_event_handler(record_mixed_fires, NULL);
+
+    for (int i=0; i<MIXED_COUNT; i++) {
+        mixed_tasks[i].events = 0;
+        mixed_tasks[i].drifted = 0;
+        TEST_ESP_OK(task_add(&mixed_tasks[i].config, &mixed_tasks[i].handle));
+    }
+
+    // A day at a time, the same as a device that is left alone for months
+    for (int day=1; day<=MIXED_DAYS; day++) {
+        sim_now = (int64_t)day * SECS_PER_DAY * US_PER_SEC;
+        task_sim_run_until(sim_now);
+    }
+
+    uint32_t pomodoro_events = 0;
+    while (pomodoro_phase_start_min(pomodoro_events) * US_PER_MIN <= MIXED_END_US) pomodoro_events++;
+
+    const uint32_t expected[MIXED_COUNT] = {
+        MIXED_DAYS * 24 * 60 / 7,
+        MIXED_DAYS * 24 * 60 / 45,
+        daily_fires_expected(7, 30),
+        daily_fires_expected(22, 15),
+        1,
+        1,
+        pomodoro_events,
+    };
+
+    uint32_t fired = 0;
+    for (int i=0; i<MIXED_COUNT; i++) {
+        const mixed_task_t* task = &mixed_tasks[i];
+        printf("task %i (type %i): %u events, %u drifted\n", i, task->config.type, (unsigned)task->events, (unsigned)task->drifted);
+        TEST_ASSERT_EQUAL_UINT32(expected[i], task->events);
+        TEST_ASSERT_EQUAL_UINT32(0, task->drifted);
+        // A Pomodoro's first event is its start, not a fire
+        fired += task->events - (task->config.type == TASK_TYPE_POMODORO ? 1 : 0);
+    }
+
+    task_stats_t stats;
+    TEST_ESP_OK(task_get_stats(&stats));
+    TEST_ASSERT_EQUAL_UINT32(fired, stats.fired);
+    TEST_ASSERT_EQUAL_INT64(0, stats.fire_error_max_us);
+
+    task_set_event_handler(NULL, NULL);
+    for (int i=0; i<MIXED_COUNT; i++) {
+        TEST_ESP_OK(task_cancel(mixed_tasks[i].handle));
+    }
+    sim_drain();
+}
+
+#define POWER_HOURS 24
+
+static const uint16_t power_intervals[] = { 10, 15, 20, 30, 60 };
+static power_accounting_t power;
+
+// The same calls task_port.c makes to the power manager on the device
+static void power_on_wait(int64_t deadline) {
+    power_stats_deadline(&power, deadline);
+    power_stats_release(&power, POWER_CLIENT_TASKS);
+}
+
+static void power_on_wake(void) {
+    power_stats_acquire(&power, POWER_CLIENT_TASKS);
+    power_stats_wakeup(&power, POWER_CLIENT_TASKS);
+}
+
+/**
+ * @brief Runs a few interval tasks for a simulated day with power_stats.c doing the
+ * dispatcher's lock accounting, and checks it only woke for the deadlines.
+ */
+static void test_power_accounting(void) {
+    sim_start_empty();
+    uint16_t count = sizeof(power_intervals) / sizeof(power_intervals[0]);
+    for (uint16_t i=0; i<count; i++) {
+        task_config_t config = TASK_REPEATING_EVERY_CONFIG(power_intervals[i]);
+        TEST_ESP_OK(task_add(&config, &handles[i]));
+    }
+    sim_drain();
+
+    power_stats_init(&power, task_sim_now);
+    task_sim_set_wait_hooks(power_on_wait, power_on_wake);
+    sim_now = POWER_HOURS * 60 * US_PER_MIN;
+    task_sim_run_until(sim_now);
+    task_sim_set_wait_hooks(NULL, NULL);
+
+    power_stats_t stats;
+    power_stats_get(&power, &stats);
+    uint32_t wakeups = stats.wakeups[POWER_CLIENT_TASKS];
+    printf("%u wakeups in %i hours, %u per hour\n", (unsigned)wakeups, POWER_HOURS, (unsigned)(wakeups / POWER_HOURS));
+
+    // Due tasks share a wakeup, so every hour is 10, 15, 20, 30, 40, 45, 50 and 60 minutes
+    // past, plus the dispatch `task_sim_run_until` always starts with
+    TEST_ASSERT_EQUAL_UINT32(POWER_HOURS * 8 + 1, wakeups);
+    TEST_ASSERT_EQUAL_UINT32(wakeups, stats.acquires[POWER_CLIENT_TASKS]);
+    TEST_ASSERT_EQUAL_UINT16(0, power.locks[POWER_CLIENT_TASKS]);
+    TEST_ASSERT_EQUAL(POWER_STATE_IDLE, stats.state);
+    TEST_ASSERT_EQUAL_INT64(sim_now + 10 * US_PER_MIN, stats.next_deadline);
+
+    // Dispatching takes no virtual time, so the whole day is spent idle between deadlines
+    TEST_ASSERT_EQUAL_INT64(0, stats.residency_us[POWER_STATE_ACTIVE]);
+    TEST_ASSERT_EQUAL_INT64(sim_now, stats.residency_us[POWER_STATE_IDLE]);
+
+    sim_cancel_tasks(count);
+}
+
+void app_main(void) {
+    // A fire is logged at info level, which would drown out the results
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_scheduler_scaling);
+    RUN_TEST(test_restore_time);
+    RUN_TEST(test_stale_handles_are_dropped);
+    RUN_TEST(test_stale_handles_survive_reboot);
+    RUN_TEST(test_paused_add_never_fires);
+    RUN_TEST(test_pomodoro_controls);
+    RUN_TEST(test_pomodoro_sessions_run_out);
+    RUN_TEST(test_update_and_pause_together);
+    RUN_TEST(test_snapshot_in_chunks);
+    RUN_TEST(test_relative_task_survives_first_sync);
+    RUN_TEST(test_clock_step_moves_calendar_tasks);
+    RUN_TEST(test_timezone_change_moves_daily_tasks);
+    RUN_TEST(test_daily_task_across_dst);
+    RUN_TEST(test_mixed_tasks_for_months);
+    RUN_TEST(test_power_accounting);
+    exit(UNITY_END());
+}
@@ -0,0 +1,26 @@
+#ifndef TASK_API_H
+#define TASK_API_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#define TASK_API_MAX_BODY 4096
+// Kept at half the dispatcher's command ring size so a whole batch, including the
+// pause or resume that can follow an update, always fits in it
+#define TASK_API_MAX_BATCH 16
+
+/**
+ * @brief Registers the `/api/tasks` endpoints. Must be called before any wildcard
+ * handler that would also match them.
+ *
+ * GET    /api/tasks        List every task. Honours If-None-Match.
+ * POST   /api/tasks        Create a task.
+ * PUT    /api/tasks/<id>   Replace a task's config and/or enable it.
+ * DELETE /api/tasks/<id>   Delete a task.
+ * POST   /api/tasks/batch  {"ops": [{"op": "create|update|delete", "id": .., "task": {..}}]}
+ *
+ * An id that isn't a current task is a 404, or `"ok": false` for that op in a batch.
+ */
+esp_err_t task_api_register(httpd_handle_t server);
+
+#endif
@@ -1,9 +1,31 @@
 #ifndef TASK_MANAGER_H
 #define TASK_MANAGER_H
 
-#include <freertos/task.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
 
-#define MAX_TASKS 32
+#define MAX_TASKS CONFIG_TASK_MANAGER_MAX_TASKS
+
+// Longest POSIX TZ rule string that can be set, including the terminator
+#define TASK_TIMEZONE_MAX_LENGTH 64
+
+#define TASK_POMODORO_WORK_MIN 25
+#define TASK_POMODORO_SHORT_BREAK_MIN 5
+#define TASK_POMODORO_LONG_BREAK_MIN 15
+#define TASK_POMODORO_ROUNDS 4
+#define TASK_POMODORO_MAX_ROUNDS 8
+
+/**
+ * @brief Identifies a task for as long as it exists. The low 16 bits are the slot and
+ * the high 16 bits are the slot's generation, so handles to cancelled tasks are rejected
+ * instead of acting on whichever task reused the slot. 0 is never a valid handle.
+ */
+typedef uint32_t task_handle_t;
+
+#define TASK_HANDLE_INVALID 0
 
 typedef enum {
     TASK_TYPE_REPEATING,
@@ -11,13 +33,179 @@ typedef enum {
     TASK_TYPE_POMODORO
 } task_type_t;
 
+typedef enum {
+    TASK_REPEAT_EVERY,  // Every X minutes
+    TASK_REPEAT_DAILY,  // Every day at X:XX
+} task_repeat_mode_t;
+
+typedef enum {
+    TASK_POMODORO_WORK,
+    TASK_POMODORO_SHORT_BREAK,
+    TASK_POMODORO_LONG_BREAK,
+} task_pomodoro_phase_t;
+
+/**
+ * @brief Fixed-size description of a task. Every task type fits in the same record.
+ * "In X seconds" one time tasks are anchored to the monotonic clock when they're added,
+ * so a wall clock step (like the first SNTP sync) moves their `at` rather than when
+ * they fire.
+ */
 typedef struct {
     task_type_t type;
-    TaskHandle_t task_handle;
+    union {
+        struct {
+            task_repeat_mode_t mode;
+            uint16_t interval_min;
+            uint8_t hour;
+            uint8_t minute;
+        } repeating;
+        struct {
+            // Unix time, or seconds from when the task is added if `is_relative`
+            int64_t at;
+            bool is_relative;
+        } one_time;
+        struct {
+            uint8_t work_min;
+            uint8_t short_break_min;
+            uint8_t long_break_min;
+            uint8_t rounds;
+        } pomodoro;
+    };
+} task_config_t;
+
+#define TASK_REPEATING_EVERY_CONFIG(minutes) { \
+    .type = TASK_TYPE_REPEATING, \
+    .repeating = { .mode = TASK_REPEAT_EVERY, .interval_min = (minutes) } \
+}
+
+#define TASK_REPEATING_DAILY_CONFIG(hh, mm) { \
+    .type = TASK_TYPE_REPEATING, \
+    .repeating = { .mode = TASK_REPEAT_DAILY, .hour = (hh), .minute = (mm) } \
+}
+
+#define TASK_ONE_TIME_AT_CONFIG(unix_time) { \
+    .type = TASK_TYPE_ONE_TIME, \
+    .one_time = { .at = (unix_time) } \
+}
+
+#define TASK_ONE_TIME_IN_CONFIG(seconds) { \
+    .type = TASK_TYPE_ONE_TIME, \
+    .one_time = { .at = (seconds), .is_relative = true } \
+}
+
+#define TASK_POMODORO_DEFAULT_CONFIG() { \
+    .type = TASK_TYPE_POMODORO, \
+    .pomodoro = { \
+        .work_min = TASK_POMODORO_WORK_MIN, \
+        .short_break_min = TASK_POMODORO_SHORT_BREAK_MIN, \
+        .long_break_min = TASK_POMODORO_LONG_BREAK_MIN, \
+        .rounds = TASK_POMODORO_ROUNDS \
+    } \
+}
+
+typedef struct {
+    task_handle_t handle;
+    task_config_t config;
     bool is_enabled;
-} task_handle_t;
+    // Unix time of the next fire, 0 when the task isn't scheduled
+    time_t next_fire;
+} task_info_t;
+
+typedef struct {
+    task_handle_t handle;
+    task_type_t type;
+    // Only valid for TASK_TYPE_POMODORO, the phase that just started
+    task_pomodoro_phase_t phase;
+    uint8_t round;
+    uint32_t phase_duration_s;
+} task_event_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+} task_op_stats_t;
+
+typedef struct {
+    // Times the dispatcher woke up, for any reason
+    uint32_t wakeups;
+    uint32_t fired;
+    // How late tasks fired compared to their deadline
+    int64_t fire_error_max_us;
+    int64_t fire_error_total_us;
+    // CPU cycles spent on each scheduler operation
+    task_op_stats_t insert;
+    task_op_stats_t cancel;
+    task_op_stats_t next_due;
+} task_stats_t;
+
+/**
+ * @brief Called from the dispatcher task every time a task fires. Must not block
+ * for long and must not call back into the task manager.
+ */
+typedef void (*task_event_handler_t)(const task_event_t* event, void* arg);
 
 esp_err_t task_init(void);
-esp_err_t task_add(task_type_t type);
+esp_err_t task_set_event_handler(task_event_handler_t handler, void* arg);
+
+// Every call below only posts a command to the dispatcher and never blocks, except
+// `task_snapshot` which waits for it. The _ISR variants are safe to call from an ISR.
+// A command for a stale handle is dropped by the dispatcher.
+esp_err_t task_add(const task_config_t* config, task_handle_t* handle);
+esp_err_t task_add_ISR(const task_config_t* config, task_handle_t* handle);
+// Adds the task paused, so it can't fire before `task_resume`
+esp_err_t task_add_paused(const task_config_t* config, task_handle_t* handle);
+// A Pomodoro holds one of CONFIG_TASK_MANAGER_MAX_POMODOROS sessions from the add or update
+// that makes it one until it is cancelled, both return ESP_ERR_INVALID_STATE if none is free
+esp_err_t task_update(task_handle_t handle, const task_config_t* config);
+// Updates the task and pauses or resumes it as one command, nothing sees it half done
+esp_err_t task_update_enabled(task_handle_t handle, const task_config_t* config, bool is_enabled);
+esp_err_t task_cancel(task_handle_t handle);
+esp_err_t task_cancel_ISR(task_handle_t handle);
+esp_err_t task_pause(task_handle_t handle);
+esp_err_t task_pause_ISR(task_handle_t handle);
+esp_err_t task_resume(task_handle_t handle);
+esp_err_t task_resume_ISR(task_handle_t handle);
+// Pause and resume keep a Pomodoro's place in its current phase. Skip ends the current
+// phase now, extend adds `minutes` to it.
+esp_err_t task_pomodoro_skip(task_handle_t handle);
+esp_err_t task_pomodoro_skip_ISR(task_handle_t handle);
+esp_err_t task_pomodoro_extend(task_handle_t handle, uint16_t minutes);
+esp_err_t task_pomodoro_extend_ISR(task_handle_t handle, uint16_t minutes);
+
+/**
+ * @brief Copies up to `max_count` tasks, in table order. `offset` is where in the table
+ * to start, NULL for the beginning, and is moved past the last task copied so the next
+ * call carries on from there. Fewer than `max_count` means the end of the table.
+ */
+esp_err_t task_snapshot(task_info_t* tasks, uint16_t max_count, uint16_t* offset, uint16_t* count);
+
+esp_err_t task_get_stats(task_stats_t* stats);
+
+/**
+ * @brief Everything posted between `task_batch_begin` and `task_batch_end` is saved to
+ * flash with a single write once the batch ends. Batches can nest.
+ */
+void task_batch_begin(void);
+esp_err_t task_batch_end(void);
+
+/**
+ * @brief Checks `handle` refers to a task, without waiting for the dispatcher. A task
+ * stays until the dispatcher has run its cancel, and exists as soon as `task_add` returns.
+ */
+bool task_exists(task_handle_t handle);
+
+/**
+ * @brief Changes every time the task table or a fire time changes, for cheap "has
+ * anything changed" checks.
+ */
+uint32_t task_get_version(void);
+
+/**
+ * @brief Sets the POSIX TZ rule (e.g. "PST8PDT,M3.2.0,M11.1.0") used for daily and one
+ * time tasks, saves it, and reschedules every calendar task against it.
+ */
+esp_err_t task_set_timezone(const char* timezone);
+bool task_clock_is_synced(void);
 
-#endif
\ No newline at end of file
+#endif
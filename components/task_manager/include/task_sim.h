@@ -0,0 +1,45 @@
+#ifndef TASK_SIM_H
+#define TASK_SIM_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sdkconfig.h>
+
+// Virtual clock for running the task manager on the linux target. There is no
+// dispatcher thread, time only moves when `task_sim_run_until` is called, and
+// every deadline in between is hit exactly.
+
+#if CONFIG_IDF_TARGET_LINUX
+
+/**
+ * @brief Sets the monotonic clock (us) and the unix time that monotonic 0 maps to.
+ * Call before `task_init`.
+ */
+void task_sim_set_clock(int64_t now, time_t epoch);
+
+/**
+ * @brief Runs the dispatcher at every deadline up to `until`, then leaves the clock
+ * at `until`. Returns how many times the dispatcher woke up.
+ */
+int64_t task_sim_run_until(int64_t until);
+
+/**
+ * @brief Steps the wall clock to `now_wall` without moving the monotonic clock, the same
+ * way an SNTP sync does on the device.
+ */
+void task_sim_step_wall_clock(time_t now_wall);
+
+/**
+ * @brief Calls `on_wait` with the next deadline whenever the dispatcher would block, and
+ * `on_wake` whenever it wakes up, where the device port releases and takes its power
+ * lock. Either can be NULL.
+ */
+void task_sim_set_wait_hooks(void (*on_wait)(int64_t deadline), void (*on_wake)(void));
+
+int64_t task_sim_now(void);
+time_t task_sim_wall_time(void);
+int64_t task_sim_wakeups(void);
+
+#endif
+
+#endif
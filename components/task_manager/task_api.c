@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include <http_json.h>
+
+#include "task_manager.h"
+#include "task_api.h"
+
+#define TASK_API_PREFIX "/api/tasks/"
+#define TASK_API_ETAG_LENGTH 12
+// Tasks copied out of the dispatcher at a time while listing them
+#define TASK_API_LIST_CHUNK 16
+// Latest unix time, and longest "in" delay, a one time task takes. 9999-12-31.
+#define TASK_API_MAX_TIME 253402300799LL
+
+static const char* TAG = "Task API";
+
+static const char* task_type_names[] = {
+    [TASK_TYPE_REPEATING] = "repeating",
+    [TASK_TYPE_ONE_TIME] = "one_time",
+    [TASK_TYPE_POMODORO] = "pomodoro",
+};
+
+// A task as it arrives in a request body, filled in one member at a time by the parser
+typedef struct {
+    // Left empty when missing or not a string
+    char type[12];
+    char mode[8];
+    bool has_type;
+    int hour;
+    int minute;
+    int interval_min;
+    int work_min;
+    int short_break_min;
+    int long_break_min;
+    int rounds;
+    bool has_at;
+    bool has_in;
+    int64_t at;
+    int64_t in;
+    // -1 when missing or not a bool
+    int8_t enabled;
+    // Set if any member was there but unusable, like an hour of 24
+    bool is_invalid;
+} api_task_t;
+
+typedef struct {
+    const char* key;
+    size_t offset;
+    int min;
+    int max;
+} api_task_number_t;
+
+// Every whole number member, with the range that fits where it ends up in task_config_t
+static const api_task_number_t api_task_numbers[] = {
+    { "hour", offsetof(api_task_t, hour), 0, 23 },
+    { "minute", offsetof(api_task_t, minute), 0, 59 },
+    { "interval_min", offsetof(api_task_t, interval_min), 1, UINT16_MAX },
+    { "work_min", offsetof(api_task_t, work_min), 1, UINT8_MAX },
+    { "short_break_min", offsetof(api_task_t, short_break_min), 1, UINT8_MAX },
+    { "long_break_min", offsetof(api_task_t, long_break_min), 1, UINT8_MAX },
+    { "rounds", offsetof(api_task_t, rounds), 1, TASK_POMODORO_MAX_ROUNDS },
+};
+
+typedef struct {
+    char op[8];
+    task_handle_t handle;
+    bool has_task;
+    api_task_t task;
+    esp_err_t err;
+} api_op_t;
+
+typedef struct {
+    api_op_t ops[TASK_API_MAX_BATCH];
+    // Ops in the body, which can be more than fit
+    int count;
+    bool has_ops;
+} api_batch_t;
+
+static void api_task_init(api_task_t* task) {
+    memset(task, 0, sizeof(*task));
+    task->hour = -1;
+    task->minute = -1;
+    task->work_min = TASK_POMODORO_WORK_MIN;
+    task->short_break_min = TASK_POMODORO_SHORT_BREAK_MIN;
+    task->long_break_min = TASK_POMODORO_LONG_BREAK_MIN;
+    task->rounds = TASK_POMODORO_ROUNDS;
+    task->enabled = -1;
+}
+
+/**
+ * @brief Checks `event` is a whole number in [min, max]. The range is checked on the
+ * double first, so NaN, infinities and huge values never reach an integer conversion.
+ */
+static bool api_number_in_range(const json_event_t* event, double min, double max) {
+    return event->type == JSON_NUMBER && event->number >= min && event->number <= max &&
+           event->number == (double)(int64_t)event->number;
+}
+
+/**
+ * @brief Keeps the task member `event` if it's one a task has, and flags the task invalid
+ * if the member is there but out of range or the wrong type.
+ */
+static void api_task_member(api_task_t* task, const json_event_t* event) {
+    const char* key = event->key;
+    if (strcmp(key, "type") == 0) {
+        task->has_type = true;
+        task->is_invalid |= !json_event_copy(event, task->type, sizeof(task->type));
+        return;
+    } else if (strcmp(key, "mode") == 0) {
+        task->is_invalid |= !json_event_copy(event, task->mode, sizeof(task->mode));
+        return;
+    } else if (strcmp(key, "enabled") == 0) {
+        if (event->type == JSON_BOOL) task->enabled = event->boolean;
+        task->is_invalid |= event->type != JSON_BOOL;
+        return;
+    } else if (strcmp(key, "at") == 0) {
+        task->has_at = api_number_in_range(event, 0, TASK_API_MAX_TIME);
+        if (task->has_at) task->at = event->number;
+        task->is_invalid |= !task->has_at;
+        return;
+    } else if (strcmp(key, "in") == 0) {
+        task->has_in = api_number_in_range(event, 0, TASK_API_MAX_TIME);
+        if (task->has_in) task->in = event->number;
+        task->is_invalid |= !task->has_in;
+        return;
+    }
+
+    for (int i=0; i<sizeof(api_task_numbers) / sizeof(api_task_numbers[0]); i++) {
+        const api_task_number_t* number = &api_task_numbers[i];
+        if (strcmp(key, number->key) != 0) continue;
+
+        bool is_valid = api_number_in_range(event, number->min, number->max);
+        if (is_valid) *(int*)((char*)task + number->offset) = event->number;
+        task->is_invalid |= !is_valid;
+        return;
+    }
+}
+
+static void api_task_field(const json_parser_t* parser, const json_event_t* event, void* ctx) {
+    if (event->depth == 1 && event->key != NULL && event->type != JSON_END) api_task_member(ctx, event);
+}
+
+// Body is `{"ops": [{"op": "create", "task": {...}}, {"op": "update", "id": 1, "task": {...}}, {"op": "delete", "id": 2}]}`
+static void api_batch_field(const json_parser_t* parser, const json_event_t* event, void* ctx) {
+    api_batch_t* batch = ctx;
+    if (event->depth == 0 || event->type == JSON_END) return;
+
+    const char* ops_key = json_parser_key(parser, 1);
+    if (ops_key == NULL || strcmp(ops_key, "ops") != 0) return;
+
+    if (event->depth == 1) {
+        batch->has_ops = event->type == JSON_ARRAY;
+        return;
+    }
+    if (!batch->has_ops) return;
+
+    if (event->depth == 2) {
+        // Anything that isn't an object is counted, and fails as an op without a name
+        batch->count = event->index + 1;
+        if (event->index < TASK_API_MAX_BATCH) {
+            memset(&batch->ops[event->index], 0, sizeof(batch->ops[0]));
+            api_task_init(&batch->ops[event->index].task);
+        }
+        return;
+    }
+    if (batch->count > TASK_API_MAX_BATCH || event->key == NULL) return;
+
+    api_op_t* op = &batch->ops[batch->count - 1];
+    if (event->depth == 3) {
+        if (strcmp(event->key, "op") == 0) {
+            json_event_copy(event, op->op, sizeof(op->op));
+        } else if (strcmp(event->key, "id") == 0) {
+            // Handles use all 32 bits, `number` holds them exactly. Anything else is left
+            // as TASK_HANDLE_INVALID, which the op then fails to find.
+            if (api_number_in_range(event, 1, UINT32_MAX)) op->handle = event->number;
+        } else if (strcmp(event->key, "task") == 0) {
+            op->has_task = true;
+        }
+    } else if (event->depth == 4) {
+        const char* parent = json_parser_key(parser, 3);
+        if (parent != NULL && strcmp(parent, "task") == 0) api_task_member(&op->task, event);
+    }
+}
+
+/**
+ * @brief Builds a config from a parsed task. Every number was range checked by
+ * `api_task_member`, so they all fit the fields they're narrowed into.
+ */
+static esp_err_t task_config_from_fields(const api_task_t* task, task_config_t* config) {
+    memset(config, 0, sizeof(*config));
+
+    if (strcmp(task->type, "repeating") == 0) {
+        config->type = TASK_TYPE_REPEATING;
+        if (strcmp(task->mode, "daily") == 0) {
+            if (task->hour < 0 || task->minute < 0) return ESP_ERR_INVALID_ARG;
+            config->repeating.mode = TASK_REPEAT_DAILY;
+            config->repeating.hour = task->hour;
+            config->repeating.minute = task->minute;
+        } else if (task->mode[0] != '\0' && strcmp(task->mode, "every") != 0) {
+            return ESP_ERR_INVALID_ARG;
+        } else {
+            config->repeating.mode = TASK_REPEAT_EVERY;
+            config->repeating.interval_min = task->interval_min;
+        }
+    } else if (strcmp(task->type, "one_time") == 0) {
+        // Either an absolute unix time, or a number of seconds from now
+        config->type = TASK_TYPE_ONE_TIME;
+        if (task->has_at) {
+            config->one_time.at = task->at;
+        } else if (task->has_in) {
+            config->one_time.at = task->in;
+            config->one_time.is_relative = true;
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    } else if (strcmp(task->type, "pomodoro") == 0) {
+        config->type = TASK_TYPE_POMODORO;
+        config->pomodoro.work_min = task->work_min;
+        config->pomodoro.short_break_min = task->short_break_min;
+        config->pomodoro.long_break_min = task->long_break_min;
+        config->pomodoro.rounds = task->rounds;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+static void api_write_task(json_writer_t* json, const task_info_t* info) {
+    const task_config_t* config = &info->config;
+
+    json_write_object(json, NULL);
+    json_write_int(json, "id", info->handle);
+    json_write_string(json, "type", task_type_names[config->type]);
+    json_write_bool(json, "enabled", info->is_enabled);
+    json_write_int(json, "next_fire", info->next_fire);
+
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            if (config->repeating.mode == TASK_REPEAT_DAILY) {
+                json_write_string(json, "mode", "daily");
+                json_write_int(json, "hour", config->repeating.hour);
+                json_write_int(json, "minute", config->repeating.minute);
+            } else {
+                json_write_string(json, "mode", "every");
+                json_write_int(json, "interval_min", config->repeating.interval_min);
+            }
+            break;
+        case TASK_TYPE_ONE_TIME:
+            json_write_int(json, "at", config->one_time.at);
+            break;
+        case TASK_TYPE_POMODORO:
+            json_write_int(json, "work_min", config->pomodoro.work_min);
+            json_write_int(json, "short_break_min", config->pomodoro.short_break_min);
+            json_write_int(json, "long_break_min", config->pomodoro.long_break_min);
+            json_write_int(json, "rounds", config->pomodoro.rounds);
+            break;
+    }
+
+    json_write_end(json);
+}
+
+/**
+ * @brief Reads the id at the end of the URI. False unless it's a handle to a task that
+ * currently exists.
+ */
+static bool api_get_uri_handle(httpd_req_t* req, task_handle_t* handle) {
+    const char* id = req->uri + strlen(TASK_API_PREFIX);
+    char* end;
+
+    // strtoull would take a sign or leading spaces, and wrap "-1"
+    if (*id < '0' || *id > '9') return false;
+
+    unsigned long long value = strtoull(id, &end, 10);
+    if ((*end != '\0' && *end != '?') || value > UINT32_MAX) return false;
+
+    *handle = (task_handle_t)value;
+    return task_exists(*handle);
+}
+
+static esp_err_t api_create(const api_task_t* task, task_handle_t* handle) {
+    if (task->is_invalid) return ESP_ERR_INVALID_ARG;
+
+    task_config_t config;
+    esp_err_t err = task_config_from_fields(task, &config);
+    if (err != ESP_OK) return err;
+
+    // A disabled task is added paused, rather than added and then paused, so it can't
+    // fire in between
+    return (task->enabled == 0) ? task_add_paused(&config, handle) : task_add(&config, handle);
+}
+
+static esp_err_t api_update(task_handle_t handle, const api_task_t* task) {
+    esp_err_t err;
+
+    // Commands for a missing task are only dropped by the dispatcher, so look first
+    if (!task_exists(handle)) return ESP_ERR_NOT_FOUND;
+    if (task->is_invalid) return ESP_ERR_INVALID_ARG;
+
+    // Any part of a task can be left out, e.g. {"enabled": false} only pauses it
+    if (task->has_type) {
+        task_config_t config;
+        err = task_config_from_fields(task, &config);
+        if (err != ESP_OK) return err;
+
+        // One command for both, so the new config can't run before it's paused
+        return (task->enabled >= 0) ? task_update_enabled(handle, &config, task->enabled)
+                                    : task_update(handle, &config);
+    }
+
+    if (task->enabled >= 0) {
+        return task->enabled ? task_resume(handle) : task_pause(handle);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t api_delete(task_handle_t handle) {
+    if (!task_exists(handle)) return ESP_ERR_NOT_FOUND;
+
+    return task_cancel(handle);
+}
+
+static esp_err_t api_send_result(httpd_req_t* req, esp_err_t err, task_handle_t handle) {
+    if (err == ESP_ERR_INVALID_ARG) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid task");
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_404(req);
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "No free Pomodoro session", HTTPD_RESP_USE_STRLEN);
+    } else if (err == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "507 Insufficient Storage");
+        return httpd_resp_send(req, "Task table is full", HTTPD_RESP_USE_STRLEN);
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error applying task change. Error: %s", esp_err_to_name(err));
+        return httpd_resp_send_500(req);
+    }
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_int(&json, "id", handle);
+    json_write_end(&json);
+    return json_writer_finish(&json);
+}
+
+static esp_err_t api_get_tasks_handler(httpd_req_t* req) {
+    // Read the version before the snapshot, so the tag can only ever be older than the body
+    char etag[TASK_API_ETAG_LENGTH];
+    snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned)task_get_version());
+
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_set_hdr(req, "ETag", etag);
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Handlers all run on the server's one task, so a single chunk does for every request.
+    // The table is copied a chunk at a time and written out as it comes.
+    static task_info_t tasks[TASK_API_LIST_CHUNK];
+
+    uint16_t offset = 0;
+    uint16_t count;
+    esp_err_t err = task_snapshot(tasks, TASK_API_LIST_CHUNK, &offset, &count);
+    if (err != ESP_OK) {
+        httpd_resp_send_500(req);
+        return err;
+    }
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_array(&json, "tasks");
+    while (1) {
+        for (int i=0; i<count; i++) {
+            api_write_task(&json, &tasks[i]);
+        }
+        if (count < TASK_API_LIST_CHUNK) break;
+
+        err = task_snapshot(tasks, TASK_API_LIST_CHUNK, &offset, &count);
+        if (err != ESP_OK) {
+            // Part of the body is already out, all we can do is cut it short
+            ESP_LOGE(TAG, "Error running `task_snapshot`. Error: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    json_write_end(&json);
+    json_write_end(&json);
+    return json_writer_finish(&json);
+}
+
+static esp_err_t api_post_task_handler(httpd_req_t* req) {
+    api_task_t task;
+    api_task_init(&task);
+    if (http_json_recv(req, TASK_API_MAX_BODY, api_task_field, &task) != ESP_OK) return ESP_FAIL;
+
+    task_handle_t handle = TASK_HANDLE_INVALID;
+    esp_err_t err = api_create(&task, &handle);
+
+    return api_send_result(req, err, handle);
+}
+
+static esp_err_t api_put_task_handler(httpd_req_t* req) {
+    task_handle_t handle;
+    if (!api_get_uri_handle(req, &handle)) return httpd_resp_send_404(req);
+
+    api_task_t task;
+    api_task_init(&task);
+    if (http_json_recv(req, TASK_API_MAX_BODY, api_task_field, &task) != ESP_OK) return ESP_FAIL;
+
+    esp_err_t err = api_update(handle, &task);
+
+    return api_send_result(req, err, handle);
+}
+
+static esp_err_t api_delete_task_handler(httpd_req_t* req) {
+    task_handle_t handle;
+    if (!api_get_uri_handle(req, &handle)) return httpd_resp_send_404(req);
+
+    return api_send_result(req, api_delete(handle), handle);
+}
+
+/**
+ * @brief Checks whether an op before `index` deleted `handle`. The dispatcher only gets
+ * to a batch's cancels after the batch, so `task_exists` still sees those tasks.
+ */
+static bool api_batch_deleted(const api_batch_t* batch, int index, task_handle_t handle) {
+    for (int i=0; i<index; i++) {
+        const api_op_t* op = &batch->ops[i];
+        if (op->err == ESP_OK && op->handle == handle && strcmp(op->op, "delete") == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Applies every op in the request, then saves the table once. Ops are applied in
+ * order and each gets its own result, a failed op doesn't stop the ones after it.
+ */
+static esp_err_t api_post_batch_handler(httpd_req_t* req) {
+    api_batch_t batch = { 0 };
+    if (http_json_recv(req, TASK_API_MAX_BODY, api_batch_field, &batch) != ESP_OK) return ESP_FAIL;
+
+    // The whole body is checked before any of it is applied
+    if (!batch.has_ops || batch.count > TASK_API_MAX_BATCH) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected an ops array of at most 16 ops");
+    }
+
+    task_batch_begin();
+
+    for (int i=0; i<batch.count; i++) {
+        api_op_t* op = &batch.ops[i];
+        op->err = ESP_ERR_INVALID_ARG;
+
+        if (strcmp(op->op, "create") == 0 && op->has_task) {
+            op->err = api_create(&op->task, &op->handle);
+        } else if (strcmp(op->op, "update") == 0 && op->has_task) {
+            op->err = api_batch_deleted(&batch, i, op->handle) ? ESP_ERR_NOT_FOUND : api_update(op->handle, &op->task);
+        } else if (strcmp(op->op, "delete") == 0) {
+            op->err = api_batch_deleted(&batch, i, op->handle) ? ESP_ERR_NOT_FOUND : api_delete(op->handle);
+        }
+    }
+
+    task_batch_end();
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_array(&json, "results");
+    for (int i=0; i<batch.count; i++) {
+        const api_op_t* op = &batch.ops[i];
+        json_write_object(&json, NULL);
+        json_write_int(&json, "id", op->handle);
+        json_write_bool(&json, "ok", op->err == ESP_OK);
+        if (op->err != ESP_OK) json_write_string(&json, "error", esp_err_to_name(op->err));
+        json_write_end(&json);
+    }
+    json_write_end(&json);
+    json_write_end(&json);
+    return json_writer_finish(&json);
+}
+
+esp_err_t task_api_register(httpd_handle_t server) {
+    static const httpd_uri_t api_get_tasks = {
+        .uri = "/api/tasks",
+        .method = HTTP_GET,
+        .handler = api_get_tasks_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_post_task = {
+        .uri = "/api/tasks",
+        .method = HTTP_POST,
+        .handler = api_post_task_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_post_batch = {
+        .uri = "/api/tasks/batch",
+        .method = HTTP_POST,
+        .handler = api_post_batch_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_put_task = {
+        .uri = TASK_API_PREFIX "*",
+        .method = HTTP_PUT,
+        .handler = api_put_task_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_delete_task = {
+        .uri = TASK_API_PREFIX "*",
+        .method = HTTP_DELETE,
+        .handler = api_delete_task_handler,
+        .user_ctx = NULL
+    };
+
+    const httpd_uri_t* handlers[] = { &api_get_tasks, &api_post_task, &api_post_batch, &api_put_task, &api_delete_task };
+    for (int i=0; i<sizeof(handlers) / sizeof(handlers[0]); i++) {
+        esp_err_t err = httpd_register_uri_handler(server, handlers[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error registering %s. Error: %s", handlers[i]->uri, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
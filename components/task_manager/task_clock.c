@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <sdkconfig.h>
+
+#include "task_manager.h"
+#include "task_clock.h"
+#include "task_port.h"
+
+static const char* TAG = "Task Clock";
+
+static bool is_synced = false;
+
+esp_err_t task_clock_set_timezone(const char* timezone) {
+    if (timezone == NULL || timezone[0] == '\0') return ESP_ERR_INVALID_ARG;
+
+    // POSIX TZ rules carry their own DST transitions, so there is no tz database to ship
+    if (setenv("TZ", timezone, 1) != 0) return ESP_ERR_NO_MEM;
+    tzset();
+
+    ESP_LOGI(TAG, "Timezone set to %s", timezone);
+    return ESP_OK;
+}
+
+bool task_clock_is_synced(void) {
+    return is_synced;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+
+esp_err_t task_clock_init(const char* timezone) {
+    // The virtual clock is the time source, `task_sim_step_wall_clock` plays the part of SNTP
+    return task_clock_set_timezone(timezone);
+}
+
+void task_clock_sim_synced(void) {
+    is_synced = true;
+}
+
+#else
+
+#include <esp_timer.h>
+#include <esp_sntp.h>
+
+// Difference between the wall clock and esp_timer at the last sync, in us
+static int64_t last_offset = 0;
+
+static void task_clock_sync_handler(struct timeval* tv) {
+    int64_t offset = (int64_t)tv->tv_sec * 1000 * 1000 + tv->tv_usec - esp_timer_get_time();
+    int64_t step = offset - last_offset;
+    last_offset = offset;
+
+    // Every calendar deadline was worked out against the old wall clock. Periodic syncs
+    // that only nudge it leave them alone, an actual step redoes them all once.
+    if (!is_synced || step > TASK_CLOCK_STEP_US || step < -TASK_CLOCK_STEP_US) {
+        ESP_LOGI(TAG, "Wall clock stepped by %lli ms, recomputing calendar tasks", step / 1000);
+        task_recompute_calendar(step / (1000 * 1000));
+    }
+
+    is_synced = true;
+}
+
+esp_err_t task_clock_init(const char* timezone) {
+    esp_err_t err = task_clock_set_timezone(timezone);
+    if (err != ESP_OK) return err;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    last_offset = (int64_t)tv.tv_sec * 1000 * 1000 + tv.tv_usec - esp_timer_get_time();
+
+    // SNTP keeps retrying on its own until the station has an IP, so this is safe to
+    // start before Wi-Fi is connected
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, CONFIG_TASK_MANAGER_NTP_SERVER);
+    sntp_set_time_sync_notification_cb(task_clock_sync_handler);
+    esp_sntp_init();
+
+    ESP_LOGI(TAG, "Started SNTP with server %s", CONFIG_TASK_MANAGER_NTP_SERVER);
+    return ESP_OK;
+}
+
+#endif
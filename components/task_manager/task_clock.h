@@ -0,0 +1,26 @@
+#ifndef TASK_CLOCK_H
+#define TASK_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+
+// Steps in the wall clock smaller than this are treated as normal SNTP slewing and
+// don't make calendar tasks recompute their next fire time
+#define TASK_CLOCK_STEP_US (500 * 1000)
+
+esp_err_t task_clock_init(const char* timezone);
+esp_err_t task_clock_set_timezone(const char* timezone);
+
+#if CONFIG_IDF_TARGET_LINUX
+// Marks the wall clock as synced, called by `task_sim_step_wall_clock` in place of SNTP
+void task_clock_sim_synced(void);
+#endif
+
+// Implemented by task_manager.c. Posts a command to recompute the cached fire time of
+// every calendar (daily and one time) task, after the clock steps by `step_s` or the
+// timezone changes (a step of 0).
+esp_err_t task_recompute_calendar(int64_t step_s);
+
+#endif
@@ -1,55 +1,1079 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <esp_err.h>
 #include <esp_log.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/FreeRTOSConfig.h>
-#include <FreeRTOSConfig.h>
-#include <freertos/task.h>
 
 #include "task_manager.h"
+#include "task_clock.h"
+#include "task_pomodoro.h"
+#include "task_port.h"
+#include "task_store.h"
+
+#define TASK_HEAP_NONE 0xFFFF
+#define TASK_FREE_NONE 0xFFFF
+// `task_free_next` of a slot that's handed out
+#define TASK_FREE_USED 0xFFFE
+
+#define TASK_HANDLE(id, generation) (((task_handle_t)(generation) << 16) | (id))
+#define TASK_HANDLE_ID(handle) ((uint16_t)((handle) & 0xFFFF))
+#define TASK_HANDLE_GENERATION(handle) ((uint16_t)((handle) >> 16))
+// Only restored slots know their generation after a reboot. Every other slot starts from
+// the boot's own range, so a handle kept from an earlier boot can't alias a new task
+// unless that slot was reused 255 times in one boot.
+#define TASK_GENERATION_SEED(epoch) ((uint16_t)(((epoch) << 8) | 1))
+#define US_PER_SEC (1000LL * 1000LL)
+#define US_PER_MIN (60LL * US_PER_SEC)
+
+#define TASK_FLAG_USED (1 << 0)
+#define TASK_FLAG_ENABLED (1 << 1)
+// A one time task added as "in X". Its deadline is anchored to the monotonic clock, a
+// wall clock step moves its `at` by the step instead.
+#define TASK_FLAG_RELATIVE (1 << 2)
+
+// Must be a power of two
+#define TASK_CMD_RING_SIZE 32
+
+typedef enum {
+    TASK_CMD_ADD,
+    TASK_CMD_UPDATE,
+    TASK_CMD_CANCEL,
+    TASK_CMD_PAUSE,
+    TASK_CMD_RESUME,
+    TASK_CMD_SNAPSHOT,
+    TASK_CMD_POMODORO_SKIP,
+    TASK_CMD_POMODORO_EXTEND,
+    TASK_CMD_RECOMPUTE_CALENDAR,
+} task_cmd_op_t;
+
+typedef struct {
+    task_info_t* tasks;
+    uint16_t max_count;
+    uint16_t count;
+    // Table position to start from, moved past the last task copied
+    uint16_t offset;
+    task_port_event_t done;
+} task_snapshot_req_t;
+
+typedef struct {
+    task_cmd_op_t op;
+    task_handle_t handle;
+    // Only for TASK_CMD_ADD, adds the task without scheduling it
+    bool is_paused;
+    // Only for TASK_CMD_UPDATE, 1 or 0 to resume or pause the task in the same step,
+    // -1 to leave it as it is
+    int8_t enabled;
+    union {
+        task_config_t config;
+        task_snapshot_req_t* snapshot;
+        uint16_t minutes;
+        // Only for TASK_CMD_RECOMPUTE_CALENDAR, how far the wall clock stepped
+        int64_t step_s;
+    };
+} task_cmd_t;
+
+typedef struct {
+    atomic_uint sequence;
+    task_cmd_t cmd;
+} task_cmd_slot_t;
 
 static const char* TAG = "Task Manager";
 
-static task_handle_t tasks[MAX_TASKS];
+// The task table is kept as a struct of arrays. The dispatcher only ever walks
+// `task_next_fire`/`task_heap_pos` to find due work, the configs are only read
+// when a task actually fires or is edited.
+static int64_t task_next_fire[MAX_TASKS];
+static uint16_t task_heap_pos[MAX_TASKS];
+static uint8_t task_flags[MAX_TASKS];
+static task_config_t task_configs[MAX_TASKS];
 
-esp_err_t task_init(void) {
-    for(int i=0; i<MAX_TASKS; i++) {
-        tasks[i].task_handle = NULL;
+// Slots are handed out from an intrusive free list so allocating and freeing a
+// task is O(1). Every slot has a generation that is bumped each time it is freed,
+// so a handle to a cancelled task can never act on whatever reuses its slot.
+// The pool is the only state shared with callers, everything else in the table
+// is owned by the dispatcher task.
+static uint16_t task_generation[MAX_TASKS];
+static uint16_t task_free_next[MAX_TASKS];
+static uint16_t free_head = TASK_FREE_NONE;
+
+// Bounded multi-producer, single-consumer ring of commands for the dispatcher.
+// Producers claim a slot with a CAS on `cmd_tail` and publish it by bumping the
+// slot's sequence, so posting never blocks or takes a lock and is safe from ISRs.
+static task_cmd_slot_t cmd_ring[TASK_CMD_RING_SIZE];
+static atomic_uint cmd_tail;
+static unsigned cmd_head = 0;
+
+// Binary min-heap of task ids, ordered by `task_next_fire`. Every task keeps
+// its own position in the heap so it can be cancelled in O(log n).
+static uint16_t heap[MAX_TASKS];
+static uint16_t heap_len = 0;
+
+static bool is_started = false;
+static task_stats_t stats;
+
+// Set whenever the table changes, the dispatcher writes it to flash once it
+// has finished with everything that woke it up and no batch is open.
+static bool table_dirty = false;
+static atomic_uint batch_depth;
+
+// Bumped on every change a caller could see in a snapshot, including fire times
+// moving, so a client can tell whether its copy of the table is still current.
+static atomic_uint table_version;
+
+static task_event_handler_t event_handler = NULL;
+static void* event_handler_arg = NULL;
+
+static inline bool heap_less(uint16_t a, uint16_t b) {
+    return task_next_fire[heap[a]] < task_next_fire[heap[b]];
+}
+
+static inline void heap_swap(uint16_t a, uint16_t b) {
+    uint16_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    task_heap_pos[heap[a]] = a;
+    task_heap_pos[heap[b]] = b;
+}
+
+static void heap_sift_up(uint16_t pos) {
+    while (pos > 0) {
+        uint16_t parent = (pos - 1) / 2;
+        if (!heap_less(pos, parent)) break;
+        heap_swap(pos, parent);
+        pos = parent;
+    }
+}
+
+static void heap_sift_down(uint16_t pos) {
+    while (1) {
+        uint16_t smallest = pos;
+        uint16_t left = 2 * pos + 1;
+        uint16_t right = left + 1;
+        if (left < heap_len && heap_less(left, smallest)) smallest = left;
+        if (right < heap_len && heap_less(right, smallest)) smallest = right;
+        if (smallest == pos) break;
+        heap_swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+static void heap_push(uint16_t id) {
+    heap[heap_len] = id;
+    task_heap_pos[id] = heap_len;
+    heap_len++;
+    heap_sift_up(task_heap_pos[id]);
+}
+
+static void heap_remove(uint16_t id) {
+    uint16_t pos = task_heap_pos[id];
+    if (pos == TASK_HEAP_NONE) return;
+
+    heap_len--;
+    if (pos != heap_len) {
+        heap[pos] = heap[heap_len];
+        task_heap_pos[heap[pos]] = pos;
+        // The moved entry could belong either above or below its new spot
+        heap_sift_up(pos);
+        heap_sift_down(task_heap_pos[heap[pos]]);
+    }
+    task_heap_pos[id] = TASK_HEAP_NONE;
+}
+
+static void pool_init(void) {
+    free_head = TASK_FREE_NONE;
+    // Build the list backwards so low ids are handed out first
+    for (int i=MAX_TASKS-1; i>=0; i--) {
+        if (task_flags[i] & TASK_FLAG_USED) {
+            task_free_next[i] = TASK_FREE_USED;
+        } else {
+            task_free_next[i] = free_head;
+            free_head = i;
+        }
+    }
+}
+
+/**
+ * @brief Reserves a slot and returns its handle, or TASK_HANDLE_INVALID if the table is
+ * full. Safe to call from any task or ISR.
+ */
+static task_handle_t pool_alloc(void) {
+    task_handle_t handle = TASK_HANDLE_INVALID;
+
+    task_port_lock();
+    uint16_t id = free_head;
+    if (id != TASK_FREE_NONE) {
+        free_head = task_free_next[id];
+        task_free_next[id] = TASK_FREE_USED;
+        handle = TASK_HANDLE(id, task_generation[id]);
+    }
+    task_port_unlock();
+
+    return handle;
+}
+
+static void pool_free(uint16_t id) {
+    task_port_lock();
+    // Generation 0 is never used so a zeroed handle is always invalid
+    if (++task_generation[id] == 0) task_generation[id] = 1;
+    task_free_next[id] = free_head;
+    free_head = id;
+    task_port_unlock();
+}
+
+static void cmd_ring_init(void) {
+    for (unsigned i=0; i<TASK_CMD_RING_SIZE; i++) {
+        atomic_init(&cmd_ring[i].sequence, i);
+    }
+    atomic_init(&cmd_tail, 0);
+    cmd_head = 0;
+}
+
+static bool cmd_ring_push(const task_cmd_t* cmd) {
+    unsigned pos = atomic_load_explicit(&cmd_tail, memory_order_relaxed);
+
+    while (1) {
+        task_cmd_slot_t* slot = &cmd_ring[pos & (TASK_CMD_RING_SIZE - 1)];
+        unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int diff = (int)(sequence - pos);
+
+        if (diff == 0) {
+            // The slot is free, try to claim it. On failure `pos` is reloaded for us.
+            if (atomic_compare_exchange_weak_explicit(&cmd_tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                slot->cmd = *cmd;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // The consumer hasn't emptied this slot yet, the ring is full
+            return false;
+        } else {
+            // Another producer claimed this slot first
+            pos = atomic_load_explicit(&cmd_tail, memory_order_relaxed);
+        }
+    }
+}
+
+static bool cmd_ring_pop(task_cmd_t* cmd) {
+    task_cmd_slot_t* slot = &cmd_ring[cmd_head & (TASK_CMD_RING_SIZE - 1)];
+    unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+    // Either empty, or claimed by a producer that hasn't finished writing it yet.
+    // That producer notifies the dispatcher once it has, so it's picked up next wake.
+    if ((int)(sequence - (cmd_head + 1)) < 0) return false;
+
+    *cmd = slot->cmd;
+    atomic_store_explicit(&slot->sequence, cmd_head + TASK_CMD_RING_SIZE, memory_order_release);
+    cmd_head++;
+    return true;
+}
+
+/**
+ * @brief Checks that a handle still refers to the task it was created for.
+ */
+static bool task_resolve(task_handle_t handle, uint16_t* id) {
+    uint16_t i = TASK_HANDLE_ID(handle);
+    if (i >= MAX_TASKS) return false;
+    if (!(task_flags[i] & TASK_FLAG_USED)) return false;
+    if (task_generation[i] != TASK_HANDLE_GENERATION(handle)) return false;
+
+    *id = i;
+    return true;
+}
+
+static inline void task_table_changed(bool persist) {
+    if (persist) table_dirty = true;
+    atomic_fetch_add_explicit(&table_version, 1, memory_order_relaxed);
+}
+
+static inline void task_op_record(task_op_stats_t* op, uint32_t start) {
+    uint32_t cycles = task_port_cycles() - start;
+    op->count++;
+    op->total_cycles += cycles;
+    if (cycles > op->max_cycles) op->max_cycles = cycles;
+}
+
+static esp_err_t task_config_validate(const task_config_t* config) {
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            if (config->repeating.mode == TASK_REPEAT_EVERY) {
+                return (config->repeating.interval_min > 0) ? ESP_OK : ESP_ERR_INVALID_ARG;
+            } else if (config->repeating.mode == TASK_REPEAT_DAILY) {
+                return (config->repeating.hour < 24 && config->repeating.minute < 60) ? ESP_OK : ESP_ERR_INVALID_ARG;
+            }
+            return ESP_ERR_INVALID_ARG;
+        case TASK_TYPE_ONE_TIME:
+            return (!config->one_time.is_relative || config->one_time.at >= 0) ? ESP_OK : ESP_ERR_INVALID_ARG;
+        case TASK_TYPE_POMODORO:
+            if (config->pomodoro.work_min == 0 || config->pomodoro.short_break_min == 0 ||
+                config->pomodoro.long_break_min == 0 || config->pomodoro.rounds == 0 ||
+                config->pomodoro.rounds > TASK_POMODORO_MAX_ROUNDS) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            return ESP_OK;
+    }
+
+    return ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief Next time the wall clock reads hour:minute, in local time.
+ */
+static time_t task_next_daily(uint8_t hour, uint8_t minute, time_t now) {
+    struct tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+
+    time_t next = mktime(&tm);
+    if (next <= now) {
+        tm.tm_mday++;
+        tm.tm_hour = hour;
+        tm.tm_min = minute;
+        tm.tm_isdst = -1;
+        next = mktime(&tm);
+    }
+
+    return next;
+}
+
+static int64_t task_wall_to_mono(time_t wall, time_t now_wall, int64_t now) {
+    return now + (int64_t)(wall - now_wall) * US_PER_SEC;
+}
+
+/**
+ * @brief Turns the "in X" config of a task that was just added or edited into the wall
+ * time it's due, and marks the task so clock steps rebase it.
+ */
+static void task_anchor(uint16_t id) {
+    task_config_t* config = &task_configs[id];
+
+    task_flags[id] &= ~TASK_FLAG_RELATIVE;
+    if (config->type != TASK_TYPE_ONE_TIME || !config->one_time.is_relative) return;
+
+    config->one_time.at += task_port_wall_time();
+    config->one_time.is_relative = false;
+    task_flags[id] |= TASK_FLAG_RELATIVE;
+}
+
+/**
+ * @brief Calculates and caches the first fire time of a task that was just added or
+ * enabled. Returns false if the task has nothing left to fire.
+ */
+static bool task_schedule_first(uint16_t id, int64_t now) {
+    const task_config_t* config = &task_configs[id];
+    time_t now_wall = task_port_wall_time();
+
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            if (config->repeating.mode == TASK_REPEAT_EVERY) {
+                task_next_fire[id] = now + config->repeating.interval_min * US_PER_MIN;
+            } else {
+                time_t next = task_next_daily(config->repeating.hour, config->repeating.minute, now_wall);
+                task_next_fire[id] = task_wall_to_mono(next, now_wall, now);
+            }
+            return true;
+        case TASK_TYPE_ONE_TIME:
+            // A time in the past fires straight away
+            task_next_fire[id] = task_wall_to_mono(config->one_time.at, now_wall, now);
+            return true;
+        case TASK_TYPE_POMODORO:
+            // Picks a paused session back up where it left off
+            if (!task_pomodoro_run(id, config, now)) return false;
+            task_next_fire[id] = task_pomodoro_deadline(id);
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Advances the cached fire time of a task that just fired. Only the task that
+ * fired has its calendar recomputed. Returns false if the task is finished.
+ */
+static bool task_schedule_next(uint16_t id, int64_t now) {
+    const task_config_t* config = &task_configs[id];
+    int64_t next;
+
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            if (config->repeating.mode == TASK_REPEAT_EVERY) {
+                // Step from the previous deadline rather than `now` so lateness
+                // in one run doesn't push back every run after it
+                next = task_next_fire[id] + config->repeating.interval_min * US_PER_MIN;
+                if (next <= now) next = now + config->repeating.interval_min * US_PER_MIN;
+            } else {
+                // Step one second past now so we can't land on the same minute again
+                time_t now_wall = task_port_wall_time();
+                next = task_wall_to_mono(task_next_daily(config->repeating.hour, config->repeating.minute, now_wall + 1), now_wall, now);
+            }
+            task_next_fire[id] = next;
+            return true;
+        case TASK_TYPE_ONE_TIME:
+            return false;
+        case TASK_TYPE_POMODORO:
+            task_pomodoro_input(id, TASK_POMODORO_INPUT_EXPIRE, 0, now);
+            task_next_fire[id] = task_pomodoro_deadline(id);
+            return true;
+    }
+
+    return false;
+}
+
+static void task_emit(uint16_t id) {
+    task_event_t event = {
+        .handle = TASK_HANDLE(id, task_generation[id]),
+        .type = task_configs[id].type,
+    };
+
+    if (event.type == TASK_TYPE_POMODORO) {
+        task_pomodoro_status_t status;
+        if (task_pomodoro_status(id, &status)) {
+            event.phase = status.phase;
+            event.round = status.round;
+            event.phase_duration_s = status.duration_s;
+        }
+    }
+
+    if (event_handler != NULL) event_handler(&event, event_handler_arg);
+}
+
+/**
+ * @brief Sets a task running that was just added or resumed. Returns false and leaves the
+ * task disabled if it couldn't be scheduled.
+ */
+static bool task_enable(uint16_t id, int64_t now) {
+    task_flags[id] |= TASK_FLAG_ENABLED;
+    if (!task_schedule_first(id, now)) {
+        task_flags[id] &= ~TASK_FLAG_ENABLED;
+        return false;
+    }
+
+    heap_push(id);
+    return true;
+}
+
+static void task_fire(uint16_t id, int64_t now) {
+    int64_t error = now - task_next_fire[id];
+    stats.fired++;
+    stats.fire_error_total_us += error;
+    if (error > stats.fire_error_max_us) stats.fire_error_max_us = error;
+
+    heap_remove(id);
+
+    bool rescheduled = task_schedule_next(id, now);
+    if (rescheduled) {
+        heap_push(id);
+    } else {
+        // One time tasks stay in the table so they can be re-enabled or edited
+        task_flags[id] &= ~TASK_FLAG_ENABLED;
     }
+    task_table_changed(!rescheduled);
+
+    ESP_LOGI(TAG, "Running ID #%i", id);
+    task_emit(id);
+}
+
+static void task_pack(uint16_t id, task_store_record_t* record) {
+    const task_config_t* config = &task_configs[id];
+
+    memset(record, 0, sizeof(*record));
+    record->id = id;
+    record->generation = task_generation[id];
+    record->type = config->type;
+    record->flags = (task_flags[id] & TASK_FLAG_ENABLED) ? TASK_STORE_FLAG_ENABLED : 0;
+    if (task_flags[id] & TASK_FLAG_RELATIVE) record->flags |= TASK_STORE_FLAG_RELATIVE;
+
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            record->repeating.mode = config->repeating.mode;
+            record->repeating.hour = config->repeating.hour;
+            record->repeating.minute = config->repeating.minute;
+            record->repeating.interval_min = config->repeating.interval_min;
+            break;
+        case TASK_TYPE_ONE_TIME:
+            record->one_time.at = config->one_time.at;
+            break;
+        case TASK_TYPE_POMODORO:
+            record->pomodoro.work_min = config->pomodoro.work_min;
+            record->pomodoro.short_break_min = config->pomodoro.short_break_min;
+            record->pomodoro.long_break_min = config->pomodoro.long_break_min;
+            record->pomodoro.rounds = config->pomodoro.rounds;
+            break;
+    }
+}
+
+static void task_unpack(const task_store_record_t* record, task_config_t* config) {
+    memset(config, 0, sizeof(*config));
+    config->type = record->type;
+
+    switch (config->type) {
+        case TASK_TYPE_REPEATING:
+            config->repeating.mode = record->repeating.mode;
+            config->repeating.hour = record->repeating.hour;
+            config->repeating.minute = record->repeating.minute;
+            config->repeating.interval_min = record->repeating.interval_min;
+            break;
+        case TASK_TYPE_ONE_TIME:
+            config->one_time.at = record->one_time.at;
+            break;
+        case TASK_TYPE_POMODORO:
+            config->pomodoro.work_min = record->pomodoro.work_min;
+            config->pomodoro.short_break_min = record->pomodoro.short_break_min;
+            config->pomodoro.long_break_min = record->pomodoro.long_break_min;
+            config->pomodoro.rounds = record->pomodoro.rounds;
+            break;
+    }
+}
+
+/**
+ * @brief Writes the whole task table to flash as one blob, packing the tasks straight into
+ * it. Only called from the dispatcher.
+ */
+static esp_err_t task_persist(void) {
+    uint16_t count = 0;
+    for (int i=0; i<MAX_TASKS; i++) {
+        if (task_flags[i] & TASK_FLAG_USED) count++;
+    }
+
+    task_store_record_t* records = task_store_save_begin(count);
+    if (records == NULL) return ESP_ERR_NO_MEM;
+
+    uint16_t packed = 0;
+    for (int i=0; i<MAX_TASKS; i++) {
+        if (task_flags[i] & TASK_FLAG_USED) {
+            task_pack(i, &records[packed++]);
+        }
+    }
+
+    return task_store_save();
+}
+
+typedef struct {
+    // Every restored task is scheduled from the same moment
+    int64_t now;
+    uint16_t restored;
+} task_restore_t;
+
+static void task_restore_record(const task_store_record_t* record, void* arg) {
+    task_restore_t* restore = arg;
+    uint16_t id = record->id;
+    if (id >= MAX_TASKS || (task_flags[id] & TASK_FLAG_USED)) {
+        ESP_LOGW(TAG, "Skipping stored task with bad id %u", id);
+        return;
+    }
+
+    task_unpack(record, &task_configs[id]);
+    task_generation[id] = record->generation ? record->generation : 1;
+    if (task_config_validate(&task_configs[id]) != ESP_OK) {
+        ESP_LOGW(TAG, "Skipping stored task #%u with invalid config", id);
+        return;
+    }
+
+    task_flags[id] = TASK_FLAG_USED;
+    if (record->flags & TASK_STORE_FLAG_RELATIVE) task_flags[id] |= TASK_FLAG_RELATIVE;
+    // Stored with more sessions configured, it comes back paused until one frees up
+    if (task_configs[id].type == TASK_TYPE_POMODORO && !task_pomodoro_reserve(id)) {
+        ESP_LOGW(TAG, "No free Pomodoro sessions, restoring task #%u paused", id);
+    } else if (record->flags & TASK_STORE_FLAG_ENABLED) {
+        task_enable(id, restore->now);
+    }
+    restore->restored++;
+}
+
+/**
+ * @brief Loads the stored task table into the empty in-memory table. Only called from
+ * `task_init`, before the dispatcher is running.
+ */
+static esp_err_t task_restore(void) {
+    task_restore_t restore = {
+        .now = task_port_now(),
+        .restored = 0,
+    };
+    esp_err_t err = task_store_load(MAX_TASKS, task_restore_record, &restore);
+    if (err != ESP_OK) return err;
+
+    ESP_LOGI(TAG, "Restored %u tasks in %lli us", restore.restored, task_port_now() - restore.now);
 
     return ESP_OK;
 }
 
-void sample_task(void* arg) {
-    int task_pos = (int)arg;
+static time_t task_next_fire_wall(uint16_t id, int64_t now) {
+    if (task_heap_pos[id] == TASK_HEAP_NONE) return 0;
+    return task_port_wall_time() + (time_t)((task_next_fire[id] - now) / US_PER_SEC);
+}
+
+static bool task_is_calendar(uint16_t id) {
+    const task_config_t* config = &task_configs[id];
+    return config->type == TASK_TYPE_ONE_TIME ||
+           (config->type == TASK_TYPE_REPEATING && config->repeating.mode == TASK_REPEAT_DAILY);
+}
+
+/**
+ * @brief Redoes the cached fire time of every scheduled calendar task. Interval and pomodoro
+ * tasks only count elapsed time, so they are left alone. "In X" tasks keep their deadline
+ * and have their `at` moved by `step_s`, so one added before the first sync doesn't go
+ * off straight away because its `at` is in 1970.
+ */
+static void task_recompute_calendar_tasks(int64_t now, int64_t step_s) {
+    uint16_t count = 0;
+    uint16_t rebased = 0;
 
-    int i = 0;
-    while(1) {
-        ESP_LOGI(TAG, "Running ID #%i", task_pos);
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        i++;
-        if (i > 10) {
-            tasks[task_pos].task_handle = NULL;
-            vTaskDelete(NULL);
+    for (int i=0; i<MAX_TASKS; i++) {
+        if (task_flags[i] & TASK_FLAG_RELATIVE) {
+            task_configs[i].one_time.at += step_s;
+            rebased += step_s != 0;
+            continue;
         }
+        if (task_heap_pos[i] == TASK_HEAP_NONE || !task_is_calendar(i)) continue;
+
+        heap_remove(i);
+        task_schedule_first(i, now);
+        heap_push(i);
+        count++;
     }
+    task_table_changed(rebased > 0);
+
+    ESP_LOGI(TAG, "Recomputed %u calendar tasks, rebased %u relative ones", count, rebased);
 }
 
-esp_err_t task_add(task_type_t type) {
-    int i;
-    for(i=0; i<MAX_TASKS; i++) {
-        if (tasks[i].task_handle == NULL) {
-            // tasks[i] is a free task
-            xTaskCreate(sample_task, NULL, configMINIMAL_STACK_SIZE + 1024, (void*)i, tskIDLE_PRIORITY + 5, &(tasks[i].task_handle));
+static void task_run_cmd(const task_cmd_t* cmd, int64_t now) {
+    uint16_t id = TASK_HANDLE_ID(cmd->handle);
+
+    if (cmd->op == TASK_CMD_ADD) {
+        uint32_t start = task_port_cycles();
+        // The slot was reserved by `task_add`, it just needs filling in
+        task_configs[id] = cmd->config;
+        task_flags[id] = TASK_FLAG_USED;
+        task_anchor(id);
+        bool is_enabled = !cmd->is_paused && task_enable(id, now);
+        task_op_record(&stats.insert, start);
+        task_table_changed(true);
+        if (is_enabled && task_configs[id].type == TASK_TYPE_POMODORO) task_emit(id);
+        return;
+    }
+
+    if (cmd->op == TASK_CMD_SNAPSHOT) {
+        task_snapshot_req_t* req = cmd->snapshot;
+        req->count = 0;
+        uint16_t i = req->offset;
+        for (; i<MAX_TASKS && req->count < req->max_count; i++) {
+            if (!(task_flags[i] & TASK_FLAG_USED)) continue;
+
+            task_info_t* info = &req->tasks[req->count++];
+            info->handle = TASK_HANDLE(i, task_generation[i]);
+            info->config = task_configs[i];
+            info->is_enabled = task_flags[i] & TASK_FLAG_ENABLED;
+            info->next_fire = task_next_fire_wall(i, now);
+        }
+        req->offset = i;
+        task_port_event_set(&req->done);
+        return;
+    }
+
+    if (cmd->op == TASK_CMD_RECOMPUTE_CALENDAR) {
+        task_recompute_calendar_tasks(now, cmd->step_s);
+        return;
+    }
+
+    if (!task_resolve(cmd->handle, &id)) {
+        ESP_LOGW(TAG, "Ignoring command %i for stale handle 0x%08x", cmd->op, (unsigned)cmd->handle);
+        return;
+    }
+
+    switch (cmd->op) {
+        case TASK_CMD_UPDATE:
+            // An edited task starts over as if it was just added, keeping its handle. A
+            // Pomodoro keeps the session `task_update` reserved.
+            heap_remove(id);
+            if (cmd->config.type == TASK_TYPE_POMODORO) {
+                task_pomodoro_reset(id);
+            } else {
+                task_pomodoro_stop(id);
+            }
+            task_configs[id] = cmd->config;
+            task_anchor(id);
+            if (cmd->enabled >= 0) {
+                task_flags[id] &= ~TASK_FLAG_ENABLED;
+                if (cmd->enabled) task_flags[id] |= TASK_FLAG_ENABLED;
+            }
+            if (task_flags[id] & TASK_FLAG_ENABLED) task_enable(id, now);
+            task_table_changed(true);
+            break;
+        case TASK_CMD_CANCEL: {
+            uint32_t start = task_port_cycles();
+            heap_remove(id);
+            task_pomodoro_stop(id);
+            task_flags[id] = 0;
+            pool_free(id);
+            task_op_record(&stats.cancel, start);
+            task_table_changed(true);
+            break;
+        }
+        case TASK_CMD_PAUSE:
+            if (task_flags[id] & TASK_FLAG_ENABLED) {
+                task_flags[id] &= ~TASK_FLAG_ENABLED;
+                heap_remove(id);
+                task_pomodoro_input(id, TASK_POMODORO_INPUT_PAUSE, 0, now);
+                task_table_changed(true);
+            }
+            break;
+        case TASK_CMD_RESUME:
+            if (!(task_flags[id] & TASK_FLAG_ENABLED)) {
+                task_enable(id, now);
+                task_table_changed(true);
+            }
+            break;
+        case TASK_CMD_POMODORO_SKIP:
+        case TASK_CMD_POMODORO_EXTEND: {
+            task_pomodoro_input_t input = (cmd->op == TASK_CMD_POMODORO_SKIP) ? TASK_POMODORO_INPUT_SKIP : TASK_POMODORO_INPUT_EXTEND;
+            uint8_t result = task_pomodoro_input(id, input, cmd->minutes, now);
+            if (result & TASK_POMODORO_RUNNING) {
+                // Only this task's deadline moves, the timeline itself is untouched
+                heap_remove(id);
+                task_next_fire[id] = task_pomodoro_deadline(id);
+                heap_push(id);
+            }
+            task_table_changed(false);
+            if (result & TASK_POMODORO_PHASE_CHANGED) task_emit(id);
+            break;
+        }
+        default:
             break;
+    }
+}
+
+/**
+ * @brief One pass of the dispatcher: drains the command ring, fires everything that is
+ * due and saves the table if it changed. Returns the next deadline.
+ */
+int64_t task_dispatch_once(void) {
+    task_cmd_t cmd;
+
+    stats.wakeups++;
+
+    // Drain everything that was posted since the last wake in one go
+    int64_t now = task_port_now();
+    while (cmd_ring_pop(&cmd)) {
+        task_run_cmd(&cmd, now);
+    }
+
+    now = task_port_now();
+    while (1) {
+        uint32_t start = task_port_cycles();
+        bool is_due = heap_len > 0 && task_next_fire[heap[0]] <= now;
+        task_op_record(&stats.next_due, start);
+        if (!is_due) break;
+
+        task_fire(heap[0], now);
+    }
+
+    if (table_dirty && atomic_load(&batch_depth) == 0) {
+        table_dirty = false;
+        if (task_persist() != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save task table");
         }
     }
-    
-    if (i == MAX_TASKS) {
+
+    return heap_len > 0 ? task_next_fire[heap[0]] : TASK_PORT_NO_DEADLINE;
+}
+
+/**
+ * @brief Single task that owns the task table and runs every timer. It sleeps until the
+ * earliest deadline in the heap, or until a command is posted to the ring.
+ */
+static void task_dispatcher(void* arg) {
+    while (1) {
+        task_port_wait(task_dispatch_once());
+    }
+}
+
+static esp_err_t task_post(const task_cmd_t* cmd) {
+    if (!is_started) return ESP_ERR_INVALID_STATE;
+
+    if (!cmd_ring_push(cmd)) {
+        ESP_LOGW(TAG, "Command ring is full, dropping command %i", cmd->op);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return task_port_notify();
+}
+
+static esp_err_t task_post_ISR(const task_cmd_t* cmd) {
+    if (!is_started) return ESP_ERR_INVALID_STATE;
+
+    if (!cmd_ring_push(cmd)) return ESP_ERR_NO_MEM;
+
+    return task_port_notify_ISR();
+}
+
+static esp_err_t task_add_common(const task_config_t* config, task_handle_t* handle, bool is_paused, bool from_isr) {
+    if (config == NULL) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = task_config_validate(config);
+    if (err != ESP_OK) return err;
+
+    task_cmd_t cmd = {
+        .op = TASK_CMD_ADD,
+        .handle = pool_alloc(),
+        .is_paused = is_paused,
+        .config = *config,
+    };
+    if (cmd.handle == TASK_HANDLE_INVALID) {
         // No task positions are open
-        return ESP_FAIL;
+        return ESP_ERR_NO_MEM;
     }
 
+    uint16_t id = TASK_HANDLE_ID(cmd.handle);
+    if (config->type == TASK_TYPE_POMODORO && !task_pomodoro_reserve(id)) {
+        ESP_LOGW(TAG, "No free Pomodoro sessions, not adding the task");
+        pool_free(id);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    err = from_isr ? task_post_ISR(&cmd) : task_post(&cmd);
+    if (err != ESP_OK) {
+        task_pomodoro_stop(id);
+        pool_free(id);
+        return err;
+    }
+
+    if (handle != NULL) *handle = cmd.handle;
+    return ESP_OK;
+}
+
+esp_err_t task_init(void) {
+    for(int i=0; i<MAX_TASKS; i++) {
+        task_flags[i] = 0;
+        task_heap_pos[i] = TASK_HEAP_NONE;
+    }
+    heap_len = 0;
+    atomic_init(&batch_depth, 0);
+    atomic_init(&table_version, 1);
+    cmd_ring_init();
+    task_pomodoro_init();
+
+    esp_err_t err = task_store_open();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening task storage. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    uint8_t epoch = 0;
+    err = task_store_next_epoch(&epoch);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error counting boots, old handles may match new tasks. Error: %s", esp_err_to_name(err));
+    }
+    for (int i=0; i<MAX_TASKS; i++) {
+        task_generation[i] = TASK_GENERATION_SEED(epoch);
+    }
+
+    // The timezone has to be in place before any daily task works out its next fire time
+    char timezone[TASK_TIMEZONE_MAX_LENGTH];
+    if (task_store_get_timezone(timezone, sizeof(timezone)) != ESP_OK) {
+        strncpy(timezone, CONFIG_TASK_MANAGER_TIMEZONE, sizeof(timezone) - 1);
+        timezone[sizeof(timezone) - 1] = '\0';
+    }
+
+    err = task_clock_init(timezone);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error starting the wall clock. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = task_restore();
+    if (err != ESP_OK) {
+        // A table we can't read shouldn't stop the device from working, start empty instead
+        ESP_LOGW(TAG, "Error restoring tasks, starting with an empty table. Error: %s", esp_err_to_name(err));
+    }
+
+    // Restored tasks keep their slots, everything else becomes free
+    pool_init();
+
+    memset(&stats, 0, sizeof(stats));
+
+    err = task_port_start(task_dispatcher);
+    if (err != ESP_OK) return err;
+
+    is_started = true;
+    return ESP_OK;
+}
+
+esp_err_t task_set_event_handler(task_event_handler_t handler, void* arg) {
+    // Only meant to be set once at startup, before any task can fire
+    event_handler_arg = arg;
+    event_handler = handler;
+
+    return ESP_OK;
+}
+
+esp_err_t task_add(const task_config_t* config, task_handle_t* handle) {
+    return task_add_common(config, handle, false, false);
+}
+
+esp_err_t task_add_ISR(const task_config_t* config, task_handle_t* handle) {
+    return task_add_common(config, handle, false, true);
+}
+
+esp_err_t task_add_paused(const task_config_t* config, task_handle_t* handle) {
+    return task_add_common(config, handle, true, false);
+}
+
+static esp_err_t task_update_common(task_handle_t handle, const task_config_t* config, int8_t enabled) {
+    if (config == NULL) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = task_config_validate(config);
+    if (err != ESP_OK) return err;
+
+    if (config->type == TASK_TYPE_POMODORO) {
+        // A session reserved for a stale handle would sit on a free slot
+        if (!task_exists(handle)) return ESP_ERR_NOT_FOUND;
+        if (!task_pomodoro_reserve(TASK_HANDLE_ID(handle))) {
+            ESP_LOGW(TAG, "No free Pomodoro sessions, not updating task #%u", TASK_HANDLE_ID(handle));
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    task_cmd_t cmd = { .op = TASK_CMD_UPDATE, .handle = handle, .enabled = enabled, .config = *config };
+    return task_post(&cmd);
+}
+
+esp_err_t task_update(task_handle_t handle, const task_config_t* config) {
+    return task_update_common(handle, config, -1);
+}
+
+esp_err_t task_update_enabled(task_handle_t handle, const task_config_t* config, bool is_enabled) {
+    return task_update_common(handle, config, is_enabled);
+}
+
+esp_err_t task_cancel(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_CANCEL, .handle = handle };
+    return task_post(&cmd);
+}
+
+esp_err_t task_cancel_ISR(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_CANCEL, .handle = handle };
+    return task_post_ISR(&cmd);
+}
+
+esp_err_t task_pause(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_PAUSE, .handle = handle };
+    return task_post(&cmd);
+}
+
+esp_err_t task_pause_ISR(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_PAUSE, .handle = handle };
+    return task_post_ISR(&cmd);
+}
+
+esp_err_t task_resume(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_RESUME, .handle = handle };
+    return task_post(&cmd);
+}
+
+esp_err_t task_resume_ISR(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_RESUME, .handle = handle };
+    return task_post_ISR(&cmd);
+}
+
+esp_err_t task_pomodoro_skip(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_POMODORO_SKIP, .handle = handle };
+    return task_post(&cmd);
+}
+
+esp_err_t task_pomodoro_skip_ISR(task_handle_t handle) {
+    task_cmd_t cmd = { .op = TASK_CMD_POMODORO_SKIP, .handle = handle };
+    return task_post_ISR(&cmd);
+}
+
+esp_err_t task_pomodoro_extend(task_handle_t handle, uint16_t minutes) {
+    task_cmd_t cmd = { .op = TASK_CMD_POMODORO_EXTEND, .handle = handle, .minutes = minutes };
+    return task_post(&cmd);
+}
+
+esp_err_t task_pomodoro_extend_ISR(task_handle_t handle, uint16_t minutes) {
+    task_cmd_t cmd = { .op = TASK_CMD_POMODORO_EXTEND, .handle = handle, .minutes = minutes };
+    return task_post_ISR(&cmd);
+}
+
+esp_err_t task_snapshot(task_info_t* tasks, uint16_t max_count, uint16_t* offset, uint16_t* count) {
+    if (tasks == NULL || count == NULL) return ESP_ERR_INVALID_ARG;
+
+    task_snapshot_req_t req = {
+        .tasks = tasks,
+        .max_count = max_count,
+        .count = 0,
+        .offset = (offset != NULL) ? *offset : 0,
+    };
+    task_port_event_init(&req.done);
+
+    task_cmd_t cmd = { .op = TASK_CMD_SNAPSHOT, .snapshot = &req };
+    esp_err_t err = task_post(&cmd);
+    if (err != ESP_OK) return err;
+
+    // `req` lives on our stack, so we have to wait for the dispatcher no matter how long it takes
+    task_port_event_wait(&req.done);
+
+    if (offset != NULL) *offset = req.offset;
+    *count = req.count;
+    return ESP_OK;
+}
+
+void task_batch_begin(void) {
+    atomic_fetch_add(&batch_depth, 1);
+}
+
+esp_err_t task_batch_end(void) {
+    if (atomic_fetch_sub(&batch_depth, 1) != 1) return ESP_OK;
+
+    // Wake the dispatcher so it saves everything the batch changed in one go
+    return is_started ? task_port_notify() : ESP_OK;
+}
+
+bool task_exists(task_handle_t handle) {
+    uint16_t id = TASK_HANDLE_ID(handle);
+    if (handle == TASK_HANDLE_INVALID || id >= MAX_TASKS) return false;
+
+    // The pool is the one part of the table callers can read, a slot is handed out until
+    // the dispatcher frees it and bumps its generation
+    task_port_lock();
+    bool exists = task_free_next[id] == TASK_FREE_USED && task_generation[id] == TASK_HANDLE_GENERATION(handle);
+    task_port_unlock();
+
+    return exists;
+}
+
+uint32_t task_get_version(void) {
+    return atomic_load_explicit(&table_version, memory_order_relaxed);
+}
+
+esp_err_t task_recompute_calendar(int64_t step_s) {
+    task_cmd_t cmd = { .op = TASK_CMD_RECOMPUTE_CALENDAR, .step_s = step_s };
+    return task_post(&cmd);
+}
+
+esp_err_t task_set_timezone(const char* timezone) {
+    if (timezone == NULL || strlen(timezone) >= TASK_TIMEZONE_MAX_LENGTH) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = task_clock_set_timezone(timezone);
+    if (err != ESP_OK) return err;
+
+    err = task_store_set_timezone(timezone);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error saving timezone. Error: %s", esp_err_to_name(err));
+    }
+
+    // A new rule changes local times only, the unix time every task is due at stays put
+    return task_recompute_calendar(0);
+}
+
+esp_err_t task_get_stats(task_stats_t* out) {
+    if (out == NULL) return ESP_ERR_INVALID_ARG;
+
+    // Only the dispatcher writes these, a copy taken mid-update can be off by one event
+    *out = stats;
     return ESP_OK;
 }
@@ -0,0 +1,238 @@
+#include <string.h>
+#include <esp_log.h>
+
+#include "task_pomodoro.h"
+#include "task_port.h"
+
+#define US_PER_SEC (1000LL * 1000LL)
+#define US_PER_MIN (60LL * US_PER_SEC)
+
+#define TASK_POMODORO_MAX_PHASES (2 * TASK_POMODORO_MAX_ROUNDS)
+#define TASK_POMODORO_SESSION_NONE 0xFF
+
+typedef enum {
+    SESSION_RUNNING,
+    SESSION_PAUSED,
+    // Held for a task that hasn't started yet, it takes no inputs until `task_pomodoro_run`
+    SESSION_RESERVED,
+    SESSION_STATE_MAX,
+} session_state_t;
+
+typedef enum {
+    ACTION_NONE,
+    ACTION_ADVANCE,
+    ACTION_SKIP,
+    ACTION_EXTEND,
+    ACTION_FREEZE,
+    ACTION_THAW,
+} session_action_t;
+
+typedef struct {
+    uint8_t next;
+    uint8_t action;
+} session_transition_t;
+
+// The whole state machine. An expiry can't happen while paused since a paused
+// session isn't in the dispatcher's heap, it is listed so stray inputs are harmless.
+static const session_transition_t transitions[SESSION_STATE_MAX][TASK_POMODORO_INPUT_MAX] = {
+    [SESSION_RUNNING] = {
+        [TASK_POMODORO_INPUT_EXPIRE] = { SESSION_RUNNING, ACTION_ADVANCE },
+        [TASK_POMODORO_INPUT_SKIP] = { SESSION_RUNNING, ACTION_SKIP },
+        [TASK_POMODORO_INPUT_EXTEND] = { SESSION_RUNNING, ACTION_EXTEND },
+        [TASK_POMODORO_INPUT_PAUSE] = { SESSION_PAUSED, ACTION_FREEZE },
+        [TASK_POMODORO_INPUT_RESUME] = { SESSION_RUNNING, ACTION_NONE },
+    },
+    [SESSION_PAUSED] = {
+        [TASK_POMODORO_INPUT_EXPIRE] = { SESSION_PAUSED, ACTION_NONE },
+        [TASK_POMODORO_INPUT_SKIP] = { SESSION_PAUSED, ACTION_SKIP },
+        [TASK_POMODORO_INPUT_EXTEND] = { SESSION_PAUSED, ACTION_EXTEND },
+        [TASK_POMODORO_INPUT_PAUSE] = { SESSION_PAUSED, ACTION_NONE },
+        [TASK_POMODORO_INPUT_RESUME] = { SESSION_RUNNING, ACTION_THAW },
+    },
+    [SESSION_RESERVED] = {
+        [TASK_POMODORO_INPUT_EXPIRE] = { SESSION_RESERVED, ACTION_NONE },
+        [TASK_POMODORO_INPUT_SKIP] = { SESSION_RESERVED, ACTION_NONE },
+        [TASK_POMODORO_INPUT_EXTEND] = { SESSION_RESERVED, ACTION_NONE },
+        [TASK_POMODORO_INPUT_PAUSE] = { SESSION_RESERVED, ACTION_NONE },
+        [TASK_POMODORO_INPUT_RESUME] = { SESSION_RESERVED, ACTION_NONE },
+    },
+};
+
+/**
+ * @brief A running Pomodoro. The timeline is built once when the session starts and
+ * holds the end of every phase as an offset from `base`, so moving to the next phase
+ * is one index bump. Skip, extend and pause only ever move `base`.
+ */
+typedef struct {
+    uint32_t end_s[TASK_POMODORO_MAX_PHASES];
+    uint8_t phase[TASK_POMODORO_MAX_PHASES];
+    uint8_t count;
+    uint8_t index;
+    uint8_t state;
+    int64_t base;
+    int64_t paused_at;
+} session_t;
+
+static const char* TAG = "Task Pomodoro";
+
+static session_t sessions[CONFIG_TASK_MANAGER_MAX_POMODOROS];
+// Which task holds which session. Callers reserve sessions from their own task, so both
+// are only changed under the port lock.
+static uint8_t session_used[CONFIG_TASK_MANAGER_MAX_POMODOROS];
+static uint8_t task_session[MAX_TASKS];
+
+static void session_build(session_t* session, const task_config_t* config) {
+    const uint32_t duration_s[] = {
+        [TASK_POMODORO_WORK] = config->pomodoro.work_min * 60,
+        [TASK_POMODORO_SHORT_BREAK] = config->pomodoro.short_break_min * 60,
+        [TASK_POMODORO_LONG_BREAK] = config->pomodoro.long_break_min * 60,
+    };
+    uint32_t end = 0;
+
+    session->count = 0;
+    for (int round=0; round<config->pomodoro.rounds; round++) {
+        task_pomodoro_phase_t pause = (round == config->pomodoro.rounds - 1) ? TASK_POMODORO_LONG_BREAK : TASK_POMODORO_SHORT_BREAK;
+
+        end += duration_s[TASK_POMODORO_WORK];
+        session->phase[session->count] = TASK_POMODORO_WORK;
+        session->end_s[session->count++] = end;
+
+        end += duration_s[pause];
+        session->phase[session->count] = pause;
+        session->end_s[session->count++] = end;
+    }
+}
+
+static inline int64_t session_deadline(const session_t* session) {
+    return session->base + session->end_s[session->index] * US_PER_SEC;
+}
+
+static void session_advance(session_t* session) {
+    if (++session->index == session->count) {
+        // Start the next set of rounds right where this one ended
+        session->base += session->end_s[session->count - 1] * US_PER_SEC;
+        session->index = 0;
+    }
+}
+
+static session_t* session_get(uint16_t id) {
+    uint8_t s = task_session[id];
+    return (s == TASK_POMODORO_SESSION_NONE) ? NULL : &sessions[s];
+}
+
+void task_pomodoro_init(void) {
+    memset(session_used, 0, sizeof(session_used));
+    memset(task_session, TASK_POMODORO_SESSION_NONE, sizeof(task_session));
+}
+
+bool task_pomodoro_reserve(uint16_t id) {
+    bool is_reserved = false;
+
+    task_port_lock();
+    if (task_session[id] != TASK_POMODORO_SESSION_NONE) {
+        is_reserved = true;
+    } else {
+        for (int s=0; s<CONFIG_TASK_MANAGER_MAX_POMODOROS && !is_reserved; s++) {
+            if (session_used[s]) continue;
+
+            sessions[s].state = SESSION_RESERVED;
+            session_used[s] = 1;
+            task_session[id] = s;
+            is_reserved = true;
+        }
+    }
+    task_port_unlock();
+
+    return is_reserved;
+}
+
+bool task_pomodoro_run(uint16_t id, const task_config_t* config, int64_t now) {
+    // Only a task restored from flash can get here without one
+    if (!task_pomodoro_reserve(id)) {
+        ESP_LOGW(TAG, "No free Pomodoro sessions for task #%u", id);
+        return false;
+    }
+
+    session_t* session = session_get(id);
+    if (session->state != SESSION_RESERVED) {
+        task_pomodoro_input(id, TASK_POMODORO_INPUT_RESUME, 0, now);
+        return true;
+    }
+
+    session_build(session, config);
+    session->index = 0;
+    session->state = SESSION_RUNNING;
+    session->base = now;
+    session->paused_at = 0;
+    return true;
+}
+
+void task_pomodoro_reset(uint16_t id) {
+    session_t* session = session_get(id);
+    if (session != NULL) session->state = SESSION_RESERVED;
+}
+
+void task_pomodoro_stop(uint16_t id) {
+    task_port_lock();
+    uint8_t s = task_session[id];
+    if (s != TASK_POMODORO_SESSION_NONE) {
+        session_used[s] = 0;
+        task_session[id] = TASK_POMODORO_SESSION_NONE;
+    }
+    task_port_unlock();
+}
+
+uint8_t task_pomodoro_input(uint16_t id, task_pomodoro_input_t input, uint16_t minutes, int64_t now) {
+    session_t* session = session_get(id);
+    if (session == NULL || input >= TASK_POMODORO_INPUT_MAX) return 0;
+
+    const session_transition_t* transition = &transitions[session->state][input];
+    uint8_t result = 0;
+
+    switch (transition->action) {
+        case ACTION_ADVANCE:
+            session_advance(session);
+            result |= TASK_POMODORO_PHASE_CHANGED;
+            break;
+        case ACTION_SKIP: {
+            // Pull the timeline in so the current phase ends right now, or right when we paused
+            int64_t at = (session->state == SESSION_PAUSED) ? session->paused_at : now;
+            session->base -= session_deadline(session) - at;
+            session_advance(session);
+            result |= TASK_POMODORO_PHASE_CHANGED;
+            break;
+        }
+        case ACTION_EXTEND:
+            session->base += minutes * US_PER_MIN;
+            break;
+        case ACTION_FREEZE:
+            session->paused_at = now;
+            break;
+        case ACTION_THAW:
+            session->base += now - session->paused_at;
+            break;
+        default:
+            break;
+    }
+
+    session->state = transition->next;
+    if (session->state == SESSION_RUNNING) result |= TASK_POMODORO_RUNNING;
+
+    return result;
+}
+
+int64_t task_pomodoro_deadline(uint16_t id) {
+    session_t* session = session_get(id);
+    return (session != NULL) ? session_deadline(session) : 0;
+}
+
+bool task_pomodoro_status(uint16_t id, task_pomodoro_status_t* status) {
+    session_t* session = session_get(id);
+    if (session == NULL || session->state == SESSION_RESERVED) return false;
+
+    uint8_t i = session->index;
+    status->phase = session->phase[i];
+    status->round = i / 2;
+    status->duration_s = session->end_s[i] - (i > 0 ? session->end_s[i - 1] : 0);
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef TASK_POMODORO_H
+#define TASK_POMODORO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "task_manager.h"
+
+// Everything here is only called from the dispatcher task, apart from
+// `task_pomodoro_reserve` and `task_pomodoro_stop` which take the port lock
+
+typedef enum {
+    TASK_POMODORO_INPUT_EXPIRE,  // The current phase's deadline passed
+    TASK_POMODORO_INPUT_SKIP,
+    TASK_POMODORO_INPUT_EXTEND,
+    TASK_POMODORO_INPUT_PAUSE,
+    TASK_POMODORO_INPUT_RESUME,
+    TASK_POMODORO_INPUT_MAX,
+} task_pomodoro_input_t;
+
+// Returned by `task_pomodoro_input`
+#define TASK_POMODORO_PHASE_CHANGED (1 << 0)
+#define TASK_POMODORO_RUNNING (1 << 1)
+
+typedef struct {
+    task_pomodoro_phase_t phase;
+    uint8_t round;
+    uint32_t duration_s;
+} task_pomodoro_status_t;
+
+void task_pomodoro_init(void);
+
+/**
+ * @brief Holds a session for task `id` until `task_pomodoro_stop`, so a Pomodoro can't
+ * be added and then find every session taken when it starts. Returns false if every
+ * session is in use, true straight away if `id` already holds one.
+ */
+bool task_pomodoro_reserve(uint16_t id);
+
+/**
+ * @brief Starts the session for task `id` with its timeline built from `config`, or thaws
+ * the session if it is paused. Returns false if it has none and every session is in use.
+ */
+bool task_pomodoro_run(uint16_t id, const task_config_t* config, int64_t now);
+
+/**
+ * @brief Ends the session of task `id` but keeps it reserved, the next run starts over.
+ */
+void task_pomodoro_reset(uint16_t id);
+void task_pomodoro_stop(uint16_t id);
+
+/**
+ * @brief Feeds one input to the session's state machine. `minutes` is only used by
+ * TASK_POMODORO_INPUT_EXTEND.
+ */
+uint8_t task_pomodoro_input(uint16_t id, task_pomodoro_input_t input, uint16_t minutes, int64_t now);
+
+int64_t task_pomodoro_deadline(uint16_t id);
+bool task_pomodoro_status(uint16_t id, task_pomodoro_status_t* status);
+
+#endif
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <sdkconfig.h>
+
+#include "task_port.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include "task_clock.h"
+#include "task_sim.h"
+
+// Virtual clock, only ever moved forward by `task_sim_*`
+static int64_t sim_now = 0;
+static time_t sim_epoch = 0;
+static int64_t sim_wakeups = 0;
+static void (*sim_on_wait)(int64_t deadline) = NULL;
+static void (*sim_on_wake)(void) = NULL;
+
+int64_t task_port_now(void) {
+    return sim_now;
+}
+
+time_t task_port_wall_time(void) {
+    return sim_epoch + (time_t)(sim_now / (1000 * 1000));
+}
+
+uint32_t task_port_cycles(void) {
+    // Host nanoseconds stand in for CPU cycles
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+esp_err_t task_port_start(void (*dispatcher)(void*)) {
+    // There is no dispatcher thread, `task_sim_run_until` runs it in the caller
+    return ESP_OK;
+}
+
+void task_port_wait(int64_t deadline) {
+}
+
+esp_err_t task_port_notify(void) {
+    return ESP_OK;
+}
+
+esp_err_t task_port_notify_ISR(void) {
+    return ESP_OK;
+}
+
+void task_port_lock(void) {
+}
+
+void task_port_unlock(void) {
+}
+
+void task_port_event_init(task_port_event_t* event) {
+    event->is_set = false;
+}
+
+void task_port_event_set(task_port_event_t* event) {
+    event->is_set = true;
+}
+
+/**
+ * @brief Runs the dispatcher once, between the same wake and wait calls the device port
+ * makes to the power manager.
+ */
+static int64_t sim_dispatch(void) {
+    if (sim_on_wake) sim_on_wake();
+    int64_t next = task_dispatch_once();
+    sim_wakeups++;
+    if (sim_on_wait) sim_on_wait(next);
+    return next;
+}
+
+void task_port_event_wait(task_port_event_t* event) {
+    // Single threaded, so whatever we are waiting on only happens if we run the dispatcher
+    while (!event->is_set) {
+        sim_dispatch();
+    }
+}
+
+void task_sim_set_clock(int64_t now, time_t epoch) {
+    sim_now = now;
+    sim_epoch = epoch;
+}
+
+int64_t task_sim_run_until(int64_t until) {
+    int64_t wakeups = 0;
+
+    while (1) {
+        int64_t next = sim_dispatch();
+        wakeups++;
+        if (next > until) break;
+        // Jump straight to the next deadline, exactly like a perfect timer would
+        if (next > sim_now) sim_now = next;
+    }
+
+    sim_now = until;
+    return wakeups;
+}
+
+void task_sim_step_wall_clock(time_t now_wall) {
+    time_t step = now_wall - task_port_wall_time();
+    sim_epoch = now_wall - (time_t)(sim_now / (1000 * 1000));
+    task_clock_sim_synced();
+    task_recompute_calendar(step);
+}
+
+void task_sim_set_wait_hooks(void (*on_wait)(int64_t deadline), void (*on_wake)(void)) {
+    sim_on_wait = on_wait;
+    sim_on_wake = on_wake;
+}
+
+int64_t task_sim_now(void) {
+    return sim_now;
+}
+
+time_t task_sim_wall_time(void) {
+    return task_port_wall_time();
+}
+
+int64_t task_sim_wakeups(void) {
+    return sim_wakeups;
+}
+
+#else
+
+#include <esp_timer.h>
+#include <esp_cpu.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <power_manager.h>
+
+static const char* TAG = "Task Port";
+
+static TaskHandle_t dispatcher_handle = NULL;
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+int64_t task_port_now(void) {
+    return esp_timer_get_time();
+}
+
+time_t task_port_wall_time(void) {
+    return time(NULL);
+}
+
+uint32_t task_port_cycles(void) {
+    return esp_cpu_get_cycle_count();
+}
+
+esp_err_t task_port_start(void (*dispatcher)(void*)) {
+    // The dispatcher runs at full speed and holds this lock for as long as it isn't
+    // blocked in `task_port_wait`, so its short bursts of work finish sooner
+    power_acquire(POWER_CLIENT_TASKS);
+
+    if (xTaskCreate(dispatcher, "Task Dispatcher", configMINIMAL_STACK_SIZE + 2048, NULL, tskIDLE_PRIORITY + 5, &dispatcher_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Error creating task dispatcher");
+        power_release(POWER_CLIENT_TASKS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Blocks the dispatcher until `deadline` or until it is notified. With tickless
+ * idle this timeout is what lets the chip light sleep until the next deadline.
+ */
+void task_port_wait(int64_t deadline) {
+    TickType_t wait = portMAX_DELAY;
+
+    if (deadline != TASK_PORT_NO_DEADLINE) {
+        // Round up so we never wake before the deadline and spin
+        int64_t delta_us = deadline - esp_timer_get_time();
+        int64_t us_per_tick = 1000 * portTICK_PERIOD_MS;
+        wait = (delta_us > 0) ? (TickType_t)((delta_us + us_per_tick - 1) / us_per_tick) : 0;
+    }
+
+    power_publish_deadline(deadline == TASK_PORT_NO_DEADLINE ? POWER_NO_DEADLINE : deadline);
+    power_release(POWER_CLIENT_TASKS);
+    ulTaskNotifyTake(pdTRUE, wait);
+    power_acquire(POWER_CLIENT_TASKS);
+    power_note_wakeup(POWER_CLIENT_TASKS);
+}
+
+esp_err_t task_port_notify(void) {
+    if (dispatcher_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    xTaskNotifyGive(dispatcher_handle);
+    return ESP_OK;
+}
+
+esp_err_t task_port_notify_ISR(void) {
+    if (dispatcher_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(dispatcher_handle, &higher_priority_task_woken);
+    if (higher_priority_task_woken) portYIELD_FROM_ISR();
+
+    return ESP_OK;
+}
+
+void task_port_lock(void) {
+    portENTER_CRITICAL_SAFE(&pool_lock);
+}
+
+void task_port_unlock(void) {
+    portEXIT_CRITICAL_SAFE(&pool_lock);
+}
+
+void task_port_event_init(task_port_event_t* event) {
+    event->handle = xSemaphoreCreateBinaryStatic(&event->buf);
+}
+
+void task_port_event_set(task_port_event_t* event) {
+    xSemaphoreGive(event->handle);
+}
+
+void task_port_event_wait(task_port_event_t* event) {
+    xSemaphoreTake(event->handle, portMAX_DELAY);
+    vSemaphoreDelete(event->handle);
+}
+
+#endif
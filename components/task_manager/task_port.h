@@ -0,0 +1,50 @@
+#ifndef TASK_PORT_H
+#define TASK_PORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+
+// Everything the task manager needs from the OS. On the ESP32 this is FreeRTOS and
+// esp_timer, on the linux target it is a single threaded virtual clock that the
+// caller advances with the `task_sim_*` functions, see task_sim.h.
+
+#if CONFIG_IDF_TARGET_LINUX
+typedef struct {
+    volatile bool is_set;
+} task_port_event_t;
+#else
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+typedef struct {
+    StaticSemaphore_t buf;
+    SemaphoreHandle_t handle;
+} task_port_event_t;
+#endif
+
+#define TASK_PORT_NO_DEADLINE INT64_MAX
+
+int64_t task_port_now(void);
+time_t task_port_wall_time(void);
+uint32_t task_port_cycles(void);
+
+esp_err_t task_port_start(void (*dispatcher)(void*));
+void task_port_wait(int64_t deadline);
+esp_err_t task_port_notify(void);
+esp_err_t task_port_notify_ISR(void);
+
+void task_port_lock(void);
+void task_port_unlock(void);
+
+void task_port_event_init(task_port_event_t* event);
+void task_port_event_set(task_port_event_t* event);
+void task_port_event_wait(task_port_event_t* event);
+
+// Implemented by task_manager.c. Runs one pass of the dispatcher and returns
+// the next deadline, so a virtual clock can step it directly.
+int64_t task_dispatch_once(void);
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <nvs.h>
+
+#include "task_store.h"
+
+static const char* TAG = "Task Store";
+static nvs_handle_t storage_handle;
+
+esp_err_t task_store_open(void) {
+    esp_err_t err = nvs_open(TASK_STORE_NAMESPACE, NVS_READWRITE, &storage_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_open`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+// The blob being built by `task_store_save_begin`, header first and the records after it
+static uint8_t* save_buf = NULL;
+static uint16_t save_count = 0;
+
+/**
+ * @brief Restores the whole task table with a single `nvs_get_blob` call into a buffer
+ * sized for what is stored, and hands each record to `restore` straight from there.
+ */
+esp_err_t task_store_load(uint16_t max_count, task_store_restore_t restore, void* arg) {
+    size_t length = 0;
+    esp_err_t err = nvs_get_blob(storage_handle, TASK_STORE_KEY, NULL, &length);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_get_blob` for %s. Error: %s", TASK_STORE_KEY, esp_err_to_name(err));
+        return err;
+    }
+
+    task_store_header_t header;
+    if (length < sizeof(header)) {
+        ESP_LOGW(TAG, "Stored task table is truncated, ignoring it");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t* buf = malloc(length);
+    if (buf == NULL) return ESP_ERR_NO_MEM;
+
+    err = nvs_get_blob(storage_handle, TASK_STORE_KEY, buf, &length);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_get_blob` for %s. Error: %s", TASK_STORE_KEY, esp_err_to_name(err));
+        free(buf);
+        return err;
+    }
+    memcpy(&header, buf, sizeof(header));
+
+    if (header.magic != TASK_STORE_MAGIC) {
+        ESP_LOGW(TAG, "Stored task table has a bad magic, ignoring it");
+        free(buf);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    size_t record_size;
+    switch (header.version) {
+        case 1:
+            record_size = sizeof(task_store_record_v1_t);
+            break;
+        case TASK_STORE_VERSION:
+            record_size = sizeof(task_store_record_t);
+            break;
+        default:
+            ESP_LOGW(TAG, "Stored task table has unknown version %u, ignoring it", header.version);
+            free(buf);
+            return ESP_ERR_INVALID_VERSION;
+    }
+
+    if (header.count > max_count || length != sizeof(header) + header.count * record_size) {
+        ESP_LOGW(TAG, "Stored task table length doesn't match its count of %u", header.count);
+        free(buf);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const uint8_t* at = buf + sizeof(header);
+    if (header.version == 1) {
+        // Version 1 had no generations, start every restored slot at 1
+        for (int i=0; i<header.count; i++) {
+            task_store_record_v1_t old;
+            memcpy(&old, at + i * sizeof(old), sizeof(old));
+
+            task_store_record_t record = {
+                .id = old.id,
+                .generation = 1,
+                .type = old.type,
+                .flags = old.flags,
+            };
+            memcpy(record.raw, old.raw, sizeof(old.raw));
+            restore(&record, arg);
+        }
+        ESP_LOGI(TAG, "Migrated %u stored tasks from version 1", header.count);
+    } else {
+        for (int i=0; i<header.count; i++) {
+            restore((const task_store_record_t*)(at + i * sizeof(task_store_record_t)), arg);
+        }
+    }
+
+    free(buf);
+    return ESP_OK;
+}
+
+task_store_record_t* task_store_save_begin(uint16_t count) {
+    free(save_buf);
+    save_count = count;
+    // One byte more so an empty table still gets a buffer
+    save_buf = malloc(sizeof(task_store_header_t) + (size_t)count * sizeof(task_store_record_t) + 1);
+    if (save_buf == NULL) return NULL;
+
+    return (task_store_record_t*)(save_buf + sizeof(task_store_header_t));
+}
+
+esp_err_t task_store_save(void) {
+    if (save_buf == NULL) return ESP_ERR_INVALID_STATE;
+
+    task_store_header_t header = {
+        .magic = TASK_STORE_MAGIC,
+        .version = TASK_STORE_VERSION,
+        .count = save_count,
+    };
+    memcpy(save_buf, &header, sizeof(header));
+
+    size_t length = sizeof(header) + (size_t)save_count * sizeof(task_store_record_t);
+    esp_err_t err = nvs_set_blob(storage_handle, TASK_STORE_KEY, save_buf, length);
+    free(save_buf);
+    save_buf = NULL;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_set_blob` for %s. Error: %s", TASK_STORE_KEY, esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_commit(storage_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_commit`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t task_store_get_timezone(char* timezone, size_t length) {
+    esp_err_t err = nvs_get_str(storage_handle, TASK_STORE_TIMEZONE_KEY, timezone, &length);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Error running `nvs_get_str` for %s. Error: %s", TASK_STORE_TIMEZONE_KEY, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t task_store_set_timezone(const char* timezone) {
+    esp_err_t err = nvs_set_str(storage_handle, TASK_STORE_TIMEZONE_KEY, timezone);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_set_str` for %s. Error: %s", TASK_STORE_TIMEZONE_KEY, esp_err_to_name(err));
+        return err;
+    }
+
+    return nvs_commit(storage_handle);
+}
+
+/**
+ * @brief Counts boots, 1 to 255 and round again, so every boot can hand out handles no
+ * recent boot has.
+ */
+esp_err_t task_store_next_epoch(uint8_t* epoch) {
+    uint8_t last = 0;
+    esp_err_t err = nvs_get_u8(storage_handle, TASK_STORE_EPOCH_KEY, &last);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Error running `nvs_get_u8` for %s. Error: %s", TASK_STORE_EPOCH_KEY, esp_err_to_name(err));
+        return err;
+    }
+
+    *epoch = (last == UINT8_MAX) ? 1 : last + 1;
+
+    err = nvs_set_u8(storage_handle, TASK_STORE_EPOCH_KEY, *epoch);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_set_u8` for %s. Error: %s", TASK_STORE_EPOCH_KEY, esp_err_to_name(err));
+        return err;
+    }
+
+    return nvs_commit(storage_handle);
+}
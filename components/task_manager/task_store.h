@@ -0,0 +1,84 @@
+#ifndef TASK_STORE_H
+#define TASK_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#include "task_manager.h"
+
+#define TASK_STORE_NAMESPACE "task_details"
+#define TASK_STORE_KEY "task_table"
+#define TASK_STORE_TIMEZONE_KEY "timezone"
+#define TASK_STORE_EPOCH_KEY "boot_epoch"
+#define TASK_STORE_MAGIC 0x4B534154 // "TASK"
+#define TASK_STORE_VERSION 2
+
+#define TASK_STORE_FLAG_ENABLED (1 << 0)
+// A one time task added as "in X", its `at` moves with wall clock steps
+#define TASK_STORE_FLAG_RELATIVE (1 << 1)
+
+// Everything below is written to flash as-is, so the layout must never change
+// without bumping TASK_STORE_VERSION and adding a migration in `task_store_load`.
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+} task_store_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t id;
+    uint16_t generation;
+    uint8_t type;
+    uint8_t flags;
+    union __attribute__((packed)) {
+        struct __attribute__((packed)) {
+            uint8_t mode;
+            uint8_t hour;
+            uint8_t minute;
+            uint8_t reserved;
+            uint16_t interval_min;
+        } repeating;
+        struct __attribute__((packed)) {
+            int64_t at;
+        } one_time;
+        struct __attribute__((packed)) {
+            uint8_t work_min;
+            uint8_t short_break_min;
+            uint8_t long_break_min;
+            uint8_t rounds;
+        } pomodoro;
+        uint8_t raw[8];
+    };
+} task_store_record_t;
+
+_Static_assert(sizeof(task_store_record_t) == 14, "task_store_record_t layout changed");
+
+// Version 1 records, from before tasks had generation counted handles
+typedef struct __attribute__((packed)) {
+    uint16_t id;
+    uint8_t type;
+    uint8_t flags;
+    uint8_t raw[8];
+} task_store_record_v1_t;
+
+_Static_assert(sizeof(task_store_record_v1_t) == 12, "task_store_record_v1_t layout changed");
+
+esp_err_t task_store_open(void);
+typedef void (*task_store_restore_t)(const task_store_record_t* record, void* arg);
+
+esp_err_t task_store_load(uint16_t max_count, task_store_restore_t restore, void* arg);
+
+/**
+ * @brief Allocates the blob for a table of `count` records and returns where they go, so
+ * they are packed straight into what gets written. `task_store_save` writes and frees it.
+ * Returns NULL if there isn't the memory.
+ */
+task_store_record_t* task_store_save_begin(uint16_t count);
+esp_err_t task_store_save(void);
+esp_err_t task_store_get_timezone(char* timezone, size_t length);
+esp_err_t task_store_set_timezone(const char* timezone);
+esp_err_t task_store_next_epoch(uint8_t* epoch);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include <power_manager.h>
+
+#include "wifi_manager.h"
+#include "wifi_api.h"
+#include "wifi_sta.h"
+#include "wifi_scan.h"
+#include "wifi_job.h"
+#include "wifi_profile.h"
+
+// Replaces glibc's allocator for the whole program, so allocations made inside libc
+// on the handlers' behalf, like strdup's, are counted as well
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+static bool is_counting = false;
+static int allocs = 0;
+
+void* malloc(size_t size) {
+    if (is_counting) allocs++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (is_counting) allocs++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (is_counting) allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+// Everything wifi_api.c calls outside itself, kept in statics the tests set up
+
+static wifi_scan_ap_t fake_aps[2] = {
+    { .ssid = "Home", .channel = 6, .rssi = -48, .authmode = WIFI_AUTH_WPA2_PSK },
+    { .ssid = "Cafe", .channel = 11, .rssi = -71, .authmode = WIFI_AUTH_OPEN },
+};
+static int scan_refreshes = 0;
+
+static wifi_job_t fake_job;
+static wifi_profile_t fake_profiles[WIFI_PROFILE_MAX];
+static uint8_t fake_profile_count = 0;
+
+int64_t esp_timer_get_time(void) {
+    return 1000 * 1000;
+}
+
+esp_err_t wifi_scan_refresh(void) {
+    scan_refreshes++;
+    return ESP_OK;
+}
+
+uint8_t wifi_scan_get(wifi_scan_ap_t* aps, int64_t* age_ms) {
+    memcpy(aps, fake_aps, sizeof(fake_aps));
+    *age_ms = 1500;
+    return 2;
+}
+
+bool wifi_scan_is_running(void) {
+    return scan_refreshes > 0;
+}
+
+esp_err_t wifi_job_start(const char* ssid, const char* password, uint32_t* id) {
+    memset(&fake_job, 0, sizeof(fake_job));
+    fake_job.id = 7;
+    fake_job.version = 1;
+    fake_job.state = WIFI_JOB_CONNECTING;
+    snprintf(fake_job.ssid, sizeof(fake_job.ssid), "%s", ssid);
+    *id = fake_job.id;
+    return ESP_OK;
+}
+
+esp_err_t wifi_job_get(uint32_t id, wifi_job_t* job) {
+    if (fake_job.id == 0 || id != fake_job.id) return ESP_ERR_NOT_FOUND;
+
+    *job = fake_job;
+    return ESP_OK;
+}
+
+esp_err_t wifi_job_wait(uint32_t id, uint32_t version, uint32_t timeout_ms, wifi_job_t* job) {
+    return wifi_job_get(id, job);
+}
+
+esp_err_t wifi_get_stats(wifi_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->state = WIFI_STATE_ONLINE;
+    stats->connects = 1;
+    return ESP_OK;
+}
+
+const char* wifi_state_name(wifi_state_t state) {
+    static const char* names[WIFI_STATE_MAX] = { "idle", "connecting", "associated", "online", "backoff" };
+    return (state < WIFI_STATE_MAX) ? names[state] : "unknown";
+}
+
+uint8_t wifi_profile_list(wifi_profile_t* profiles) {
+    memcpy(profiles, fake_profiles, fake_profile_count * sizeof(wifi_profile_t));
+    return fake_profile_count;
+}
+
+esp_err_t wifi_profile_save(const char* ssid, const char* password, int priority) {
+    if (ssid[0] == '\0') return ESP_ERR_INVALID_ARG;
+
+    for (int i=0; i<fake_profile_count; i++) {
+        if (strcmp(fake_profiles[i].ssid, ssid) == 0) {
+            if (priority >= 0) fake_profiles[i].priority = priority;
+            return ESP_OK;
+        }
+    }
+    if (fake_profile_count == WIFI_PROFILE_MAX) return ESP_ERR_NO_MEM;
+
+    wifi_profile_t* profile = &fake_profiles[fake_profile_count++];
+    memset(profile, 0, sizeof(*profile));
+    snprintf(profile->ssid, sizeof(profile->ssid), "%s", ssid);
+    snprintf(profile->password, sizeof(profile->password), "%s", password);
+    profile->priority = (priority >= 0) ? priority : 0;
+    return ESP_OK;
+}
+
+esp_err_t wifi_profile_delete(const char* ssid) {
+    for (int i=0; i<fake_profile_count; i++) {
+        if (strcmp(fake_profiles[i].ssid, ssid) == 0) {
+            fake_profiles[i] = fake_profiles[--fake_profile_count];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t power_get_stats(power_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->state = POWER_STATE_IDLE;
+    stats->next_deadline = POWER_NO_DEADLINE;
+    return ESP_OK;
+}
+
+const char* power_state_name(power_state_t state) {
+    static const char* names[POWER_STATE_MAX] = { "active", "idle", "light_sleep" };
+    return names[state];
+}
+
+const char* power_client_name(power_client_t client) {
+    static const char* names[POWER_CLIENT_MAX] = { "tasks", "led", "http" };
+    return names[client];
+}
+
+static fake_httpd_resp_t resp;
+
+/**
+ * @brief Runs one request and fails the test if its handler allocated anything.
+ */
+static void api_request(httpd_method_t method, const char* uri, const char* header, const char* body,
+                        const char* status) {
+    allocs = 0;
+    is_counting = true;
+    esp_err_t err = fake_httpd_request(method, uri, header, body, &resp);
+    is_counting = false;
+
+    TEST_ESP_OK(err);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(status, resp.status, uri);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocs, uri);
+}
+
+static void api_start(void) {
+    memset(&fake_job, 0, sizeof(fake_job));
+    fake_profile_count = 0;
+    scan_refreshes = 0;
+
+    fake_httpd_reset();
+    TEST_ESP_OK(wifi_api_register(NULL));
+}
+
+static void test_handlers_do_not_allocate(void) {
+    api_start();
+
+    api_request(HTTP_GET, "/api/get_ssids", NULL, NULL, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"ssid\":\"Home\""));
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"auth\":\"open\""));
+    api_request(HTTP_GET, "/api/get_ssids?refresh=1", NULL, NULL, "200 OK");
+    TEST_ASSERT_EQUAL(1, scan_refreshes);
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"scanning\":true"));
+
+    api_request(HTTP_POST, "/api/connect", NULL, "{\"ssid\":\"Home\",\"password\":\"hunter22\"}", "202 Accepted");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"state\":\"connecting\""));
+    api_request(HTTP_GET, "/api/connect/7", NULL, NULL, "200 OK");
+    api_request(HTTP_GET, "/api/connect/7?since=0&wait=0", NULL, NULL, "200 OK");
+
+    // A stream that has already seen the end is told to stop reconnecting
+    fake_job.state = WIFI_JOB_CONNECTED;
+    fake_job.version = 3;
+    api_request(HTTP_GET, "/api/connect/7", "Accept: text/event-stream\nLast-Event-ID: 3", NULL, "204 No Content");
+
+    api_request(HTTP_GET, "/api/wifi_status", NULL, NULL, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"state\":\"online\""));
+    api_request(HTTP_GET, "/api/power_status", NULL, NULL, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"next_deadline_ms\":null"));
+
+    api_request(HTTP_POST, "/api/networks", NULL, "{\"ssid\":\"Home\",\"password\":\"hunter22\",\"priority\":2}", "200 OK");
+    api_request(HTTP_POST, "/api/networks", NULL, "{\"ssid\":\"Cafe\",\"password\":\"\"}", "200 OK");
+    api_request(HTTP_GET, "/api/networks", NULL, NULL, "200 OK");
+    TEST_ASSERT_NOT_NULL(strstr(resp.body, "\"priority\":2"));
+    TEST_ASSERT_NULL(strstr(resp.body, "hunter22"));
+    api_request(HTTP_DELETE, "/api/networks", NULL, "{\"ssid\":\"Cafe\"}", "200 OK");
+    TEST_ASSERT_NULL(strstr(resp.body, "Cafe"));
+}
+
+static void test_errors_do_not_allocate(void) {
+    api_start();
+
+    api_request(HTTP_POST, "/api/connect", NULL, "{\"ssid\":", "400 Bad Request");
+    api_request(HTTP_POST, "/api/connect", NULL, "{\"ssid\":\"Home\"}", "400 Bad Request");
+    api_request(HTTP_POST, "/api/connect", NULL,
+                "{\"ssid\":\"Home\",\"password\":\"0123456789012345678901234567890123\"}", "400 Bad Request");
+    api_request(HTTP_GET, "/api/connect/7", NULL, NULL, "404 Not Found");
+    api_request(HTTP_GET, "/api/connect/x", NULL, NULL, "404 Not Found");
+    api_request(HTTP_POST, "/api/networks", NULL, "{\"password\":\"hunter22\"}", "400 Bad Request");
+    api_request(HTTP_POST, "/api/networks", NULL, "{\"ssid\":\"Home\",\"priority\":300}", "400 Bad Request");
+    api_request(HTTP_DELETE, "/api/networks", NULL, "{\"ssid\":\"Nowhere\"}", "404 Not Found");
+}
+
+void app_main(void) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_handlers_do_not_allocate);
+    RUN_TEST(test_errors_do_not_allocate);
+    exit(UNITY_END());
+}
@@ -1,12 +1,16 @@
 #ifndef WIFI_MANAGER_H
 #define WIFI_MANAGER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
 #include <esp_http_server.h>
 
 #define PATH_MAX_LENGTH ESP_VFS_PATH_MAX+128
 #define SCRATCH_BUFSIZE (10240)
 #define DEFAULT_SCAN_LIST_SIZE 24
 #define PING_WAIT_DELAY_MS 250
+#define WIFI_API_MAX_BODY 256
 #define HOSTNAME "pomo"
 
 #ifndef MAC2STR
@@ -14,6 +18,61 @@
 #define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
 #endif
 
+typedef enum {
+    WIFI_STATE_IDLE,
+    WIFI_STATE_CONNECTING,
+    // Associated with the AP, waiting on DHCP
+    WIFI_STATE_ASSOCIATED,
+    // Has an IP, the only state the station is usable in
+    WIFI_STATE_ONLINE,
+    // Lost the network and waiting to try it again
+    WIFI_STATE_BACKOFF,
+    WIFI_STATE_MAX,
+} wifi_state_t;
+
+/**
+ * @brief The ways a connect can start out, see `wifi_connect_to_configured_ap`.
+ */
+typedef enum {
+    WIFI_PATH_FULL,  // Scans every channel for the network
+    WIFI_PATH_FAST,  // Straight to the AP and channel that worked last time
+    WIFI_PATH_MAX,
+} wifi_path_t;
+
+typedef struct {
+    uint32_t connects;
+    uint32_t failures;
+    // Time to IP, from the start of the connect
+    uint32_t last_ms;
+    uint32_t best_ms;
+} wifi_path_stats_t;
+
+typedef struct {
+    wifi_state_t state;
+    uint32_t state_ms;
+    // Total time spent in each state, including the current one so far
+    uint32_t time_in_state_ms[WIFI_STATE_MAX];
+    // Boot to the first IP, 0 until there is one
+    uint32_t boot_to_online_ms;
+    // Start of the last connect to its IP
+    uint32_t connect_ms;
+    uint32_t connects;
+    // Times an online station lost its network
+    uint32_t disconnects;
+    uint32_t reconnect_attempts;
+    // Losing the network to having an IP again
+    uint32_t last_reconnect_ms;
+    uint32_t max_reconnect_ms;
+    uint8_t last_reason;
+    wifi_path_stats_t paths[WIFI_PATH_MAX];
+    // Picking a known network and getting an IP from it, timed from boot's first connect
+    // or from losing the last network
+    uint32_t recoveries;
+    uint32_t last_recover_ms;
+    // Networks tried by the last recovery before one worked
+    uint8_t last_candidates;
+} wifi_stats_t;
+
 esp_err_t wifi_init(void);
 bool wifi_is_configured(void);
 esp_err_t wifi_reset_config_ISR(void);
@@ -21,5 +80,6 @@ esp_err_t wifi_connect_to_ap(const char ssid[32], const char password[32]);
 esp_err_t wifi_connect_to_configured_ap(void);
 esp_err_t wifi_start_ap(void);
 esp_err_t wifi_start_http_server(void);
+esp_err_t wifi_get_stats(wifi_stats_t* stats);
 
 #endif
\ No newline at end of file
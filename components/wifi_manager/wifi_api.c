@@ -0,0 +1,559 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <http_json.h>
+#include <power_manager.h>
+
+#include "wifi_manager.h"
+#include "wifi_api.h"
+#include "wifi_sta.h"
+#include "wifi_scan.h"
+#include "wifi_job.h"
+#include "wifi_profile.h"
+
+static const char* TAG = "Wifi API";
+
+static const char* api_auth_name(wifi_auth_mode_t authmode) {
+    switch (authmode) {
+        case WIFI_AUTH_OPEN: return "open";
+        case WIFI_AUTH_WEP: return "wep";
+        case WIFI_AUTH_WPA_PSK: return "wpa";
+        case WIFI_AUTH_WPA2_PSK: return "wpa2";
+        case WIFI_AUTH_WPA_WPA2_PSK: return "wpa/wpa2";
+        case WIFI_AUTH_WPA2_ENTERPRISE: return "wpa2-enterprise";
+        case WIFI_AUTH_WPA3_PSK: return "wpa3";
+        case WIFI_AUTH_WPA2_WPA3_PSK: return "wpa2/wpa3";
+        default: return "unknown";
+    }
+}
+
+// Served from the scan cache so the request never waits on the radio. `?refresh=1` starts
+// a new scan for the next request, `scanning` tells the client one is still running.
+static esp_err_t api_get_ssids_handler(httpd_req_t* req) {
+    char query[32];
+    char value[4];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "refresh", value, sizeof(value)) == ESP_OK &&
+        strcmp(value, "1") == 0) {
+        wifi_scan_refresh();
+    }
+
+    wifi_scan_ap_t aps[DEFAULT_SCAN_LIST_SIZE];
+    int64_t age_ms;
+    uint8_t count = wifi_scan_get(aps, &age_ms);
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_array(&json, "ssids");
+    for (int i=0; i<count; i++) {
+        json_write_object(&json, NULL);
+        json_write_string(&json, "ssid", aps[i].ssid);
+        json_write_bool(&json, "is_open", aps[i].authmode == WIFI_AUTH_OPEN);
+        json_write_int(&json, "rssi", aps[i].rssi);
+        json_write_int(&json, "channel", aps[i].channel);
+        json_write_string(&json, "auth", api_auth_name(aps[i].authmode));
+        json_write_end(&json);
+    }
+    json_write_end(&json);
+
+    if (age_ms < 0) {
+        json_write_null(&json, "age_ms");
+    } else {
+        json_write_int(&json, "age_ms", age_ms);
+    }
+    json_write_bool(&json, "scanning", wifi_scan_is_running());
+    json_write_end(&json);
+
+    return json_writer_finish(&json);
+}
+
+static const char* api_job_state_name(wifi_job_state_t state) {
+    switch (state) {
+        case WIFI_JOB_CONNECTING: return "connecting";
+        case WIFI_JOB_ASSOCIATED: return "associated";
+        case WIFI_JOB_CONNECTED: return "connected";
+        default: return "failed";
+    }
+}
+
+static void api_write_job(json_writer_t* json, const wifi_job_t* job) {
+    json_write_object(json, NULL);
+    json_write_int(json, "id", job->id);
+    json_write_int(json, "version", job->version);
+    json_write_string(json, "ssid", job->ssid);
+    json_write_string(json, "state", api_job_state_name(job->state));
+    if (job->state == WIFI_JOB_FAILED) json_write_int(json, "reason", job->reason);
+    json_write_int(json, "elapsed_ms", job->elapsed_ms);
+    json_write_end(json);
+}
+
+static esp_err_t api_send_job(httpd_req_t* req, const wifi_job_t* job) {
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    api_write_job(&json, job);
+    return json_writer_finish(&json);
+}
+
+// Body of the requests that name a network, `{"ssid": "...", "password": "...", "priority": 0}`
+typedef struct {
+    char ssid[33];
+    char password[65];
+    int priority;
+    bool has_ssid;
+    bool has_password;
+    // Set if any member was there but unusable, like a password that's too long
+    bool is_invalid;
+} api_network_t;
+
+static void api_network_field(const json_parser_t* parser, const json_event_t* event, void* ctx) {
+    api_network_t* network = ctx;
+    if (event->depth != 1 || event->key == NULL || event->type == JSON_END) return;
+
+    if (strcmp(event->key, "ssid") == 0) {
+        network->has_ssid = json_event_copy(event, network->ssid, sizeof(network->ssid));
+        network->is_invalid |= !network->has_ssid;
+    } else if (strcmp(event->key, "password") == 0) {
+        network->has_password = json_event_copy(event, network->password, sizeof(network->password));
+        network->is_invalid |= !network->has_password;
+    } else if (strcmp(event->key, "priority") == 0) {
+        bool is_valid = event->type == JSON_NUMBER && event->number >= 0 && event->number <= UINT8_MAX;
+        if (is_valid) network->priority = event->number;
+        network->is_invalid |= !is_valid;
+    }
+}
+
+static esp_err_t api_recv_network(httpd_req_t* req, api_network_t* network) {
+    memset(network, 0, sizeof(*network));
+    network->priority = -1;
+    return http_json_recv(req, WIFI_API_MAX_BODY, api_network_field, network);
+}
+
+static esp_err_t api_post_connect_to_ap(httpd_req_t* req) {
+    ESP_LOGI(TAG, "Got request to /connect endpoint");
+
+    // Body is `{"ssid": "TheSSIDHere", "password": "ThePasswordHere"}`
+    api_network_t network;
+    if (api_recv_network(req, &network) != ESP_OK) return ESP_FAIL;
+
+    // `wifi_connect_to_ap` takes at most 32 characters of password
+    if (!network.has_ssid || !network.has_password || network.is_invalid || strlen(network.password) > 32) {
+        ESP_LOGW(TAG, "Error getting SSID and password from JSON");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+        return ESP_FAIL;
+    }
+
+    // Returns as soon as the attempt has started, the client follows it with
+    // GET /api/connect/<id>
+    uint32_t id;
+    esp_err_t err = wifi_job_start(network.ssid, network.password, &id);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error connecting to wifi.");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+        return ESP_FAIL;
+    }
+
+    wifi_job_t job;
+    wifi_job_get(id, &job);
+    httpd_resp_set_status(req, "202 Accepted");
+    return api_send_job(req, &job);
+}
+
+static bool api_get_query_u32(const char* query, const char* key, uint32_t* value) {
+    char str[12];
+    if (httpd_query_key_value(query, key, str, sizeof(str)) != ESP_OK) return false;
+
+    char* end;
+    *value = strtoul(str, &end, 10);
+    return end != str && *end == '\0';
+}
+
+// Waiting on a connect job can take up to WIFI_JOB_MAX_WAIT_MS, far too long to hold the
+// HTTP server's only worker. Those requests are handed to their own tasks instead, with
+// `httpd_req_async_handler_begin` keeping the connection open until they've answered.
+#define API_JOB_WAITERS 2
+_Static_assert(API_JOB_WAITERS <= WIFI_JOB_MAX_WAITERS, "Every waiter task has to fit in wifi_job_wait");
+
+typedef struct {
+    httpd_req_t* req;
+    uint32_t id;
+    uint32_t version;
+    uint32_t wait_ms;
+    bool has_version;
+    bool is_stream;
+} api_job_wait_t;
+
+static QueueHandle_t api_job_waits;
+
+/**
+ * @brief Sends the job's state as Server-Sent Events, each one a `job` event with the
+ * version as its id.
+ */
+static esp_err_t api_stream_job(httpd_req_t* req, uint32_t id, uint32_t version, bool has_version) {
+    wifi_job_t job;
+    esp_err_t err = wifi_job_get(id, &job);
+    if (err != ESP_OK) return httpd_resp_send_404(req);
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    json_writer_t json;
+    json_writer_init(&json, req);
+    json_write_raw(&json, "retry: 250\n\n");
+
+    // A stream is cut off after WIFI_JOB_MAX_WAIT_MS so a client that went away doesn't
+    // keep a waiter forever. EventSource reconnects with Last-Event-ID and carries on.
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        if (!has_version || job.version != version) {
+            char id_line[24];
+            snprintf(id_line, sizeof(id_line), "id: %u\n", job.version);
+            json_write_raw(&json, id_line);
+            json_write_raw(&json, "event: job\ndata: ");
+            api_write_job(&json, &job);
+            json_write_raw(&json, "\n\n");
+            if (json_writer_flush(&json) != ESP_OK) return ESP_FAIL;
+
+            version = job.version;
+            has_version = true;
+        }
+
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (wifi_job_is_finished(&job) || waited >= pdMS_TO_TICKS(WIFI_JOB_MAX_WAIT_MS)) break;
+
+        err = wifi_job_wait(id, version, WIFI_JOB_MAX_WAIT_MS - pdTICKS_TO_MS(waited), &job);
+        if (err != ESP_OK) break;
+    }
+
+    return json_writer_finish(&json);
+}
+
+static void api_job_waiter(void* arg) {
+    api_job_wait_t wait;
+    while (true) {
+        xQueueReceive(api_job_waits, &wait, portMAX_DELAY);
+
+        if (wait.is_stream) {
+            api_stream_job(wait.req, wait.id, wait.version, wait.has_version);
+        } else {
+            wifi_job_t job;
+            if (wifi_job_wait(wait.id, wait.version, wait.wait_ms, &job) == ESP_OK) {
+                api_send_job(wait.req, &job);
+            } else {
+                httpd_resp_send_404(wait.req);
+            }
+        }
+
+        httpd_req_async_handler_complete(wait.req);
+    }
+}
+
+esp_err_t wifi_api_init(void) {
+    api_job_waits = xQueueCreate(API_JOB_WAITERS, sizeof(api_job_wait_t));
+    if (api_job_waits == NULL) return ESP_ERR_NO_MEM;
+
+    for (int i=0; i<API_JOB_WAITERS; i++) {
+        if (xTaskCreate(api_job_waiter, "Wifi Job Waiter", 4096, NULL, tskIDLE_PRIORITY + 5, NULL) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t api_send_busy(httpd_req_t* req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+/**
+ * @brief Hands the request to a waiter task and returns straight away, or answers 503
+ * if every waiter already has a queued request.
+ */
+static esp_err_t api_defer_job_wait(httpd_req_t* req, api_job_wait_t* wait) {
+    // Only this handler feeds the queue, so the space can't go between here and the send
+    if (uxQueueSpacesAvailable(api_job_waits) == 0) return api_send_busy(req);
+
+    esp_err_t err = httpd_req_async_handler_begin(req, &wait->req);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `httpd_req_async_handler_begin`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    xQueueSend(api_job_waits, wait, 0);
+    return ESP_OK;
+}
+
+// GET /api/connect/<id> gives the job's state. `?since=<version>&wait=<ms>` long-polls,
+// answering as soon as the job moves past that version. Asking for text/event-stream
+// streams every change instead.
+static esp_err_t api_get_connect_job(httpd_req_t* req) {
+    char* end;
+    const char* start = req->uri + strlen("/api/connect/");
+    uint32_t id = strtoul(start, &end, 10);
+    if (end == start || (*end != '\0' && *end != '?')) return httpd_resp_send_404(req);
+
+    wifi_job_t job;
+    if (wifi_job_get(id, &job) != ESP_OK) return httpd_resp_send_404(req);
+
+    api_job_wait_t wait = {
+        .id = id,
+        .wait_ms = WIFI_JOB_MAX_WAIT_MS,
+    };
+
+    char accept[64];
+    if (httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept)) != ESP_ERR_NOT_FOUND &&
+        strstr(accept, "text/event-stream") != NULL) {
+        char last_id[12];
+        wait.is_stream = true;
+        wait.has_version = httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_id, sizeof(last_id)) == ESP_OK;
+        wait.version = wait.has_version ? strtoul(last_id, NULL, 10) : 0;
+
+        // Nothing left to tell a client that has seen the end, a 204 stops EventSource reconnecting
+        if (wait.has_version && job.version == wait.version && wifi_job_is_finished(&job)) {
+            httpd_resp_set_status(req, "204 No Content");
+            return httpd_resp_send(req, NULL, 0);
+        }
+
+        return api_defer_job_wait(req, &wait);
+    }
+
+    char query[48];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        wait.has_version = api_get_query_u32(query, "since", &wait.version);
+        api_get_query_u32(query, "wait", &wait.wait_ms);
+        if (wait.wait_ms > WIFI_JOB_MAX_WAIT_MS) wait.wait_ms = WIFI_JOB_MAX_WAIT_MS;
+    }
+
+    // Answer here when there's nothing to wait for, only a real wait goes to a waiter
+    if (!wait.has_version || wait.wait_ms == 0 || job.version != wait.version || wifi_job_is_finished(&job)) {
+        return api_send_job(req, &job);
+    }
+
+    return api_defer_job_wait(req, &wait);
+}
+
+static esp_err_t api_get_wifi_status(httpd_req_t* req) {
+    wifi_stats_t stats;
+    wifi_get_stats(&stats);
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_string(&json, "state", wifi_state_name(stats.state));
+    json_write_int(&json, "state_ms", stats.state_ms);
+
+    json_write_object(&json, "time_in_state_ms");
+    for (int i=0; i<WIFI_STATE_MAX; i++) {
+        json_write_int(&json, wifi_state_name(i), stats.time_in_state_ms[i]);
+    }
+    json_write_end(&json);
+
+    json_write_int(&json, "boot_to_online_ms", stats.boot_to_online_ms);
+    json_write_int(&json, "connect_ms", stats.connect_ms);
+    json_write_int(&json, "connects", stats.connects);
+    json_write_int(&json, "disconnects", stats.disconnects);
+    json_write_int(&json, "reconnect_attempts", stats.reconnect_attempts);
+    json_write_int(&json, "last_reconnect_ms", stats.last_reconnect_ms);
+    json_write_int(&json, "max_reconnect_ms", stats.max_reconnect_ms);
+    json_write_int(&json, "last_reason", stats.last_reason);
+
+    static const char* path_names[WIFI_PATH_MAX] = { "full", "fast" };
+    json_write_object(&json, "paths");
+    for (int i=0; i<WIFI_PATH_MAX; i++) {
+        json_write_object(&json, path_names[i]);
+        json_write_int(&json, "connects", stats.paths[i].connects);
+        json_write_int(&json, "failures", stats.paths[i].failures);
+        json_write_int(&json, "last_ms", stats.paths[i].last_ms);
+        json_write_int(&json, "best_ms", stats.paths[i].best_ms);
+        json_write_end(&json);
+    }
+    json_write_end(&json);
+
+    json_write_int(&json, "recoveries", stats.recoveries);
+    json_write_int(&json, "last_recover_ms", stats.last_recover_ms);
+    json_write_int(&json, "last_candidates", stats.last_candidates);
+    json_write_end(&json);
+
+    return json_writer_finish(&json);
+}
+
+static esp_err_t api_get_power_status(httpd_req_t* req) {
+    power_stats_t stats;
+    power_get_stats(&stats);
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_string(&json, "state", power_state_name(stats.state));
+
+    json_write_object(&json, "residency_ms");
+    for (int i=0; i<POWER_STATE_MAX; i++) {
+        json_write_int(&json, power_state_name(i), stats.residency_us[i] / 1000);
+    }
+    json_write_end(&json);
+
+    json_write_int(&json, "sleeps", stats.sleeps);
+    if (stats.next_deadline == POWER_NO_DEADLINE) {
+        json_write_null(&json, "next_deadline_ms");
+    } else {
+        json_write_int(&json, "next_deadline_ms", (stats.next_deadline - esp_timer_get_time()) / 1000);
+    }
+
+    json_write_object(&json, "clients");
+    for (int i=0; i<POWER_CLIENT_MAX; i++) {
+        json_write_object(&json, power_client_name(i));
+        json_write_int(&json, "acquires", stats.acquires[i]);
+        json_write_int(&json, "wakeups", stats.wakeups[i]);
+        json_write_end(&json);
+    }
+    json_write_end(&json);
+    json_write_end(&json);
+
+    return json_writer_finish(&json);
+}
+
+// Passwords are never sent back
+static esp_err_t api_send_networks(httpd_req_t* req) {
+    wifi_profile_t profiles[WIFI_PROFILE_MAX];
+    uint8_t count = wifi_profile_list(profiles);
+
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_array(&json, "networks");
+    for (int i=0; i<count; i++) {
+        json_write_object(&json, NULL);
+        json_write_string(&json, "ssid", profiles[i].ssid);
+        json_write_int(&json, "priority", profiles[i].priority);
+        json_write_int(&json, "failures", profiles[i].failures);
+        json_write_int(&json, "last_success", profiles[i].last_success);
+        json_write_end(&json);
+    }
+    json_write_end(&json);
+    json_write_int(&json, "max", WIFI_PROFILE_MAX);
+    json_write_end(&json);
+
+    return json_writer_finish(&json);
+}
+
+static esp_err_t api_get_networks(httpd_req_t* req) {
+    return api_send_networks(req);
+}
+
+// Body is `{"ssid": "...", "password": "...", "priority": 0}`, `priority` is optional
+static esp_err_t api_post_network(httpd_req_t* req) {
+    api_network_t network;
+    if (api_recv_network(req, &network) != ESP_OK) return ESP_FAIL;
+
+    if (!network.has_ssid || network.is_invalid) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected ssid, password and priority");
+    }
+
+    esp_err_t err = wifi_profile_save(network.ssid, network.password, network.priority);
+    if (err == ESP_ERR_NO_MEM) return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No room for another network");
+    if (err == ESP_ERR_INVALID_ARG) return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid network");
+    if (err != ESP_OK) {
+        httpd_resp_send_500(req);
+        return err;
+    }
+
+    return api_send_networks(req);
+}
+
+// Body is `{"ssid": "..."}`, SSIDs can hold anything so they're kept out of the URI
+static esp_err_t api_delete_network(httpd_req_t* req) {
+    api_network_t network;
+    if (api_recv_network(req, &network) != ESP_OK) return ESP_FAIL;
+
+    if (!network.has_ssid) return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected ssid");
+
+    esp_err_t err = wifi_profile_delete(network.ssid);
+    if (err == ESP_ERR_NOT_FOUND) return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown network");
+    if (err != ESP_OK) {
+        httpd_resp_send_500(req);
+        return err;
+    }
+
+    return api_send_networks(req);
+}
+
+esp_err_t wifi_api_register(httpd_handle_t server) {
+    static const httpd_uri_t api_get_ssids = {
+        .uri = "/api/get_ssids",
+        .method = HTTP_GET,
+        .handler = api_get_ssids_handler,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_connect = {
+        .uri = "/api/connect",
+        .method = HTTP_POST,
+        .handler = api_post_connect_to_ap,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_connect_job = {
+        .uri = "/api/connect/*",
+        .method = HTTP_GET,
+        .handler = api_get_connect_job,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_wifi_status = {
+        .uri = "/api/wifi_status",
+        .method = HTTP_GET,
+        .handler = api_get_wifi_status,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_power_status = {
+        .uri = "/api/power_status",
+        .method = HTTP_GET,
+        .handler = api_get_power_status,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_networks = {
+        .uri = "/api/networks",
+        .method = HTTP_GET,
+        .handler = api_get_networks,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_add_network = {
+        .uri = "/api/networks",
+        .method = HTTP_POST,
+        .handler = api_post_network,
+        .user_ctx = NULL
+    };
+
+    static const httpd_uri_t api_remove_network = {
+        .uri = "/api/networks",
+        .method = HTTP_DELETE,
+        .handler = api_delete_network,
+        .user_ctx = NULL
+    };
+
+    const httpd_uri_t* handlers[] = {
+        &api_get_ssids, &api_connect, &api_connect_job, &api_wifi_status, &api_power_status,
+        &api_networks, &api_add_network, &api_remove_network,
+    };
+    for (int i=0; i<sizeof(handlers) / sizeof(handlers[0]); i++) {
+        esp_err_t err = httpd_register_uri_handler(server, handlers[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error registering %s. Error: %s", handlers[i]->uri, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
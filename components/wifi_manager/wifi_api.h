@@ -0,0 +1,31 @@
+#ifndef WIFI_API_H
+#define WIFI_API_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+// The JSON endpoints for scanning, connecting and the known networks, along with the
+// Wi-Fi and power status. The ones that restart the device or ping through the
+// station stay in wifi_manager.c.
+
+/**
+ * @brief Starts the tasks that answer requests waiting on a connect job.
+ */
+esp_err_t wifi_api_init(void);
+
+/**
+ * @brief Registers the endpoints. Must be called before any wildcard handler that would
+ * also match them.
+ *
+ * GET    /api/get_ssids     Networks from the last scan, `?refresh=1` starts a new one.
+ * POST   /api/connect       Start connecting to `{"ssid", "password"}`, answers the job.
+ * GET    /api/connect/<id>  The job's state, see `api_get_connect_job`.
+ * GET    /api/wifi_status   Station state and connect timings.
+ * GET    /api/power_status  Power state residency and wakeups.
+ * GET    /api/networks      The known networks, without their passwords.
+ * POST   /api/networks      Add or update a known network.
+ * DELETE /api/networks      Forget the known network named in the body.
+ */
+esp_err_t wifi_api_register(httpd_handle_t server);
+
+#endif
@@ -0,0 +1,162 @@
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <nvs.h>
+#include <sdkconfig.h>
+
+#include "wifi_manager.h"
+#include "wifi_fast.h"
+
+#define WIFI_FAST_KEY "wifi_fast"
+
+static const char* TAG = "Wifi Fast";
+
+static esp_netif_t* sta_netif;
+static nvs_handle_t fast_handle;
+
+static portMUX_TYPE fast_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_fast_t cache;
+static bool is_cached = false;
+
+static void wifi_fast_got_ip_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
+
+    wifi_ap_record_t ap;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&ap);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error running `esp_wifi_sta_get_ap_info`. Error: %s", esp_err_to_name(err));
+        return;
+    }
+
+    // Zeroed first so the compare below sees the same bytes for the same connection
+    wifi_fast_t fast;
+    memset(&fast, 0, sizeof(fast));
+    strncpy(fast.ssid, (const char*)ap.ssid, sizeof(fast.ssid) - 1);
+    memcpy(fast.bssid, ap.bssid, sizeof(fast.bssid));
+    fast.channel = ap.primary;
+    fast.ip = event->ip_info;
+
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) fast.dns.addr = dns.ip.u_addr.ip4.addr;
+
+    portENTER_CRITICAL_SAFE(&fast_lock);
+    bool is_changed = !is_cached || memcmp(&cache, &fast, sizeof(fast)) != 0;
+    cache = fast;
+    is_cached = true;
+    portEXIT_CRITICAL_SAFE(&fast_lock);
+
+    // Nothing is written on a boot that came back the same way, which is most of them
+    if (!is_changed) return;
+
+    ESP_LOGI(TAG, "Caching AP " MACSTR " on channel %u", MAC2STR(fast.bssid), fast.channel);
+
+    err = nvs_set_blob(fast_handle, WIFI_FAST_KEY, &fast, sizeof(fast));
+    if (err == ESP_OK) err = nvs_commit(fast_handle);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Error saving fast reconnect cache. Error: %s", esp_err_to_name(err));
+}
+
+esp_err_t wifi_fast_init(esp_netif_t* netif) {
+    sta_netif = netif;
+
+    esp_err_t err = nvs_open("wifi_details", NVS_READWRITE, &fast_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_open`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // A cache of another size was written by other firmware and is ignored
+    size_t size = sizeof(cache);
+    err = nvs_get_blob(fast_handle, WIFI_FAST_KEY, &cache, &size);
+    if (err == ESP_OK && size == sizeof(cache)) {
+        is_cached = true;
+    } else if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND && err != ESP_ERR_NVS_INVALID_LENGTH) {
+        ESP_LOGW(TAG, "Error loading fast reconnect cache. Error: %s", esp_err_to_name(err));
+    }
+
+    err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_fast_got_ip_handler, NULL, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error registering IP event handler. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_fast_get(const char* ssid, wifi_fast_t* fast) {
+    portENTER_CRITICAL_SAFE(&fast_lock);
+    bool is_found = is_cached && (ssid == NULL || strncmp(cache.ssid, ssid, sizeof(cache.ssid)) == 0);
+    if (is_found) *fast = cache;
+    portEXIT_CRITICAL_SAFE(&fast_lock);
+
+    return is_found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void wifi_fast_forget(void) {
+    portENTER_CRITICAL_SAFE(&fast_lock);
+    is_cached = false;
+    portEXIT_CRITICAL_SAFE(&fast_lock);
+
+    esp_err_t err = nvs_erase_key(fast_handle, WIFI_FAST_KEY);
+    if (err == ESP_OK) err = nvs_commit(fast_handle);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Error erasing fast reconnect cache. Error: %s", esp_err_to_name(err));
+    }
+}
+
+esp_err_t wifi_fast_set_ip(const wifi_fast_t* lease) {
+    esp_netif_ip_info_t ip;
+    esp_ip4_addr_t dns;
+    memset(&ip, 0, sizeof(ip));
+    memset(&dns, 0, sizeof(dns));
+
+#if CONFIG_WIFI_MANAGER_STATIC_IP
+    ip.ip.addr = esp_ip4addr_aton(CONFIG_WIFI_MANAGER_STATIC_IP_ADDRESS);
+    ip.netmask.addr = esp_ip4addr_aton(CONFIG_WIFI_MANAGER_STATIC_IP_NETMASK);
+    ip.gw.addr = esp_ip4addr_aton(CONFIG_WIFI_MANAGER_STATIC_IP_GATEWAY);
+    dns.addr = esp_ip4addr_aton(CONFIG_WIFI_MANAGER_STATIC_IP_DNS);
+#elif CONFIG_WIFI_MANAGER_REUSE_LEASE
+    if (lease != NULL) {
+        ip = lease->ip;
+        dns = lease->dns;
+    }
+#endif
+
+    esp_err_t err;
+    if (ip.ip.addr == 0) {
+        err = esp_netif_dhcpc_start(sta_netif);
+        if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+            ESP_LOGE(TAG, "Error running `esp_netif_dhcpc_start`. Error: %s", esp_err_to_name(err));
+            return err;
+        }
+        return ESP_OK;
+    }
+
+    // With a fixed address the netif reports GOT_IP as soon as the station associates,
+    // there's no DHCP exchange to wait on
+    err = esp_netif_dhcpc_stop(sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        ESP_LOGE(TAG, "Error running `esp_netif_dhcpc_stop`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_netif_set_ip_info(sta_netif, &ip);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_netif_set_ip_info`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (dns.addr != 0) {
+        esp_netif_dns_info_t dns_info;
+        memset(&dns_info, 0, sizeof(dns_info));
+        dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+        dns_info.ip.u_addr.ip4.addr = dns.addr;
+        err = esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+        if (err != ESP_OK) ESP_LOGW(TAG, "Error running `esp_netif_set_dns_info`. Error: %s", esp_err_to_name(err));
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,41 @@
+#ifndef WIFI_FAST_H
+#define WIFI_FAST_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_netif.h>
+
+// Fast reconnect cache. Every time the station gets an IP, the AP, channel and lease it
+// got are kept in NVS, so the next boot can go straight to that AP on that channel
+// instead of scanning every channel for the network.
+//
+// The station's address comes from, in order: the static IP in menuconfig, the cached
+// lease if CONFIG_WIFI_MANAGER_REUSE_LEASE is set and the connect is a fast one, or DHCP.
+
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 4000
+
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip;
+    esp_ip4_addr_t dns;
+} wifi_fast_t;
+
+esp_err_t wifi_fast_init(esp_netif_t* netif);
+
+/**
+ * @brief Copies the cache into `fast` if it's for `ssid`, or for any network if `ssid` is
+ * NULL. ESP_ERR_NOT_FOUND otherwise.
+ */
+esp_err_t wifi_fast_get(const char* ssid, wifi_fast_t* fast);
+
+void wifi_fast_forget(void);
+
+/**
+ * @brief Sets up the station's address for the next connect. `lease` is the cached lease
+ * for a fast connect, NULL for any other.
+ */
+esp_err_t wifi_fast_set_ip(const wifi_fast_t* lease);
+
+#endif
@@ -0,0 +1,230 @@
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+
+#include <led_manager.h>
+
+#include "wifi_manager.h"
+#include "wifi_sta.h"
+#include "wifi_job.h"
+
+// States a job is still running in, see `wifi_job_advance`
+#define WIFI_JOB_FROM(state) (1 << (state))
+#define WIFI_JOB_RUNNING (WIFI_JOB_FROM(WIFI_JOB_CONNECTING) | WIFI_JOB_FROM(WIFI_JOB_ASSOCIATED))
+
+static const char* TAG = "Wifi Job";
+
+static portMUX_TYPE job_lock = portMUX_INITIALIZER_UNLOCKED;
+// id 0 is never handed out, so an id of 0 means there hasn't been a job yet
+static wifi_job_t job = { .state = WIFI_JOB_FAILED };
+static int64_t job_start_us = 0;
+static esp_timer_handle_t job_timer;
+// Every task in `wifi_job_wait`, each one is notified on its own so none of them can
+// take a change away from the others
+static TaskHandle_t job_waiters[WIFI_JOB_MAX_WAITERS];
+
+static void wifi_job_notify(void) {
+    TaskHandle_t waiters[WIFI_JOB_MAX_WAITERS];
+    portENTER_CRITICAL_SAFE(&job_lock);
+    memcpy(waiters, job_waiters, sizeof(waiters));
+    portEXIT_CRITICAL_SAFE(&job_lock);
+
+    for (int i=0; i<WIFI_JOB_MAX_WAITERS; i++) {
+        if (waiters[i] != NULL) xTaskNotifyGive(waiters[i]);
+    }
+}
+
+/**
+ * @brief Moves the latest job to `state` if it's in one of the `from` states. Events for
+ * an attempt that was replaced or timed out find it in some other state and are dropped.
+ */
+static void wifi_job_advance(uint8_t from, wifi_job_state_t state, uint8_t reason) {
+    portENTER_CRITICAL_SAFE(&job_lock);
+    bool is_moved = (job.id != 0) && (from & WIFI_JOB_FROM(job.state));
+    if (is_moved) {
+        job.state = state;
+        job.reason = reason;
+        job.version++;
+        job.elapsed_ms = (esp_timer_get_time() - job_start_us) / 1000;
+    }
+    wifi_job_t copy = job;
+    portEXIT_CRITICAL_SAFE(&job_lock);
+
+    if (!is_moved) return;
+
+    wifi_job_notify();
+
+    if (state == WIFI_JOB_CONNECTED) {
+        esp_timer_stop(job_timer);
+        ESP_LOGI(TAG, "Job %u connected to '%s' in %u ms", copy.id, copy.ssid, copy.elapsed_ms);
+        led_fade_in(COLOR_GREEN);
+    } else if (state == WIFI_JOB_FAILED) {
+        esp_timer_stop(job_timer);
+        ESP_LOGW(TAG, "Job %u failed to connect to '%s' after %u ms, reason: %u", copy.id, copy.ssid, copy.elapsed_ms, reason);
+        led_fade_in(COLOR_RED);
+    }
+}
+
+static bool wifi_job_is_for(const uint8_t* ssid, uint8_t ssid_len) {
+    portENTER_CRITICAL_SAFE(&job_lock);
+    bool is_for = (strlen(job.ssid) == ssid_len) && (memcmp(job.ssid, ssid, ssid_len) == 0);
+    portEXIT_CRITICAL_SAFE(&job_lock);
+    return is_for;
+}
+
+static void wifi_job_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*)event_data;
+        if (!wifi_job_is_for(event->ssid, event->ssid_len)) return;
+        wifi_job_advance(WIFI_JOB_FROM(WIFI_JOB_CONNECTING), WIFI_JOB_ASSOCIATED, 0);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*)event_data;
+        // Our own disconnect from whatever was connected before the job started
+        if (event->reason == WIFI_REASON_ASSOC_LEAVE) return;
+        wifi_job_advance(WIFI_JOB_RUNNING, WIFI_JOB_FAILED, event->reason);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        wifi_job_advance(WIFI_JOB_FROM(WIFI_JOB_ASSOCIATED), WIFI_JOB_CONNECTED, 0);
+    }
+}
+
+static void wifi_job_timeout(void* arg) {
+    wifi_job_advance(WIFI_JOB_RUNNING, WIFI_JOB_FAILED, 0);
+    wifi_sta_stop();
+}
+
+esp_err_t wifi_job_init(void) {
+    const esp_timer_create_args_t timer_args = {
+        .callback = wifi_job_timeout,
+        .name = "wifi_job",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &job_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_timer_create`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const int32_t wifi_events[] = { WIFI_EVENT_STA_CONNECTED, WIFI_EVENT_STA_DISCONNECTED };
+    for (int i=0; i<sizeof(wifi_events) / sizeof(wifi_events[0]); i++) {
+        err = esp_event_handler_instance_register(WIFI_EVENT, wifi_events[i], &wifi_job_event_handler, NULL, NULL);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error registering Wi-Fi event handler. Error: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_job_event_handler, NULL, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error registering IP event handler. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_job_start(const char* ssid, const char* password, uint32_t* id) {
+    esp_timer_stop(job_timer);
+
+    portENTER_CRITICAL_SAFE(&job_lock);
+    job.id++;
+    if (job.id == 0) job.id++;
+    job.version = 0;
+    job.state = WIFI_JOB_CONNECTING;
+    job.reason = 0;
+    strncpy(job.ssid, ssid, sizeof(job.ssid) - 1);
+    job.ssid[sizeof(job.ssid) - 1] = '\0';
+    job.elapsed_ms = 0;
+    job_start_us = esp_timer_get_time();
+    *id = job.id;
+    portEXIT_CRITICAL_SAFE(&job_lock);
+
+    // Anyone waiting on the job this replaced finds out it's gone
+    wifi_job_notify();
+
+    esp_err_t err = esp_timer_start_once(job_timer, WIFI_JOB_TIMEOUT_MS * 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_timer_start_once`. Error: %s", esp_err_to_name(err));
+        wifi_job_advance(WIFI_JOB_RUNNING, WIFI_JOB_FAILED, 0);
+        return err;
+    }
+
+    err = wifi_connect_to_ap(ssid, password);
+    if (err != ESP_OK) {
+        wifi_job_advance(WIFI_JOB_RUNNING, WIFI_JOB_FAILED, 0);
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_job_get(uint32_t id, wifi_job_t* out) {
+    portENTER_CRITICAL_SAFE(&job_lock);
+    bool is_found = (id != 0) && (id == job.id);
+    if (is_found) *out = job;
+    int64_t start_us = job_start_us;
+    portEXIT_CRITICAL_SAFE(&job_lock);
+
+    if (!is_found) return ESP_ERR_NOT_FOUND;
+
+    if (!wifi_job_is_finished(out)) out->elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+    return ESP_OK;
+}
+
+/**
+ * @brief Adds the calling task to `job_waiters`. Returns its slot, or -1 if they're all taken.
+ */
+static int wifi_job_add_waiter(void) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    int slot = -1;
+
+    portENTER_CRITICAL_SAFE(&job_lock);
+    for (int i=0; i<WIFI_JOB_MAX_WAITERS; i++) {
+        if (job_waiters[i] == NULL) {
+            job_waiters[i] = self;
+            slot = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&job_lock);
+
+    return slot;
+}
+
+static void wifi_job_remove_waiter(int slot) {
+    portENTER_CRITICAL_SAFE(&job_lock);
+    job_waiters[slot] = NULL;
+    portEXIT_CRITICAL_SAFE(&job_lock);
+}
+
+esp_err_t wifi_job_wait(uint32_t id, uint32_t version, uint32_t timeout_ms, wifi_job_t* out) {
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+
+    // Drop a notification left over from an earlier wait, then register before the first
+    // look, so a change made after the look is still there to wake the wait
+    ulTaskNotifyTake(pdTRUE, 0);
+    int slot = wifi_job_add_waiter();
+    if (slot == -1) {
+        ESP_LOGW(TAG, "Too many tasks waiting on jobs, not waiting");
+        return wifi_job_get(id, out);
+    }
+
+    esp_err_t err;
+    while (true) {
+        err = wifi_job_get(id, out);
+        if (err != ESP_OK || out->version != version || wifi_job_is_finished(out)) break;
+
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout) break;
+
+        ulTaskNotifyTake(pdTRUE, timeout - waited);
+    }
+
+    wifi_job_remove_waiter(slot);
+    return err;
+}
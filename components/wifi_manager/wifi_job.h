@@ -0,0 +1,62 @@
+#ifndef WIFI_JOB_H
+#define WIFI_JOB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+// A connect job is one attempt to join a network, started from the API. It returns as
+// soon as the attempt is under way, and is then moved along by the Wi-Fi and IP events
+// rather than by anyone polling. Only the latest job is kept, starting a new one
+// replaces it.
+
+#define WIFI_JOB_TIMEOUT_MS 15000
+// Longest an API request waits on a job, it holds one of the API's job waiter tasks meanwhile
+#define WIFI_JOB_MAX_WAIT_MS 5000
+// Most tasks that can be in `wifi_job_wait` at once, the API's waiter tasks with room to spare
+#define WIFI_JOB_MAX_WAITERS 4
+
+typedef enum {
+    WIFI_JOB_CONNECTING,
+    // Associated with the AP, waiting on DHCP
+    WIFI_JOB_ASSOCIATED,
+    WIFI_JOB_CONNECTED,
+    WIFI_JOB_FAILED,
+} wifi_job_state_t;
+
+typedef struct {
+    uint32_t id;
+    // Bumped on every state change, so waiters can tell what they've already seen
+    uint32_t version;
+    wifi_job_state_t state;
+    // Disconnect reason for a failed job, 0 if it timed out
+    uint8_t reason;
+    char ssid[33];
+    uint32_t elapsed_ms;
+} wifi_job_t;
+
+esp_err_t wifi_job_init(void);
+
+/**
+ * @brief Starts connecting to `ssid`, replacing any job still running. `id` is set to
+ * the new job's id.
+ */
+esp_err_t wifi_job_start(const char* ssid, const char* password, uint32_t* id);
+
+/**
+ * @brief Copies job `id` into `job`. Returns ESP_ERR_NOT_FOUND if it's not the latest job.
+ */
+esp_err_t wifi_job_get(uint32_t id, wifi_job_t* job);
+
+/**
+ * @brief Like `wifi_job_get`, but first waits up to `timeout_ms` for the job to move
+ * past `version`. Returns straight away if it already has, or has finished. Any number
+ * of tasks up to WIFI_JOB_MAX_WAITERS can wait at once, each is woken by every change.
+ */
+esp_err_t wifi_job_wait(uint32_t id, uint32_t version, uint32_t timeout_ms, wifi_job_t* job);
+
+static inline bool wifi_job_is_finished(const wifi_job_t* job) {
+    return job->state == WIFI_JOB_CONNECTED || job->state == WIFI_JOB_FAILED;
+}
+
+#endif
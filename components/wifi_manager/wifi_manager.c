@@ -1,6 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include <esp_wifi.h>
 #include <esp_err.h>
 #include <esp_system.h>
@@ -11,39 +14,114 @@
 #include <esp_ping.h>
 #include <ping/ping_sock.h>
 #include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <mdns.h>
 #include <esp_vfs.h>
+#include <esp_timer.h>
 #include <sdkconfig.h>
-#include <cJSON.h>
+#include <http_json.h>
 
 #include <led_manager.h>
+#include <led_api.h>
 #include <led_strip.h>
+#include <power_manager.h>
+#include <task_api.h>
 
 #include <esp_http_client.h>
 #include "wifi_manager.h"
+#include "wifi_sta.h"
+#include "wifi_scan.h"
+#include "wifi_fast.h"
+#include "wifi_job.h"
+#include "wifi_profile.h"
+#include "wifi_api.h"
 
 static const char *TAG = "Wifi Manager";
 static httpd_handle_t server = NULL;
-static nvs_handle_t storage_handle;
 static esp_netif_t* cfg_netif_ap;
 static esp_netif_t* cfg_netif_sta;
 
-static bool connection_finished = false;
-static bool connection_success = false;
-
-static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
-    if (event_id == WIFI_EVENT_STA_CONNECTED) {
-        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*)event_data;
-        ESP_LOGI(TAG, "Successfully connected to AP '%.*s'", event->ssid_len, event->ssid);
-        connection_finished = true;
-        connection_success = true;
-    } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*)event_data;
-        ESP_LOGI(TAG, "Disconnected from AP '%.*s' reason: %i", event->ssid_len, event->ssid, event->reason);
-        connection_finished = true;
-        connection_success = false;
-    }
-    ESP_LOGI(TAG, "Got event_base %c, event_id %i", *event_base, event_id);
+static bool wifi_roam_handler(int64_t lost_us);
+
+// How long the CPU is kept at full speed after the last byte to or from any client.
+// A keep-alive socket that just sits open doesn't hold it.
+#define HTTP_IDLE_RELEASE_MS 2000
+
+static SemaphoreHandle_t http_power_mutex = NULL;
+static esp_timer_handle_t http_idle_timer = NULL;
+static bool http_is_awake = false;
+static int64_t http_last_activity = 0;
+
+/**
+ * @brief Keeps the CPU at full speed and out of light sleep while requests are being
+ * served, so they aren't served at the minimum DFS frequency. Takes the lock if it isn't
+ * held and pushes back its release.
+ */
+static void http_note_activity(void) {
+    xSemaphoreTake(http_power_mutex, portMAX_DELAY);
+    http_last_activity = esp_timer_get_time();
+    if (!http_is_awake && power_acquire(POWER_CLIENT_HTTP) == ESP_OK) {
+        http_is_awake = true;
+        esp_timer_start_once(http_idle_timer, HTTP_IDLE_RELEASE_MS * 1000);
+    }
+    xSemaphoreGive(http_power_mutex);
+}
+
+static void http_idle_timeout(void* arg) {
+    xSemaphoreTake(http_power_mutex, portMAX_DELAY);
+    int64_t idle_us = esp_timer_get_time() - http_last_activity;
+    if (idle_us < HTTP_IDLE_RELEASE_MS * 1000) {
+        // There was activity since the timer was armed, wait out the rest
+        esp_timer_start_once(http_idle_timer, HTTP_IDLE_RELEASE_MS * 1000 - idle_us);
+    } else {
+        power_release(POWER_CLIENT_HTTP);
+        http_is_awake = false;
+    }
+    xSemaphoreGive(http_power_mutex);
+}
+
+// Same as the server's default recv and send, but every byte that goes through counts as activity
+static int http_recv(httpd_handle_t hd, int sockfd, char* buf, size_t buf_len, int flags) {
+    int ret = recv(sockfd, buf, buf_len, flags);
+    if (ret < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    if (ret > 0) http_note_activity();
+    return ret;
+}
+
+static int http_send(httpd_handle_t hd, int sockfd, const char* buf, size_t buf_len, int flags) {
+    http_note_activity();
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    return ret;
+}
+
+static esp_err_t http_open_handler(httpd_handle_t hd, int sockfd) {
+    httpd_sess_set_recv_override(hd, sockfd, http_recv);
+    httpd_sess_set_send_override(hd, sockfd, http_send);
+    http_note_activity();
+    return ESP_OK;
+}
+
+static esp_err_t http_power_init(void) {
+    http_power_mutex = xSemaphoreCreateMutex();
+    if (http_power_mutex == NULL) {
+        ESP_LOGE(TAG, "Error creating HTTP power mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = http_idle_timeout,
+        .name = "http_idle",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &http_idle_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_timer_create`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
 }
 
 esp_err_t wifi_init(void) {
@@ -99,11 +177,49 @@ esp_err_t wifi_init(void) {
         return err;
     }
 
-    esp_event_handler_instance_register(WIFI_EVENT,
-                                        ESP_EVENT_ANY_ID,
-                                        &wifi_event_handler,
-                                        NULL,
-                                        NULL);
+    err = wifi_sta_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `wifi_sta_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = wifi_scan_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `wifi_scan_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = wifi_job_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `wifi_job_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = wifi_fast_init(cfg_netif_sta);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `wifi_fast_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = wifi_profile_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `wifi_profile_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = wifi_api_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `wifi_api_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    wifi_sta_set_roam_handler(wifi_roam_handler);
+
+    err = http_power_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `http_power_init`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
 
     // server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
@@ -111,7 +227,10 @@ esp_err_t wifi_init(void) {
     config.recv_wait_timeout = 30;
     config.send_wait_timeout = 30;
     config.uri_match_fn = httpd_uri_match_wildcard;
-    // config.lru_purge_enable = true;
+    config.max_uri_handlers = 24;
+    config.open_fn = http_open_handler;
+    // Idle keep-alive sockets are closed to make room rather than refusing new clients
+    config.lru_purge_enable = true;
     
     err = httpd_start(&server, &config);
     if (err != ESP_OK) {
@@ -119,62 +238,25 @@ esp_err_t wifi_init(void) {
         return err;
     }
 
-    err = nvs_open("wifi_details", NVS_READWRITE, &storage_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error running `nvs_open`. Error: %s", esp_err_to_name(err));
-        return err;
-    }
-
     return ESP_OK;
 }
 
 bool wifi_is_configured(void) {
-    esp_err_t err;
-
-    // We dont actually have to get the string from `nvs_get_str` as if it doesn't
-    // exist, then it will return ESP_ERR_NVS_NOT_FOUND
-    size_t size;
-    err = nvs_get_str(storage_handle, "wifi_ssid", NULL, &size);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        return false;
-    } else if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error running `nvs_get_str` for wifi_ssid. Error: %s", esp_err_to_name(err));
-        return err;
-    }
-
-    err = nvs_get_str(storage_handle, "wifi_password", NULL, &size);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        return false;
-    } else if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error running `nvs_get_str` for wifi_password. Error: %s", esp_err_to_name(err));
-        return err;
-    }
-
-    return true;
+    return wifi_profile_count() > 0;
 }
 
 /**
- * @brief Erases the stored wifi ssid and password. Should NOT be called from an ISR.
+ * @brief Erases every stored network. Should NOT be called from an ISR.
  * Use `wifi_reset_config_ISR` if needed in an ISR.
  * 
  * @param arg arg is the result of also being a Task, should be set to NULL
  */
 void wifi_reset_config(void* arg) {
-    esp_err_t err;
-    
     led_fade_in_ISR(COLOR_RED);
     led_fade_out_ISR();
 
-    err = nvs_erase_key(storage_handle, "wifi_ssid");
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGE(TAG, "Error erasing `wifi_ssid` key from nvs. Error: %s", esp_err_to_name(err));
-        return;
-    }
-    err = nvs_erase_key(storage_handle, "wifi_password");
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGE(TAG, "Error erasing `wifi_password` key from nvs. Error: %s", esp_err_to_name(err));
-        return;
-    }
+    wifi_profile_clear();
+    wifi_fast_forget();
 
     // Using a pointer as a bool
     bool is_task = (bool)arg;
@@ -219,15 +301,14 @@ esp_err_t wifi_start_ap(void) {
         return err;
     }
 
+    // Someone is about to open the config page, have the networks ready for them
+    wifi_scan_refresh();
+
     ESP_LOGI(TAG, "Finished setting up wifi.");
     return ESP_OK;
 }
 
 esp_err_t wifi_connect_to_ap(const char ssid[32], const char password[32]) {
-    esp_err_t err;
-
-    esp_wifi_disconnect();
-
     wifi_config_t ap_config = {
         .sta = {
             .threshold = {
@@ -238,21 +319,12 @@ esp_err_t wifi_connect_to_ap(const char ssid[32], const char password[32]) {
     strncpy((char*)ap_config.sta.ssid, ssid, 32);
     strncpy((char*)ap_config.sta.password, password, 32);
 
-    err = esp_wifi_set_config(WIFI_IF_STA, &ap_config);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error running `esp_wifi_set_config`. Error: %s", esp_err_to_name(err));
-        return err;
-    }
-
-    ESP_LOGI(TAG, "Attempting to connect to SSID: %s Password: %s", ap_config.sta.ssid, ap_config.sta.password);
+    ESP_LOGI(TAG, "Attempting to connect to SSID: %s", ap_config.sta.ssid);
 
-    err = esp_wifi_connect();
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error running `esp_wifi_connect`. Error: %s", esp_err_to_name(err));
-        return err;
-    }
+    esp_err_t err = wifi_fast_set_ip(NULL);
+    if (err != ESP_OK) return err;
 
-    return ESP_OK;
+    return wifi_sta_connect(&ap_config, WIFI_PATH_FULL);
 }
 
 esp_err_t wifi_connect_to_configured_ap(void) {
@@ -261,207 +333,80 @@ esp_err_t wifi_connect_to_configured_ap(void) {
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Getting wifi details from saved configuration.");
-
+    int64_t start_us = esp_timer_get_time();
     esp_err_t err;
 
-    char ssid[32];
-    char password[32];
-    size_t length;
-    err = nvs_get_str(storage_handle, "wifi_ssid", NULL, &length);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `nvs_get_str` to get wifi_ssid length. Error: %s", esp_err_to_name(err));
-    }
-    err = nvs_get_str(storage_handle, "wifi_ssid", ssid, &length);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `nvs_get_str` to get wifi_ssid. Error: %s", esp_err_to_name(err));
-    }
-
-    err = nvs_get_str(storage_handle, "wifi_password", NULL, &length);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `nvs_get_str` to get wifi_password length. Error: %s", esp_err_to_name(err));
-    }
-    err = nvs_get_str(storage_handle, "wifi_password", password, &length);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `nvs_get_str` to get wifi_password. Error: %s", esp_err_to_name(err));
-    }
-
-    ESP_LOGI(TAG, "Attempting to connect to AP");
-
-    connection_finished = false;
-    connection_success = false;
-
-    wifi_connect_to_ap(ssid, password);
-
-    int i = 0;
-    while (!connection_finished) {
-        if (i > 2 * 8) {
-            ESP_LOGI(TAG, "Timed out waiting for connection status");
-            break;
+#if CONFIG_WIFI_MANAGER_FAST_RECONNECT
+    // Straight back to the network the last boot ended up on, if it's still known
+    wifi_fast_t fast;
+    wifi_profile_t profile;
+    if (wifi_fast_get(NULL, &fast) == ESP_OK && wifi_profile_get(fast.ssid, &profile) == ESP_OK) {
+        wifi_config_t ap_config = {
+            .sta = {
+                .scan_method = WIFI_FAST_SCAN,
+                .bssid_set = true,
+                .channel = fast.channel,
+            },
+        };
+        strncpy((char*)ap_config.sta.ssid, profile.ssid, sizeof(ap_config.sta.ssid));
+        strncpy((char*)ap_config.sta.password, profile.password, sizeof(ap_config.sta.password));
+        memcpy(ap_config.sta.bssid, fast.bssid, sizeof(fast.bssid));
+
+        ESP_LOGI(TAG, "Attempting fast connect to AP " MACSTR " on channel %u", MAC2STR(fast.bssid), fast.channel);
+
+        err = wifi_fast_set_ip(&fast);
+        if (err == ESP_OK) err = wifi_sta_connect(&ap_config, WIFI_PATH_FAST);
+        if (err == ESP_OK) err = wifi_sta_wait(WIFI_FAST_CONNECT_TIMEOUT_MS);
+        if (err == ESP_OK) {
+            wifi_profile_mark(profile.ssid, true);
+            return ESP_OK;
         }
-        ESP_LOGI(TAG, "Waiting for connection status...");
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        i++;
-    }
 
-    if (connection_finished && connection_success) {
-        return ESP_OK;
-    } else {
-        return ESP_FAIL;
+        // The AP moved channel, went away or the lease was no good, don't try it again
+        ESP_LOGI(TAG, "Fast connect failed, falling back to a full connect");
+        wifi_sta_stop();
+        wifi_fast_forget();
     }
-}
+#endif
 
-static esp_err_t api_get_ssids_handler(httpd_req_t* req) {
-    esp_err_t err;
+    ESP_LOGI(TAG, "Looking for a known network");
 
-    uint16_t number = DEFAULT_SCAN_LIST_SIZE;
-    wifi_ap_record_t ap_info[DEFAULT_SCAN_LIST_SIZE];
-    uint16_t ap_count = 0;
-    memset(ap_info, 0, sizeof(ap_info));
-
-    err = esp_wifi_scan_start(NULL, true);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `esp_wifi_scan_start`. Error %s", esp_err_to_name(err));
-        httpd_resp_send_500(req);
-        return err;
-    }
-
-    err = esp_wifi_scan_get_ap_records(&number, ap_info);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `esp_wifi_scan_get_ap_records`. Error %s", esp_err_to_name(err));
-        httpd_resp_send_500(req);
-        return err;
-    }
-
-    err = esp_wifi_scan_get_ap_num(&ap_count);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error executing `esp_wifi_scan_get_ap_num`. Error %s", esp_err_to_name(err));
-        httpd_resp_send_500(req);
-        return err;
-    }
-
-    ESP_LOGI(TAG, "Total APs scanned = %u", ap_count);
-
-    cJSON* json = cJSON_CreateObject();
-    cJSON* ssid_arr = cJSON_AddArrayToObject(json, "ssids");
-    for (int i = 0; (i < DEFAULT_SCAN_LIST_SIZE) && (i < ap_count); i++) {
-        ESP_LOGI(TAG, "SSID \t\t%s", ap_info[i].ssid);
-
-        cJSON* ap = cJSON_CreateObject();
-        cJSON_AddItemToObject(ap, "ssid", cJSON_CreateString((char*)(ap_info[i].ssid)));
-        cJSON_AddItemToObject(ap, "is_open", cJSON_CreateBool(ap_info[i].authmode == WIFI_AUTH_OPEN));
-        cJSON_AddItemToArray(ssid_arr, ap);
-    }
-
-    ESP_LOGI(TAG, "APs converted to cJSON object");
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, cJSON_PrintUnformatted(json), HTTPD_RESP_USE_STRLEN);
-    cJSON_Delete(json);
-    ESP_LOGI(TAG, "API Request complete");
-    return ESP_OK;
+    err = wifi_profile_connect(start_us);
+    return (err == ESP_OK) ? ESP_OK : ESP_FAIL;
 }
 
-static esp_err_t api_post_connect_to_ap(httpd_req_t* req) {
-    ESP_LOGI(TAG, "Got request to /connect endpoint");
-
-    char* content = calloc(req->content_len + 1, sizeof(char));
-    
-    // NOTE: `httpd_req_recv` does not add zero-termination
-    int ret = httpd_req_recv(req, content, req->content_len);
-    if (ret <= 0) {
-        ESP_LOGW(TAG, "Error getting HTTP request content. Content length: %i", req->content_len);
-        free(content);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
-        return ESP_FAIL;
-    }
-
-    // httpd_req_recv DOES NOT add zero-termination, so we need to do it.
-    // Technically calloc should zero the memory so any bytes not written
-    // should still be 0s, but I'm still doing it...
-    content[ret] = 0x00;
-
-    ESP_LOGD(TAG, "Connect endpoint content: %s", content);
+// Set from the event loop when roaming starts, cleared by the roam task once it's done
+static volatile bool is_roaming = false;
+static int64_t roam_lost_us;
 
-    cJSON* json = cJSON_Parse(content);
-    if (json == NULL) {
-        const char* err_ptr = cJSON_GetErrorPtr();
-        if (err_ptr != NULL) {
-            ESP_LOGW(TAG, "Error parsing JSON. Error before: %s", err_ptr);
-            free(content);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
-            return ESP_FAIL;
-        }
-    }
-
-    free(content);
-
-    // If the json is correctly formatted, it should be in the following form:
-    /*
-        {
-            "ssid": "TheSSIDHere",
-            "password": "ThePasswordHere"
-        }
-    */
-
-    char ssid[32];
-    char password[32];
-
-    cJSON* ssid_json = cJSON_GetObjectItem(json, "ssid");
-    if (!cJSON_IsString(ssid_json) || ssid_json->valuestring == NULL) {
-        ESP_LOGW(TAG, "Error getting SSID from JSON");
-        cJSON_Delete(json);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
-        return ESP_FAIL;
-    }
-    snprintf(ssid, 32, ssid_json->valuestring);
+/**
+ * @brief Looks through the known networks until one connects, however long that takes.
+ */
+static void wifi_roam_task(void* arg) {
+    wifi_sta_stop();
 
-    cJSON* password_json = cJSON_GetObjectItem(json, "password");
-    if (!cJSON_IsString(password_json) || password_json->valuestring == NULL) {
-        ESP_LOGW(TAG, "Error getting password from JSON");
-        cJSON_Delete(json);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
-        return ESP_FAIL;
+    while (wifi_profile_connect(roam_lost_us) != ESP_OK) {
+        ESP_LOGW(TAG, "No known network connected, looking again in %u ms", WIFI_STA_BACKOFF_MAX_MS);
+        vTaskDelay(pdMS_TO_TICKS(WIFI_STA_BACKOFF_MAX_MS));
     }
-    snprintf(password, 32, password_json->valuestring);
-
-    cJSON_Delete(json);
-
-    connection_finished = false;
-    connection_success = false;
 
-    esp_err_t err = wifi_connect_to_ap(ssid, password);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error connecting to wifi.");
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
-        return ESP_FAIL;
-    }
+    is_roaming = false;
+    vTaskDelete(NULL);
+}
 
-    int i = 0;
-    while (!connection_finished) {
-        if (i > 2 * 8) {
-            ESP_LOGI(TAG, "Timed out waiting for connection status");
-            break;
-        }
-        ESP_LOGI(TAG, "Waiting for connection status...");
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        i++;
-    }
+static bool wifi_roam_handler(int64_t lost_us) {
+    // With a single network there's nowhere else to go, the station keeps reconnecting
+    if (is_roaming || wifi_profile_count() < 2) return false;
 
-    if (connection_finished && connection_success) {
-        led_fade_in(COLOR_GREEN);
-    } else {
-        led_fade_in(COLOR_RED);
+    is_roaming = true;
+    roam_lost_us = lost_us;
+    if (xTaskCreate(wifi_roam_task, "Wifi Roam", 4096, NULL, tskIDLE_PRIORITY + 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Error creating roam task");
+        is_roaming = false;
+        return false;
     }
 
-    cJSON* ret_json = cJSON_CreateObject();
-
-    cJSON_AddItemToObject(ret_json, "status", cJSON_CreateBool(connection_finished && connection_success));
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, cJSON_PrintUnformatted(ret_json), HTTPD_RESP_USE_STRLEN);
-
-    cJSON_Delete(ret_json);
-    
-    return ESP_OK;
+    return true;
 }
 
 static bool ping_finished = false;
@@ -479,18 +424,56 @@ static void test_on_ping_end(esp_ping_handle_t hdl, void *args) {
     ping_finished = true;
     ping_successful = (received > 0);
 
-    esp_err_t err;
-    err = esp_ping_stop(hdl);
+    // The session is kept for the next check, only this run of it ends
+    esp_err_t err = esp_ping_stop(hdl);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error executing `esp_ping_stop`. Error: %s", esp_err_to_name(err));
-        return;
     }
+}
+
+static esp_ping_handle_t ping_session = NULL;
+static uint32_t ping_session_target = 0;
+
+/**
+ * @brief Starts pinging `target`. The session, and the task and socket that come with it,
+ * is made on the first check and kept, and only made again when the gateway changes.
+ */
+static esp_err_t ping_start(const ip_addr_t* target) {
+    esp_err_t err;
+
+    if (ping_session != NULL && ping_session_target != target->u_addr.ip4.addr) {
+        err = esp_ping_delete_session(ping_session);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error executing `esp_ping_delete_session`. Error: %s", esp_err_to_name(err));
+            return err;
+        }
+        ping_session = NULL;
+    }
+
+    if (ping_session == NULL) {
+        esp_ping_config_t ping_config = ESP_PING_DEFAULT_CONFIG();
+        ping_config.target_addr = *target;
+        ping_config.timeout_ms = 500;
 
-    err = esp_ping_delete_session(hdl);
+        esp_ping_callbacks_t cbs = {
+            .on_ping_end = test_on_ping_end,
+        };
+
+        err = esp_ping_new_session(&ping_config, &cbs, &ping_session);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error executing `esp_ping_new_session`. Error: %s", esp_err_to_name(err));
+            ping_session = NULL;
+            return err;
+        }
+        ping_session_target = target->u_addr.ip4.addr;
+        ESP_LOGI(TAG, "Configured ping client");
+    }
+
+    err = esp_ping_start(ping_session);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error executing `esp_ping_delete_session`. Error: %s", esp_err_to_name(err));
-        return;
+        ESP_LOGE(TAG, "Error executing `esp_ping_start`. Error: %s", esp_err_to_name(err));
     }
+    return err;
 }
 
 static esp_err_t api_get_check_connection(httpd_req_t* req) {
@@ -512,31 +495,11 @@ static esp_err_t api_get_check_connection(httpd_req_t* req) {
     ip4addr_ntoa_r(&target_addr.u_addr.ip4, str, IP4ADDR_STRLEN_MAX);
     printf("IP ADDRESS: %s\n", str);
 
-    esp_ping_config_t ping_config = ESP_PING_DEFAULT_CONFIG();
-    ping_config.target_addr = target_addr;
-    ping_config.timeout_ms = 500;
-
-    /* set callback functions */
-    esp_ping_callbacks_t cbs;
-    cbs.on_ping_success = NULL;
-    cbs.on_ping_success = NULL;
-    cbs.on_ping_end = test_on_ping_end;
-
     ping_finished = false;
     ping_successful = false;
 
-    ESP_LOGI(TAG, "Configured ping client");
-
-    esp_ping_handle_t ping;
-    err = esp_ping_new_session(&ping_config, &cbs, &ping);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error executing `esp_ping_new_session`. Error: %s", esp_err_to_name(err));
-        httpd_resp_send_500(req);
-        return err;
-    }
-    err = esp_ping_start(ping);
+    err = ping_start(&target_addr);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error executing `esp_ping_start`. Error: %s", esp_err_to_name(err));
         httpd_resp_send_500(req);
         return err;
     }
@@ -547,8 +510,7 @@ static esp_err_t api_get_check_connection(httpd_req_t* req) {
     while (!ping_finished) {
         if (i >= (1000/PING_WAIT_DELAY_MS) * 6) {
             ESP_LOGI(TAG, "Timed out waiting for ping results");
-            esp_ping_stop(ping);
-            esp_ping_delete_session(ping);
+            esp_ping_stop(ping_session);
             break;
         }
         ESP_LOGI(TAG, "Waiting for ping to finish...");
@@ -558,14 +520,13 @@ static esp_err_t api_get_check_connection(httpd_req_t* req) {
 
     ESP_LOGI(TAG, "IP check finished");
 
-    cJSON* resp_json = cJSON_CreateObject();
-    cJSON_AddItemToObject(resp_json, "success", cJSON_CreateBool(ping_successful));
-
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, cJSON_PrintUnformatted(resp_json), HTTPD_RESP_USE_STRLEN);
-    cJSON_Delete(resp_json);
+    json_writer_t json;
+    json_writer_begin(&json, req);
+    json_write_object(&json, NULL);
+    json_write_bool(&json, "success", ping_successful);
+    json_write_end(&json);
     ESP_LOGI(TAG, "Request handling finished");
-    return ESP_OK;
+    return json_writer_finish(&json);
 }
 
 static esp_err_t api_get_save_connection(httpd_req_t* req) {
@@ -581,20 +542,22 @@ static esp_err_t api_get_save_connection(httpd_req_t* req) {
 
     ESP_LOGI(TAG, "Current SSID: %s Password: %s", wifi_config.sta.ssid, wifi_config.sta.password);
 
-    err = nvs_set_str(storage_handle, "wifi_ssid", (char*)wifi_config.sta.ssid);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error saving wifi ssid. Error: %s", esp_err_to_name(err));
-        httpd_resp_send_500(req);
-        return err;
-    }
+    // The config's fields aren't terminated when they're full
+    char ssid[sizeof(wifi_config.sta.ssid) + 1] = { 0 };
+    char password[sizeof(wifi_config.sta.password) + 1] = { 0 };
+    memcpy(ssid, wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid));
+    memcpy(password, wifi_config.sta.password, sizeof(wifi_config.sta.password));
 
-    err = nvs_set_str(storage_handle, "wifi_password", (char*)wifi_config.sta.password);
+    err = wifi_profile_save(ssid, password, -1);
     if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Error saving wifi password. Error: %s", esp_err_to_name(err));
+        ESP_LOGW(TAG, "Error saving wifi profile. Error: %s", esp_err_to_name(err));
         httpd_resp_send_500(req);
         return err;
     }
 
+    // It's connected right now, so it's the network to prefer next boot
+    wifi_profile_mark(ssid, true);
+
     // httpd_resp_send_err(req, HTTPD_501_METHOD_NOT_IMPLEMENTED, NULL);
     httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
@@ -651,7 +614,8 @@ static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filena
 esp_err_t send_page(httpd_req_t* req, int fd, char* filepath, int status) {
     set_content_type_from_file(req, filepath);
 
-    char* chunk = calloc(1, SCRATCH_BUFSIZE);
+    // Handlers all run on the server's one task, so a single buffer does for every page
+    static char chunk[SCRATCH_BUFSIZE];
     ssize_t read_bytes;
     do {
         /* Read file in chunks into the scratch buffer */
@@ -663,7 +627,6 @@ esp_err_t send_page(httpd_req_t* req, int fd, char* filepath, int status) {
             if (httpd_resp_send_chunk(req, chunk, read_bytes) != ESP_OK) {
                 ESP_LOGE(TAG, "File sending failed!");
                 close(fd);
-                free(chunk);
                 /* Abort sending file */
                 httpd_resp_sendstr_chunk(req, NULL);
                 /* Respond with 500 Internal Server Error */
@@ -672,7 +635,6 @@ esp_err_t send_page(httpd_req_t* req, int fd, char* filepath, int status) {
             }
         }
     } while (read_bytes > 0);
-    free(chunk);
     close(fd);
     ESP_LOGI(TAG, "File sending complete");
     httpd_resp_send_chunk(req, NULL, 0);
@@ -723,20 +685,6 @@ esp_err_t wifi_start_http_server(void) {
         return ESP_FAIL;
     }
 
-    static const httpd_uri_t api_get_ssids = {
-        .uri = "/api/get_ssids",
-        .method = HTTP_GET,
-        .handler = api_get_ssids_handler,
-        .user_ctx = NULL
-    };
-
-    static const httpd_uri_t api_connect = {
-        .uri = "/api/connect",
-        .method = HTTP_POST,
-        .handler = api_post_connect_to_ap,
-        .user_ctx = NULL
-    };
-
     static const httpd_uri_t api_check_connection = {
         .uri = "/api/check_connection",
         .method = HTTP_GET,
@@ -772,12 +720,30 @@ esp_err_t wifi_start_http_server(void) {
         .user_ctx = NULL
     };
     
-    httpd_register_uri_handler(server, &api_get_ssids);
-    httpd_register_uri_handler(server, &api_connect);
     httpd_register_uri_handler(server, &api_check_connection);
     httpd_register_uri_handler(server, &api_save_connection);
     httpd_register_uri_handler(server, &api_reboot);
     httpd_register_uri_handler(server, &api_reset);
+
+    // Has to come before the `/*` file handler, which would otherwise match it first
+    esp_err_t err = wifi_api_register(server);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error registering Wi-Fi API. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = task_api_register(server);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error registering task API. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = led_api_register(server);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error registering LED API. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
     httpd_register_uri_handler(server, &get_handler);
 
     return ESP_OK;
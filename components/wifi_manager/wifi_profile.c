@@ -0,0 +1,315 @@
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp_timer.h>
+#include <nvs.h>
+
+#include "wifi_manager.h"
+#include "wifi_sta.h"
+#include "wifi_scan.h"
+#include "wifi_fast.h"
+#include "wifi_profile.h"
+
+#define WIFI_PROFILE_KEY "wifi_profiles"
+
+static const char* TAG = "Wifi Profile";
+
+typedef struct {
+    // Successful connects so far, handed out as `last_success`
+    uint32_t seq;
+    uint8_t count;
+    wifi_profile_t profiles[WIFI_PROFILE_MAX];
+} wifi_profile_store_t;
+
+typedef struct {
+    const wifi_profile_t* profile;
+    // Strongest AP the scan saw the network on, NULL if it wasn't seen
+    const wifi_scan_ap_t* ap;
+    int score;
+} wifi_candidate_t;
+
+static nvs_handle_t profile_handle;
+// Held over both the change and its write to NVS, so writes land in the order made
+static SemaphoreHandle_t store_lock;
+static wifi_profile_store_t store;
+
+// Only used by `wifi_profile_connect`, which never runs twice at once. Static to keep
+// them off the stack of whichever task is connecting.
+static wifi_profile_t known[WIFI_PROFILE_MAX];
+static wifi_scan_ap_t aps[DEFAULT_SCAN_LIST_SIZE];
+static wifi_candidate_t candidates[WIFI_PROFILE_MAX];
+
+static int wifi_profile_find(const char* ssid) {
+    for (int i=0; i<store.count; i++) {
+        if (strncmp(store.profiles[i].ssid, ssid, sizeof(store.profiles[i].ssid)) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Writes the store to NVS, `store_lock` must be held.
+ */
+static esp_err_t wifi_profile_persist(void) {
+    esp_err_t err = nvs_set_blob(profile_handle, WIFI_PROFILE_KEY, &store, sizeof(store));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_set_blob` for %s. Error: %s", WIFI_PROFILE_KEY, esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_commit(profile_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_commit`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Brings the single network older firmware kept under `wifi_ssid` and
+ * `wifi_password` over as the first profile.
+ */
+static void wifi_profile_migrate(void) {
+    wifi_profile_t* profile = &store.profiles[0];
+    size_t length = sizeof(profile->ssid);
+    if (nvs_get_str(profile_handle, "wifi_ssid", profile->ssid, &length) != ESP_OK) return;
+    length = sizeof(profile->password);
+    if (nvs_get_str(profile_handle, "wifi_password", profile->password, &length) != ESP_OK) return;
+
+    ESP_LOGI(TAG, "Moving stored network '%s' to a profile", profile->ssid);
+    store.count = 1;
+    if (wifi_profile_persist() != ESP_OK) return;
+
+    nvs_erase_key(profile_handle, "wifi_ssid");
+    nvs_erase_key(profile_handle, "wifi_password");
+    nvs_commit(profile_handle);
+}
+
+esp_err_t wifi_profile_init(void) {
+    store_lock = xSemaphoreCreateMutex();
+    if (store_lock == NULL) {
+        ESP_LOGE(TAG, "Error creating profile store lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = nvs_open("wifi_details", NVS_READWRITE, &profile_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `nvs_open`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    size_t length = sizeof(store);
+    err = nvs_get_blob(profile_handle, WIFI_PROFILE_KEY, &store, &length);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        memset(&store, 0, sizeof(store));
+        wifi_profile_migrate();
+    } else if (err != ESP_OK || length != sizeof(store) || store.count > WIFI_PROFILE_MAX) {
+        ESP_LOGW(TAG, "Stored profiles are unreadable, ignoring them");
+        memset(&store, 0, sizeof(store));
+    }
+
+    ESP_LOGI(TAG, "Loaded %u network profiles", store.count);
+    return ESP_OK;
+}
+
+uint8_t wifi_profile_count(void) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    uint8_t count = store.count;
+    xSemaphoreGive(store_lock);
+    return count;
+}
+
+uint8_t wifi_profile_list(wifi_profile_t* profiles) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    uint8_t count = store.count;
+    memcpy(profiles, store.profiles, count * sizeof(store.profiles[0]));
+    xSemaphoreGive(store_lock);
+    return count;
+}
+
+esp_err_t wifi_profile_get(const char* ssid, wifi_profile_t* profile) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int i = wifi_profile_find(ssid);
+    if (i >= 0) *profile = store.profiles[i];
+    xSemaphoreGive(store_lock);
+    return (i >= 0) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t wifi_profile_save(const char* ssid, const char* password, int priority) {
+    if (ssid[0] == '\0' || strlen(ssid) >= sizeof(store.profiles[0].ssid) ||
+        strlen(password) >= sizeof(store.profiles[0].password) || priority > UINT8_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int i = wifi_profile_find(ssid);
+    if (i < 0) {
+        if (store.count == WIFI_PROFILE_MAX) {
+            xSemaphoreGive(store_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        i = store.count++;
+        memset(&store.profiles[i], 0, sizeof(store.profiles[i]));
+        strcpy(store.profiles[i].ssid, ssid);
+    }
+
+    wifi_profile_t* profile = &store.profiles[i];
+    strcpy(profile->password, password);
+    if (priority >= 0) profile->priority = priority;
+    profile->failures = 0;
+
+    esp_err_t err = wifi_profile_persist();
+    xSemaphoreGive(store_lock);
+    return err;
+}
+
+esp_err_t wifi_profile_delete(const char* ssid) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int i = wifi_profile_find(ssid);
+    if (i < 0) {
+        xSemaphoreGive(store_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    memmove(&store.profiles[i], &store.profiles[i + 1], (store.count - i - 1) * sizeof(store.profiles[0]));
+    store.count--;
+
+    esp_err_t err = wifi_profile_persist();
+    xSemaphoreGive(store_lock);
+    return err;
+}
+
+void wifi_profile_clear(void) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    memset(&store, 0, sizeof(store));
+    esp_err_t err = nvs_erase_key(profile_handle, WIFI_PROFILE_KEY);
+    if (err == ESP_OK) err = nvs_commit(profile_handle);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Error erasing `%s` key from nvs. Error: %s", WIFI_PROFILE_KEY, esp_err_to_name(err));
+    }
+    xSemaphoreGive(store_lock);
+}
+
+void wifi_profile_mark(const char* ssid, bool is_success) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int i = wifi_profile_find(ssid);
+    bool is_changed = false;
+    if (i >= 0) {
+        wifi_profile_t* profile = &store.profiles[i];
+        if (is_success) {
+            // Connecting to the same network as last time changes nothing worth a flash write
+            is_changed = (profile->last_success != store.seq || store.seq == 0 || profile->failures != 0);
+            if (is_changed) {
+                profile->last_success = ++store.seq;
+                profile->failures = 0;
+            }
+        } else if (profile->failures < UINT8_MAX) {
+            profile->failures++;
+            is_changed = true;
+        }
+    }
+    if (is_changed) wifi_profile_persist();
+    xSemaphoreGive(store_lock);
+}
+
+/**
+ * @brief Higher is better. Starts from the signal in dBm, then adds 10 per priority
+ * level and 10 for the network that connected most recently, and takes 10 off for each
+ * recent failure, up to 3 of them.
+ */
+static int wifi_profile_score(const wifi_profile_t* profile, int8_t rssi, uint32_t latest) {
+    int score = rssi + 10 * profile->priority;
+    if (latest != 0 && profile->last_success == latest) score += 10;
+    score -= 10 * ((profile->failures < 3) ? profile->failures : 3);
+    return score;
+}
+
+/**
+ * @brief Fills `candidates` with every profile, seen ones first and best first.
+ */
+static void wifi_profile_rank(const wifi_profile_t* profiles, uint8_t count, const wifi_scan_ap_t* seen, uint8_t seen_count) {
+    uint32_t latest = 0;
+    for (int i=0; i<count; i++) {
+        if (profiles[i].last_success > latest) latest = profiles[i].last_success;
+    }
+
+    for (int i=0; i<count; i++) {
+        wifi_candidate_t candidate = { .profile = &profiles[i], .ap = NULL };
+        for (int j=0; j<seen_count; j++) {
+            if (strncmp(seen[j].ssid, profiles[i].ssid, sizeof(seen[j].ssid)) == 0) {
+                candidate.ap = &seen[j];
+                break;
+            }
+        }
+
+        // Unseen profiles still go by priority and history, as if heard at the noise floor
+        candidate.score = wifi_profile_score(&profiles[i], (candidate.ap != NULL) ? candidate.ap->rssi : -100, latest);
+
+        // Insertion sort, there are only ever a handful
+        int at = i;
+        while (at > 0) {
+            const wifi_candidate_t* before = &candidates[at - 1];
+            bool is_better = (candidate.ap != NULL && before->ap == NULL) ||
+                             ((candidate.ap != NULL) == (before->ap != NULL) && candidate.score > before->score);
+            if (!is_better) break;
+            candidates[at] = *before;
+            at--;
+        }
+        candidates[at] = candidate;
+    }
+}
+
+esp_err_t wifi_profile_connect(int64_t since_us) {
+    uint8_t count = wifi_profile_list(known);
+    if (count == 0) return ESP_ERR_NOT_FOUND;
+
+    // A single scan ranks every candidate, the attempts below don't scan again
+    uint8_t seen_count = 0;
+    esp_err_t err = wifi_scan_run(WIFI_PROFILE_SCAN_TIMEOUT_MS);
+    if (err == ESP_OK) {
+        seen_count = wifi_scan_get(aps, NULL);
+    } else {
+        ESP_LOGW(TAG, "Scan failed, trying every profile. Error: %s", esp_err_to_name(err));
+    }
+
+    wifi_profile_rank(known, count, aps, seen_count);
+
+    for (int i=0; i<count; i++) {
+        const wifi_candidate_t* candidate = &candidates[i];
+
+        wifi_config_t config;
+        memset(&config, 0, sizeof(config));
+        strncpy((char*)config.sta.ssid, candidate->profile->ssid, sizeof(config.sta.ssid));
+        strncpy((char*)config.sta.password, candidate->profile->password, sizeof(config.sta.password));
+        if (candidate->ap != NULL) {
+            // Straight to the AP the scan heard, so the connect doesn't scan again
+            config.sta.scan_method = WIFI_FAST_SCAN;
+            config.sta.bssid_set = true;
+            memcpy(config.sta.bssid, candidate->ap->bssid, sizeof(config.sta.bssid));
+            config.sta.channel = candidate->ap->channel;
+        }
+
+        ESP_LOGI(TAG, "Trying '%s', score %d%s", candidate->profile->ssid, candidate->score,
+                 (candidate->ap != NULL) ? "" : ", not seen in the scan");
+
+        err = wifi_fast_set_ip(NULL);
+        if (err == ESP_OK) err = wifi_sta_connect(&config, WIFI_PATH_FULL);
+        if (err == ESP_OK) err = wifi_sta_wait(WIFI_PROFILE_CONNECT_TIMEOUT_MS);
+        if (err == ESP_OK) {
+            uint32_t recover_ms = (esp_timer_get_time() - since_us) / 1000;
+            ESP_LOGI(TAG, "Connected to '%s', %u ms after starting to look", candidate->profile->ssid, recover_ms);
+            wifi_profile_mark(candidate->profile->ssid, true);
+            wifi_sta_count_recovery(recover_ms, i + 1);
+            return ESP_OK;
+        }
+
+        wifi_sta_stop();
+        wifi_profile_mark(candidate->profile->ssid, false);
+    }
+
+    ESP_LOGW(TAG, "None of the %u known networks connected", count);
+    return ESP_FAIL;
+}
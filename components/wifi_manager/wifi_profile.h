@@ -0,0 +1,61 @@
+#ifndef WIFI_PROFILE_H
+#define WIFI_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+// Known networks, kept in NVS. Picking one to join takes a single scan: every profile
+// seen in it is ranked on signal, priority and history (see `wifi_profile_score`), and
+// tried best first, each straight to the AP the scan saw it on and with a short timeout.
+// Profiles the scan missed, which may be hidden networks, are tried last.
+
+#define WIFI_PROFILE_MAX 8
+#define WIFI_PROFILE_SCAN_TIMEOUT_MS 5000
+#define WIFI_PROFILE_CONNECT_TIMEOUT_MS 6000
+
+typedef struct {
+    char ssid[33];
+    char password[65];
+    // Higher is preferred
+    uint8_t priority;
+    // Failed attempts since it last connected
+    uint8_t failures;
+    // Connect count at its last success, so larger is more recent, 0 if it never has
+    uint32_t last_success;
+} wifi_profile_t;
+
+esp_err_t wifi_profile_init(void);
+
+uint8_t wifi_profile_count(void);
+
+/**
+ * @brief Copies every profile into `profiles`, which must have room for WIFI_PROFILE_MAX,
+ * and returns how many there are.
+ */
+uint8_t wifi_profile_list(wifi_profile_t* profiles);
+
+esp_err_t wifi_profile_get(const char* ssid, wifi_profile_t* profile);
+
+/**
+ * @brief Adds or updates the profile for `ssid`. A negative `priority` keeps the existing
+ * one, or 0 for a new profile. ESP_ERR_NO_MEM if all WIFI_PROFILE_MAX are in use.
+ */
+esp_err_t wifi_profile_save(const char* ssid, const char* password, int priority);
+
+esp_err_t wifi_profile_delete(const char* ssid);
+void wifi_profile_clear(void);
+
+/**
+ * @brief Records how a connect to `ssid` went, if it has a profile.
+ */
+void wifi_profile_mark(const char* ssid, bool is_success);
+
+/**
+ * @brief Scans, then tries the known networks best first until one gets an IP. Blocks
+ * for as long as that takes. The time from `since_us` (esp_timer time) to online is
+ * counted as a recovery.
+ */
+esp_err_t wifi_profile_connect(int64_t since_us);
+
+#endif
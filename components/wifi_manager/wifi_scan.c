@@ -0,0 +1,170 @@
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp_event.h>
+#include <esp_timer.h>
+#include <sdkconfig.h>
+
+#include "wifi_scan.h"
+
+#define WIFI_SCAN_DONE_BIT (1 << 0)
+
+static const char* TAG = "Wifi Scan";
+
+static EventGroupHandle_t scan_events;
+
+static portMUX_TYPE scan_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_scan_ap_t cache[DEFAULT_SCAN_LIST_SIZE];
+static uint8_t cache_count = 0;
+// esp_timer time of the last finished scan, 0 before the first one
+static int64_t cache_time_us = 0;
+static bool is_scanning = false;
+
+// Only used from the event loop task, static to keep them off its small stack
+static wifi_ap_record_t records[DEFAULT_SCAN_LIST_SIZE];
+static wifi_scan_ap_t scanned[DEFAULT_SCAN_LIST_SIZE];
+
+/**
+ * @brief Adds `record` to the first `count` entries of `aps`, which are kept sorted
+ * strongest first with one entry per SSID. Returns the new count.
+ */
+static uint8_t wifi_scan_insert(wifi_scan_ap_t* aps, uint8_t count, const wifi_ap_record_t* record) {
+    int at = count;
+    for (int i=0; i<count; i++) {
+        if (strncmp(aps[i].ssid, (const char*)record->ssid, sizeof(aps[i].ssid)) != 0) continue;
+
+        // Another AP for a network already seen, keep whichever is stronger
+        if (aps[i].rssi >= record->rssi) return count;
+        memmove(&aps[i], &aps[i + 1], (count - i - 1) * sizeof(aps[0]));
+        count--;
+        at = count;
+        break;
+    }
+
+    while (at > 0 && aps[at - 1].rssi < record->rssi) {
+        aps[at] = aps[at - 1];
+        at--;
+    }
+
+    wifi_scan_ap_t* ap = &aps[at];
+    strncpy(ap->ssid, (const char*)record->ssid, sizeof(ap->ssid) - 1);
+    ap->ssid[sizeof(ap->ssid) - 1] = '\0';
+    memcpy(ap->bssid, record->bssid, sizeof(ap->bssid));
+    ap->channel = record->primary;
+    ap->rssi = record->rssi;
+    ap->authmode = record->authmode;
+
+    return count + 1;
+}
+
+static void wifi_scan_done_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    wifi_event_sta_scan_done_t* event = (wifi_event_sta_scan_done_t*)event_data;
+
+    // Always collected, the driver holds on to the records until they are
+    uint16_t number = DEFAULT_SCAN_LIST_SIZE;
+    esp_err_t err = esp_wifi_scan_get_ap_records(&number, records);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error running `esp_wifi_scan_get_ap_records`. Error: %s", esp_err_to_name(err));
+        number = 0;
+    }
+
+    if (event->status != 0 || err != ESP_OK) {
+        // Cancelled, usually by a connect. The old results are still the best there are.
+        ESP_LOGW(TAG, "Scan didn't finish, keeping the cached results");
+        portENTER_CRITICAL_SAFE(&scan_lock);
+        is_scanning = false;
+        portEXIT_CRITICAL_SAFE(&scan_lock);
+        xEventGroupSetBits(scan_events, WIFI_SCAN_DONE_BIT);
+        return;
+    }
+
+    uint8_t count = 0;
+    for (int i=0; i<number; i++) {
+        if (records[i].ssid[0] == '\0') continue;
+        count = wifi_scan_insert(scanned, count, &records[i]);
+    }
+
+    ESP_LOGI(TAG, "Scan found %u APs, %u networks", number, count);
+
+    portENTER_CRITICAL_SAFE(&scan_lock);
+    memcpy(cache, scanned, count * sizeof(cache[0]));
+    cache_count = count;
+    cache_time_us = esp_timer_get_time();
+    is_scanning = false;
+    portEXIT_CRITICAL_SAFE(&scan_lock);
+
+    xEventGroupSetBits(scan_events, WIFI_SCAN_DONE_BIT);
+}
+
+esp_err_t wifi_scan_init(void) {
+    scan_events = xEventGroupCreate();
+    if (scan_events == NULL) {
+        ESP_LOGE(TAG, "Error creating scan event group");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &wifi_scan_done_handler, NULL, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error registering scan done handler. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_scan_refresh(void) {
+    portENTER_CRITICAL_SAFE(&scan_lock);
+    bool is_started = is_scanning;
+    is_scanning = true;
+    portEXIT_CRITICAL_SAFE(&scan_lock);
+
+    if (is_started) return ESP_OK;
+
+    esp_err_t err = esp_wifi_scan_start(NULL, false);
+    if (err != ESP_OK) {
+        // Fails while the station is connecting, the next read will try again
+        ESP_LOGW(TAG, "Error running `esp_wifi_scan_start`. Error: %s", esp_err_to_name(err));
+        portENTER_CRITICAL_SAFE(&scan_lock);
+        is_scanning = false;
+        portEXIT_CRITICAL_SAFE(&scan_lock);
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_scan_run(uint32_t timeout_ms) {
+    xEventGroupClearBits(scan_events, WIFI_SCAN_DONE_BIT);
+
+    // A scan already running when this is called counts, it's just as fresh
+    esp_err_t err = wifi_scan_refresh();
+    if (err != ESP_OK) return err;
+
+    EventBits_t bits = xEventGroupWaitBits(scan_events, WIFI_SCAN_DONE_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & WIFI_SCAN_DONE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+uint8_t wifi_scan_get(wifi_scan_ap_t* aps, int64_t* age_ms) {
+    portENTER_CRITICAL_SAFE(&scan_lock);
+    uint8_t count = cache_count;
+    memcpy(aps, cache, count * sizeof(cache[0]));
+    int64_t time_us = cache_time_us;
+    portEXIT_CRITICAL_SAFE(&scan_lock);
+
+    int64_t age = (time_us == 0) ? -1 : (esp_timer_get_time() - time_us) / 1000;
+    if (age_ms != NULL) *age_ms = age;
+
+    if (age < 0 || age >= CONFIG_WIFI_MANAGER_SCAN_TTL * 1000) wifi_scan_refresh();
+
+    return count;
+}
+
+bool wifi_scan_is_running(void) {
+    portENTER_CRITICAL_SAFE(&scan_lock);
+    bool is_running = is_scanning;
+    portEXIT_CRITICAL_SAFE(&scan_lock);
+    return is_running;
+}
@@ -0,0 +1,49 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include <esp_wifi.h>
+
+#include "wifi_manager.h"
+
+// Scans run in the background, started with `wifi_scan_refresh` and finished from the
+// WIFI_EVENT_SCAN_DONE handler, which keeps the results in a cache. Readers are served
+// from the cache straight away, and a read of a cache older than
+// CONFIG_WIFI_MANAGER_SCAN_TTL starts a new scan for the next reader.
+//
+// The cache holds one entry per SSID, for its strongest AP, sorted strongest first.
+// Hidden networks are left out.
+
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+} wifi_scan_ap_t;
+
+esp_err_t wifi_scan_init(void);
+
+/**
+ * @brief Starts a scan unless one is already running. Doesn't wait for it to finish.
+ */
+esp_err_t wifi_scan_refresh(void);
+
+/**
+ * @brief Starts a scan like `wifi_scan_refresh`, and waits up to `timeout_ms` for it to
+ * finish. Only for tasks that can afford to block, never the HTTP server.
+ */
+esp_err_t wifi_scan_run(uint32_t timeout_ms);
+
+/**
+ * @brief Copies the cache into `aps`, which must have room for DEFAULT_SCAN_LIST_SIZE
+ * entries, and returns the number copied. `age_ms` is set to the age of the cache, or
+ * -1 if no scan has finished yet.
+ */
+uint8_t wifi_scan_get(wifi_scan_ap_t* aps, int64_t* age_ms);
+
+bool wifi_scan_is_running(void);
+
+#endif
@@ -0,0 +1,368 @@
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <esp_random.h>
+
+#include "wifi_sta.h"
+
+#define WIFI_STA_ONLINE_BIT (1 << 0)
+#define WIFI_STA_FAILED_BIT (1 << 1)
+
+static const char* TAG = "Wifi Station";
+
+static const char* state_names[WIFI_STATE_MAX] = { "idle", "connecting", "associated", "online", "backoff" };
+
+static EventGroupHandle_t sta_events;
+static esp_timer_handle_t backoff_timer;
+static wifi_sta_roam_handler_t roam_handler = NULL;
+
+// Everything below is guarded by `sta_lock`
+static portMUX_TYPE sta_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_state_t state = WIFI_STATE_IDLE;
+static int64_t state_since_us = 0;
+static int64_t time_in_state_us[WIFI_STATE_MAX];
+static wifi_stats_t stats;
+// Set once the network being connected to has been online, losing it after that
+// reconnects instead of failing
+static bool is_reconnecting = false;
+static uint8_t backoff_attempt = 0;
+static int64_t connect_start_us = 0;
+static wifi_path_t connect_path = WIFI_PATH_FULL;
+static int64_t lost_us = 0;
+
+// Only written by `wifi_sta_connect` and the backoff timer
+static wifi_config_t sta_config;
+
+/**
+ * @brief Moves to `next`, `sta_lock` must be held.
+ */
+static void wifi_sta_enter(wifi_state_t next, int64_t now) {
+    time_in_state_us[state] += now - state_since_us;
+    state = next;
+    state_since_us = now;
+}
+
+/**
+ * @brief Counts a first attempt that didn't get online. `sta_lock` must be held.
+ */
+static void wifi_sta_count_failure(void) {
+    if (!is_reconnecting && (state == WIFI_STATE_CONNECTING || state == WIFI_STATE_ASSOCIATED)) {
+        stats.paths[connect_path].failures++;
+    }
+}
+
+/**
+ * @brief Half fixed and half random, so devices that lose the same AP together don't all
+ * come back at the same moment.
+ */
+static uint32_t wifi_sta_backoff_ms(uint8_t attempt) {
+    uint32_t ceiling = WIFI_STA_BACKOFF_MIN_MS << ((attempt < 8) ? attempt : 8);
+    if (ceiling > WIFI_STA_BACKOFF_MAX_MS) ceiling = WIFI_STA_BACKOFF_MAX_MS;
+    return ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+}
+
+/**
+ * @brief Moves to backoff and schedules the next attempt. `sta_lock` must be held, the
+ * returned delay is for the caller to start the timer with once it has let go.
+ */
+static uint32_t wifi_sta_backoff(int64_t now) {
+    wifi_sta_enter(WIFI_STATE_BACKOFF, now);
+    return wifi_sta_backoff_ms(backoff_attempt++);
+}
+
+static void wifi_sta_start_backoff(uint32_t delay_ms) {
+    ESP_LOGI(TAG, "Reconnecting in %u ms", delay_ms);
+    esp_err_t err = esp_timer_start_once(backoff_timer, delay_ms * 1000);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Error running `esp_timer_start_once`. Error: %s", esp_err_to_name(err));
+}
+
+static void wifi_sta_backoff_expired(void* arg) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    bool is_due = (state == WIFI_STATE_BACKOFF);
+    if (is_due) {
+        wifi_sta_enter(WIFI_STATE_CONNECTING, now);
+        stats.reconnect_attempts++;
+    }
+    uint8_t attempt = backoff_attempt;
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    if (!is_due) return;
+
+    // A fast connect pins the AP and channel it came up on. If that AP has gone for good
+    // the network may still be there on another one, so stop insisting after a retry.
+    if (attempt >= 2 && sta_config.sta.bssid_set) {
+        ESP_LOGI(TAG, "Unpinning AP " MACSTR, MAC2STR(sta_config.sta.bssid));
+        sta_config.sta.bssid_set = false;
+        sta_config.sta.channel = 0;
+        sta_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+        if (err != ESP_OK) ESP_LOGW(TAG, "Error running `esp_wifi_set_config`. Error: %s", esp_err_to_name(err));
+    }
+
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error running `esp_wifi_connect`. Error: %s", esp_err_to_name(err));
+        portENTER_CRITICAL_SAFE(&sta_lock);
+        uint32_t delay_ms = wifi_sta_backoff(now);
+        portEXIT_CRITICAL_SAFE(&sta_lock);
+        wifi_sta_start_backoff(delay_ms);
+    }
+}
+
+static void wifi_sta_on_connected(void) {
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    if (state == WIFI_STATE_CONNECTING) wifi_sta_enter(WIFI_STATE_ASSOCIATED, esp_timer_get_time());
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+}
+
+static void wifi_sta_on_disconnected(uint8_t reason) {
+    // Left on purpose, by `wifi_sta_connect` dropping the last network or by `wifi_sta_stop`
+    if (reason == WIFI_REASON_ASSOC_LEAVE) return;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t delay_ms = 0;
+    bool is_roam = false;
+
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    wifi_state_t from = state;
+    if (from == WIFI_STATE_IDLE || from == WIFI_STATE_BACKOFF) {
+        // Nothing to do, a late event for an attempt already given up on
+    } else if (is_reconnecting) {
+        if (from == WIFI_STATE_ONLINE) {
+            stats.disconnects++;
+            lost_us = now;
+        }
+        delay_ms = wifi_sta_backoff(now);
+        is_roam = (backoff_attempt == WIFI_STA_ROAM_ATTEMPTS);
+    } else {
+        wifi_sta_count_failure();
+        wifi_sta_enter(WIFI_STATE_IDLE, now);
+    }
+    stats.last_reason = reason;
+    int64_t lost = lost_us;
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    if (from == WIFI_STATE_IDLE || from == WIFI_STATE_BACKOFF) return;
+
+    xEventGroupClearBits(sta_events, WIFI_STA_ONLINE_BIT);
+    ESP_LOGI(TAG, "Disconnected while %s, reason: %u", state_names[from], reason);
+
+    if (delay_ms != 0) {
+        wifi_sta_start_backoff(delay_ms);
+        // The network may be gone for good, say the device was moved
+        if (is_roam && roam_handler != NULL && roam_handler(lost)) ESP_LOGI(TAG, "Roaming to another network");
+    } else {
+        xEventGroupSetBits(sta_events, WIFI_STA_FAILED_BIT);
+    }
+}
+
+static void wifi_sta_on_got_ip(void) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    bool is_online = (state == WIFI_STATE_CONNECTING || state == WIFI_STATE_ASSOCIATED);
+    bool is_reconnect = is_reconnecting && (lost_us != 0);
+    if (is_online) {
+        wifi_sta_enter(WIFI_STATE_ONLINE, now);
+        stats.connects++;
+        if (stats.boot_to_online_ms == 0) stats.boot_to_online_ms = now / 1000;
+
+        if (is_reconnect) {
+            stats.last_reconnect_ms = (now - lost_us) / 1000;
+            if (stats.last_reconnect_ms > stats.max_reconnect_ms) stats.max_reconnect_ms = stats.last_reconnect_ms;
+        } else {
+            stats.connect_ms = (now - connect_start_us) / 1000;
+
+            wifi_path_stats_t* path = &stats.paths[connect_path];
+            path->connects++;
+            path->last_ms = stats.connect_ms;
+            if (path->best_ms == 0 || stats.connect_ms < path->best_ms) path->best_ms = stats.connect_ms;
+        }
+
+        is_reconnecting = true;
+        backoff_attempt = 0;
+        lost_us = 0;
+    }
+    wifi_stats_t copy = stats;
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    if (!is_online) return;
+
+    xEventGroupSetBits(sta_events, WIFI_STA_ONLINE_BIT);
+    if (is_reconnect) {
+        ESP_LOGI(TAG, "Back online after %u ms", copy.last_reconnect_ms);
+    } else {
+        ESP_LOGI(TAG, "Online after %u ms on the %s path, %u ms since boot", copy.connect_ms,
+                 (connect_path == WIFI_PATH_FAST) ? "fast" : "full", copy.boot_to_online_ms);
+    }
+}
+
+static void wifi_sta_on_lost_ip(void) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    bool is_lost = (state == WIFI_STATE_ONLINE);
+    if (is_lost) {
+        // Still associated, DHCP will get it back, but it's not usable until then
+        wifi_sta_enter(WIFI_STATE_ASSOCIATED, now);
+        stats.disconnects++;
+        lost_us = now;
+    }
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    if (is_lost) xEventGroupClearBits(sta_events, WIFI_STA_ONLINE_BIT);
+}
+
+static void wifi_sta_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*)event_data;
+        ESP_LOGI(TAG, "Associated with AP '%.*s' on channel %u", event->ssid_len, event->ssid, event->channel);
+        wifi_sta_on_connected();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*)event_data;
+        wifi_sta_on_disconnected(event->reason);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        wifi_sta_on_got_ip();
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        wifi_sta_on_lost_ip();
+    }
+}
+
+esp_err_t wifi_sta_init(void) {
+    sta_events = xEventGroupCreate();
+    if (sta_events == NULL) {
+        ESP_LOGE(TAG, "Error creating station event group");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = wifi_sta_backoff_expired,
+        .name = "wifi_backoff",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &backoff_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_timer_create`. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const struct {
+        esp_event_base_t base;
+        int32_t id;
+    } events[] = {
+        { WIFI_EVENT, WIFI_EVENT_STA_CONNECTED },
+        { WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED },
+        { IP_EVENT, IP_EVENT_STA_GOT_IP },
+        { IP_EVENT, IP_EVENT_STA_LOST_IP },
+    };
+    for (int i=0; i<sizeof(events) / sizeof(events[0]); i++) {
+        err = esp_event_handler_instance_register(events[i].base, events[i].id, &wifi_sta_event_handler, NULL, NULL);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error registering station event handler. Error: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    state_since_us = esp_timer_get_time();
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_sta_connect(const wifi_config_t* config, wifi_path_t path) {
+    esp_timer_stop(backoff_timer);
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    wifi_sta_count_failure();
+    wifi_sta_enter(WIFI_STATE_CONNECTING, now);
+    is_reconnecting = false;
+    backoff_attempt = 0;
+    connect_start_us = now;
+    connect_path = path;
+    lost_us = 0;
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    xEventGroupClearBits(sta_events, WIFI_STA_ONLINE_BIT | WIFI_STA_FAILED_BIT);
+
+    esp_wifi_disconnect();
+
+    sta_config = *config;
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_wifi_set_config`. Error: %s", esp_err_to_name(err));
+        wifi_sta_stop();
+        return err;
+    }
+
+    err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error running `esp_wifi_connect`. Error: %s", esp_err_to_name(err));
+        wifi_sta_stop();
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+void wifi_sta_stop(void) {
+    esp_timer_stop(backoff_timer);
+
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    wifi_sta_count_failure();
+    wifi_sta_enter(WIFI_STATE_IDLE, esp_timer_get_time());
+    is_reconnecting = false;
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    xEventGroupClearBits(sta_events, WIFI_STA_ONLINE_BIT);
+    xEventGroupSetBits(sta_events, WIFI_STA_FAILED_BIT);
+
+    esp_wifi_disconnect();
+}
+
+esp_err_t wifi_sta_wait(uint32_t timeout_ms) {
+    EventBits_t bits = xEventGroupWaitBits(sta_events, WIFI_STA_ONLINE_BIT | WIFI_STA_FAILED_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    if (bits & WIFI_STA_ONLINE_BIT) return ESP_OK;
+    if (bits & WIFI_STA_FAILED_BIT) return ESP_FAIL;
+    return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t wifi_get_stats(wifi_stats_t* out) {
+    if (out == NULL) return ESP_ERR_INVALID_ARG;
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    *out = stats;
+    out->state = state;
+    out->state_ms = (now - state_since_us) / 1000;
+    for (int i=0; i<WIFI_STATE_MAX; i++) {
+        int64_t total_us = time_in_state_us[i] + ((i == state) ? now - state_since_us : 0);
+        out->time_in_state_ms[i] = total_us / 1000;
+    }
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+
+    return ESP_OK;
+}
+
+void wifi_sta_set_roam_handler(wifi_sta_roam_handler_t handler) {
+    roam_handler = handler;
+}
+
+void wifi_sta_count_recovery(uint32_t recover_ms, uint8_t candidates) {
+    portENTER_CRITICAL_SAFE(&sta_lock);
+    stats.recoveries++;
+    stats.last_recover_ms = recover_ms;
+    stats.last_candidates = candidates;
+    portEXIT_CRITICAL_SAFE(&sta_lock);
+}
+
+const char* wifi_state_name(wifi_state_t state) {
+    return (state < WIFI_STATE_MAX) ? state_names[state] : "unknown";
+}
@@ -0,0 +1,58 @@
+#ifndef WIFI_STA_H
+#define WIFI_STA_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_wifi.h>
+
+#include "wifi_manager.h"
+
+// Station state machine, driven entirely by Wi-Fi and IP events. The station only
+// counts as online once DHCP has given it an IP. A network that has been online is
+// reconnected to whenever it's lost, with jittered exponential backoff between
+// attempts. A first attempt that fails is left failed, for the caller to decide what
+// to do next.
+
+#define WIFI_STA_CONNECT_TIMEOUT_MS 15000
+#define WIFI_STA_BACKOFF_MIN_MS 250
+#define WIFI_STA_BACKOFF_MAX_MS 30000
+// Failed reconnects to a lost network before the roam handler is asked to find another
+#define WIFI_STA_ROAM_ATTEMPTS 3
+
+/**
+ * @brief Called from the event loop when a lost network hasn't come back after
+ * WIFI_STA_ROAM_ATTEMPTS tries. `lost_us` is when it was lost. Returns true if it is
+ * taking over, in which case it must stop the station before connecting elsewhere.
+ * Otherwise the reconnects carry on.
+ */
+typedef bool (*wifi_sta_roam_handler_t)(int64_t lost_us);
+
+esp_err_t wifi_sta_init(void);
+
+/**
+ * @brief Drops any current network and starts connecting with `config`. Doesn't wait,
+ * see `wifi_sta_wait`. `path` is only used to file the time to IP under.
+ */
+esp_err_t wifi_sta_connect(const wifi_config_t* config, wifi_path_t path);
+
+/**
+ * @brief Gives up on the current network, and stops reconnecting to it.
+ */
+void wifi_sta_stop(void);
+
+/**
+ * @brief Waits for the attempt started by the last `wifi_sta_connect`. Returns ESP_OK
+ * once online, ESP_FAIL if it failed and ESP_ERR_TIMEOUT if neither happened in time.
+ */
+esp_err_t wifi_sta_wait(uint32_t timeout_ms);
+
+const char* wifi_state_name(wifi_state_t state);
+
+void wifi_sta_set_roam_handler(wifi_sta_roam_handler_t handler);
+
+/**
+ * @brief Counts a recovery that took `recover_ms` and tried `candidates` networks.
+ */
+void wifi_sta_count_recovery(uint32_t recover_ms, uint8_t candidates);
+
+#endif
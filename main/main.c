@@ -9,8 +9,11 @@
 #include <freertos/task.h>
 #include <sdkconfig.h>
 #include <esp_spiffs.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
 #include <led_strip.h>
 
+#include "power_manager.h"
 #include "led_manager.h"
 #include "wifi_manager.h"
 #include "task_manager.h"
@@ -34,7 +37,15 @@ esp_err_t init_fs() {
     return ESP_OK;
 }
 
+static bool is_button_down = false;
+
 static void IRAM_ATTR gpio_button_handler(void* arg) {
+    // Light sleep can only be woken by a level, so the pin waits for high while the button
+    // is up and for low while it is held. Flipping it on every interrupt fires once per press.
+    is_button_down = !is_button_down;
+    gpio_wakeup_enable(GPIO_NUM_34, is_button_down ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    if (!is_button_down) return;
+
     ESP_DRAM_LOGI(TAG, "Called GPIO button handler");
     wifi_reset_config_ISR();
     return;
@@ -44,7 +55,7 @@ esp_err_t init_gpio() {
     esp_err_t err;
     
     gpio_config_t io_conf = {
-        .intr_type = GPIO_INTR_POSEDGE,
+        .intr_type = GPIO_INTR_HIGH_LEVEL,
         .mode = GPIO_MODE_INPUT,
         .pin_bit_mask = (1ULL << 34),
         .pull_down_en = true,
@@ -56,6 +67,19 @@ esp_err_t init_gpio() {
         return err;
     }
 
+    // Sets the same level interrupt as above, and also lets it wake the chip from light sleep
+    err = gpio_wakeup_enable(GPIO_NUM_34, GPIO_INTR_HIGH_LEVEL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error enabling GPIO wakeup. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_sleep_enable_gpio_wakeup();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error enabling light sleep GPIO wakeup. Error: %s", esp_err_to_name(err));
+        return err;
+    }
+
     err = gpio_install_isr_service(0);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error initializing GPIO ISR service. Error: %s", esp_err_to_name(err));
@@ -71,10 +95,39 @@ esp_err_t init_gpio() {
     return ESP_OK;
 }
 
+static void task_event_handler(const task_event_t* event, void* arg) {
+    if (event->type == TASK_TYPE_POMODORO) {
+        switch (event->phase) {
+            case TASK_POMODORO_WORK:
+                led_set_pulse(COLOR_RED);
+                break;
+            case TASK_POMODORO_SHORT_BREAK:
+            case TASK_POMODORO_LONG_BREAK:
+                led_set_pulse(COLOR_GREEN);
+                break;
+        }
+    } else {
+        // Pulse over whatever is showing, then let it through again
+        led_item_t alert = {
+            .type = LED_DISPLAY_PULSE,
+            .color = COLOR_ORANGE,
+            .brightness = LED_DEFAULT_BRIGHTNESS,
+            .duration_ms = 2000
+        };
+        led_layer_set(LED_LAYER_ALERT, &alert);
+    }
+}
+
 void app_main(void) {
     esp_err_t err;
 
-    err = led_init();
+    err = power_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error initializing power management. Error: %s", esp_err_to_name(err));
+        return;
+    }
+
+    err = led_init(NULL);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error initializing LEDs. Error: %s", esp_err_to_name(err));
         return;
@@ -93,6 +146,9 @@ void app_main(void) {
         return;
     }
 
+    // Missing or broken animations are logged and skipped, they aren't worth failing boot over
+    led_anim_load_dir(CONFIG_SETUP_FS_BASE);
+
     err = init_gpio();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error initializing GPIO. Error: %s", esp_err_to_name(err));
@@ -111,10 +167,8 @@ void app_main(void) {
         return;
     }
 
-    task_add(TASK_TYPE_REPEATING);
-    task_add(TASK_TYPE_REPEATING);
-    task_add(TASK_TYPE_REPEATING);
-    task_add(TASK_TYPE_REPEATING);
+    // Tasks are restored from flash by `task_init`
+    task_set_event_handler(task_event_handler, NULL);
 
     err = wifi_start_http_server();
     if (err != ESP_OK) {